@@ -318,6 +318,31 @@
 # define G_MTX_NOPUSH       0x00	/* push or not */
 # define G_MTX_PUSH         0x04
 #endif	/* F3DEX_GBI_2 */
+#ifndef TARGET_N64
+# define G_MTX_FLOAT        0x80	/* PC only: m is a float[4][4], not an Mtx */
+#endif
+
+#ifndef TARGET_N64
+/*
+ * PC only: gDPNoOpTag(pkt, G_TAG_LAYER | layer) marks the start of a render
+ * layer in the master list, G_TAG_LAYER_END its end. Layers whose draw order
+ * doesn't matter also carry G_TAG_LAYER_SORTABLE.
+ */
+# define G_TAG_LAYER          0x4c415900
+# define G_TAG_LAYER_SORTABLE 0x80
+# define G_TAG_LAYER_END      (G_TAG_LAYER | 0xff)
+/*
+ * PC only: gDPNoOpTag(pkt, G_TAG_STATIC_DL) right before a gSPDisplayList
+ * marks the called list as static: it and the lists it calls are the same
+ * every frame and may be recorded once and replayed.
+ */
+# define G_TAG_STATIC_DL      0x5354444c
+/*
+ * PC only: gDPNoOpTag(pkt, G_TAG_BACKGROUND) says the following draws cover
+ * the whole screen with opaque pixels, so clearing it first is unnecessary.
+ */
+# define G_TAG_BACKGROUND     0x424b4744
+#endif
 
 /*
  * flags for G_SETGEOMETRYMODE
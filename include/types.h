@@ -243,6 +243,11 @@ struct Surface
     } normal;
     /*0x28*/ f32 originOffset;
     /*0x2C*/ struct Object *object;
+    // Floors and ceilings: -nx / ny and -nz / ny, with SURFACE_SLOPE_FRAC fraction bits
+    /*0x30*/ struct {
+        s32 x;
+        s32 z;
+    } slope;
 };
 
 struct MarioBodyState
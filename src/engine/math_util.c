@@ -7,6 +7,13 @@
 
 #include "trig_tables.inc.c"
 
+#ifdef FIXED_MATH_UTIL
+#include "math_util_fixed.inc.c"
+#define inv_sqrtf(x) fixed_inv_sqrtf(x)
+#else
+#define inv_sqrtf(x) (1.0 / sqrtf(x))
+#endif
+
 // Variables for a spline curve animation (used for the flight path in the grand star cutscene)
 Vec4s *gSplineKeyframe;
 float gSplineKeyframeFraction;
@@ -131,8 +138,15 @@ void *vec3f_cross(Vec3f dest, Vec3f a, Vec3f b) {
 
 /// Scale vector 'dest' so it has length 1
 void *vec3f_normalize(Vec3f dest) {
+    f32 invsqrt;
+
+#ifdef FIXED_MATH_UTIL
+    if (vec3f_normalize_fixed(dest)) {
+        return &dest; //! warning: function returns address of local variable
+    }
+#endif
     //! Possible division by zero
-    f32 invsqrt = 1.0f / sqrtf(dest[0] * dest[0] + dest[1] * dest[1] + dest[2] * dest[2]);
+    invsqrt = 1.0f / sqrtf(dest[0] * dest[0] + dest[1] * dest[1] + dest[2] * dest[2]);
 
     dest[0] *= invsqrt;
     dest[1] *= invsqrt;
@@ -200,7 +214,7 @@ void mtxf_lookat(Mat4 mtx, Vec3f from, Vec3f to, s16 roll) {
     dx = to[0] - from[0];
     dz = to[2] - from[2];
 
-    invLength = -1.0 / sqrtf(dx * dx + dz * dz);
+    invLength = -inv_sqrtf(dx * dx + dz * dz);
     dx *= invLength;
     dz *= invLength;
 
@@ -212,7 +226,7 @@ void mtxf_lookat(Mat4 mtx, Vec3f from, Vec3f to, s16 roll) {
     yColZ = to[1] - from[1];
     zColZ = to[2] - from[2];
 
-    invLength = -1.0 / sqrtf(xColZ * xColZ + yColZ * yColZ + zColZ * zColZ);
+    invLength = -inv_sqrtf(xColZ * xColZ + yColZ * yColZ + zColZ * zColZ);
     xColZ *= invLength;
     yColZ *= invLength;
     zColZ *= invLength;
@@ -221,7 +235,7 @@ void mtxf_lookat(Mat4 mtx, Vec3f from, Vec3f to, s16 roll) {
     yColX = zColY * xColZ - xColY * zColZ;
     zColX = xColY * yColZ - yColY * xColZ;
 
-    invLength = 1.0 / sqrtf(xColX * xColX + yColX * yColX + zColX * zColX);
+    invLength = inv_sqrtf(xColX * xColX + yColX * yColX + zColX * zColX);
 
     xColX *= invLength;
     yColX *= invLength;
@@ -231,7 +245,7 @@ void mtxf_lookat(Mat4 mtx, Vec3f from, Vec3f to, s16 roll) {
     yColY = zColZ * xColX - xColZ * zColX;
     zColY = xColZ * yColX - yColZ * xColX;
 
-    invLength = 1.0 / sqrtf(xColY * xColY + yColY * yColY + zColY * zColY);
+    invLength = inv_sqrtf(xColY * xColY + yColY * yColY + zColY * zColY);
     xColY *= invLength;
     yColY *= invLength;
     zColY *= invLength;
@@ -271,6 +285,12 @@ void mtxf_rotate_zxy_and_translate(Mat4 dest, Vec3f translate, Vec3s rotate) {
     register f32 sz = sins(rotate[2]);
     register f32 cz = coss(rotate[2]);
 
+#ifdef FIXED_MATH_UTIL
+    if (mtxf_rotate_zxy_and_translate_fixed(dest, translate, rotate)) {
+        return;
+    }
+#endif
+
     dest[0][0] = cy * cz + sx * sy * sz;
     dest[1][0] = -cy * sz + sx * sy * cz;
     dest[2][0] = cx * sy;
@@ -304,6 +324,12 @@ void mtxf_rotate_xyz_and_translate(Mat4 dest, Vec3f b, Vec3s c) {
     register f32 sz = sins(c[2]);
     register f32 cz = coss(c[2]);
 
+#ifdef FIXED_MATH_UTIL
+    if (mtxf_rotate_xyz_and_translate_fixed(dest, b, c)) {
+        return;
+    }
+#endif
+
     dest[0][0] = cy * cz;
     dest[0][1] = cy * sz;
     dest[0][2] = -sy;
@@ -332,6 +358,11 @@ void mtxf_rotate_xyz_and_translate(Mat4 dest, Vec3f b, Vec3s c) {
  * 'angle' rotates the object while still facing the camera.
  */
 void mtxf_billboard(Mat4 dest, Mat4 mtx, Vec3f position, s16 angle) {
+#ifdef FIXED_MATH_UTIL
+    if (mtxf_billboard_fixed(dest, mtx, position, angle)) {
+        return;
+    }
+#endif
     dest[0][0] = coss(angle);
     dest[0][1] = sins(angle);
     dest[0][2] = 0;
@@ -486,6 +517,12 @@ void mtxf_mul(Mat4 dest, Mat4 a, Mat4 b) {
     register f32 entry1;
     register f32 entry2;
 
+#ifdef FIXED_MATH_UTIL
+    if (mtxf_mul_fixed(dest, a, b)) {
+        return;
+    }
+#endif
+
     // column 0
     entry0 = a[0][0];
     entry1 = a[0][1];
@@ -548,6 +585,12 @@ void mtxf_mul_vec3s(Mat4 mtx, Vec3s b) {
     register f32 y = b[1];
     register f32 z = b[2];
 
+#ifdef FIXED_MATH_UTIL
+    if (mtxf_mul_vec3s_fixed(mtx, b)) {
+        return;
+    }
+#endif
+
     b[0] = x * mtx[0][0] + y * mtx[1][0] + z * mtx[2][0] + mtx[3][0];
     b[1] = x * mtx[0][1] + y * mtx[1][1] + z * mtx[2][1] + mtx[3][1];
     b[2] = x * mtx[0][2] + y * mtx[1][2] + z * mtx[2][2] + mtx[3][2];
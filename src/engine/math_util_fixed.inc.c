@@ -0,0 +1,321 @@
+// math_util_fixed.inc.c - fixed point versions of the hottest math_util.c functions, included by
+// math_util.c when FIXED_MATH_UTIL is defined. On targets without an FPU every f32 operation is a
+// libgcc call, so these convert their inputs to integers with plain bit twiddling, do the math with
+// 32x32->64 bit multiplies and build the resulting floats the same way.
+// The float API stays the same. A function returns FALSE when its inputs are out of the range it
+// handles, and the caller falls back to the float code.
+
+#define MTX_FRAC 24  // rotation/scale entries, |x| < 2^MTX_RANGE
+#define MTX_RANGE 6   // a product of two entries is below 2^60, so a sum of three fits an s64
+#define POS_FRAC 12  // translations and positions, |x| < 2^POS_RANGE
+#define POS_RANGE 17
+#define TRIG_FRAC 30 // sine table values
+
+typedef union {
+    f32 f;
+    u32 i;
+} FloatBits;
+
+/// Whether |f| < 2^bits (false for infinities and NaNs)
+static inline s32 f32_fits(f32 f, s32 bits) {
+    FloatBits b;
+    b.f = f;
+    return ((b.i >> 23) & 0xFF) < (u32) (127 + bits);
+}
+
+/// Convert f to fixed point with 'frac' fraction bits, truncating like a cast. The result must fit.
+static inline s32 f32_to_fix(f32 f, s32 frac) {
+    FloatBits b;
+    s32 shift;
+    u32 m;
+    s32 v;
+
+    b.f = f;
+    shift = (s32) ((b.i >> 23) & 0xFF) - (127 + 23) + frac;
+    m = (b.i & 0x7FFFFF) | 0x800000;
+    if (shift >= 0) {
+        v = m << shift;
+    } else if (shift > -32) {
+        v = m >> -shift;
+    } else {
+        v = 0; // also zero and denormals
+    }
+    return (b.i >> 31) ? -v : v;
+}
+
+/// Convert a fixed point number with 'frac' fraction bits to a float, truncating the mantissa
+static inline f32 fix_to_f32(s64 v, s32 frac) {
+    FloatBits b;
+    u64 a;
+    u32 sign = 0;
+    s32 n;
+
+    if (v == 0) {
+        return 0.0f;
+    }
+    if (v < 0) {
+        sign = 0x80000000;
+        a = -v;
+    } else {
+        a = v;
+    }
+    n = __builtin_clzll(a);
+    a <<= n;
+    b.i = sign | ((u32) (127 + 63 - n - frac) << 23) | ((u32) (a >> 40) & 0x7FFFFF);
+    return b.f;
+}
+
+/// 1/sqrt(x) for x in [0.25, 1) with 32 fraction bits, the result has 29 fraction bits
+static u32 rsqrt_q29(u32 x) {
+    // starting guesses for x in [n/16, (n+1)/16), n = 4..15
+    static const u32 guess[12] = {
+        0x3C56FBBC, 0x36945278, 0x3234AAC3, 0x2EBD2E8D, 0x2BE754CE, 0x298757D2,
+        0x27806CA2, 0x25BEC18C, 0x243430A4, 0x22D651EB, 0x219D4C63, 0x20831490,
+    };
+    u32 y = guess[(x >> 28) - 4];
+    s32 i;
+
+    // Newton's method, y = y * (3 - x * y^2) / 2, each step doubles the correct bits
+    for (i = 0; i < 3; i++) {
+        u32 y2 = ((u64) y * y) >> 29;
+        u32 xy2 = ((u64) x * y2) >> 32;
+        y = ((u64) y * ((3u << 29) - xy2)) >> 30;
+    }
+    return y;
+}
+
+/// 1 / sqrtf(f) for positive, finite f
+static f32 fixed_inv_sqrtf(f32 f) {
+    FloatBits b;
+    s32 e;
+    u32 x;
+
+    b.f = f;
+    e = (b.i >> 23) & 0xFF;
+    if ((b.i >> 31) || e == 0 || e == 0xFF) {
+        return 1.0 / sqrtf(f);
+    }
+
+    // f = x * 2^e with x in [0.25, 1) and an even e
+    x = ((b.i & 0x7FFFFF) | 0x800000) << 8;
+    e -= 126;
+    if (e & 1) {
+        x >>= 1;
+        e++;
+    }
+    return fix_to_f32(rsqrt_q29(x), 29 + e / 2);
+}
+
+static s32 vec3f_normalize_fixed(Vec3f dest) {
+    FloatBits b;
+    s32 e = 0;
+    s32 v[3];
+    u64 sum;
+    s32 n;
+    u32 y;
+    s32 i;
+
+    for (i = 0; i < 3; i++) {
+        b.f = dest[i];
+        if ((s32) ((b.i >> 23) & 0xFF) > e) {
+            e = (b.i >> 23) & 0xFF;
+        }
+    }
+    if (e == 0 || e == 0xFF) {
+        return FALSE; // zero or not finite
+    }
+
+    // the largest component goes to [2^22, 2^23), which keeps all of its mantissa bits
+    for (i = 0; i < 3; i++) {
+        v[i] = f32_to_fix(dest[i], 149 - e);
+    }
+    sum = (s64) v[0] * v[0] + (s64) v[1] * v[1] + (s64) v[2] * v[2];
+
+    // sum = x * 2^(64 - n) with x in [0.25, 1), so 1 / sqrt(sum) = 1 / sqrt(x) * 2^(n/2 - 32)
+    n = __builtin_clzll(sum) & ~1;
+    y = rsqrt_q29((sum << n) >> 32);
+
+    for (i = 0; i < 3; i++) {
+        dest[i] = fix_to_f32((s64) v[i] * y, 61 - n / 2);
+    }
+    return TRUE;
+}
+
+static s32 mtxf_mul_fixed(Mat4 dest, Mat4 a, Mat4 b) {
+    s32 fa[4][3];
+    s32 fb[4][3];
+    s32 i;
+    s32 j;
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            if (!f32_fits(a[i][j], MTX_RANGE) || !f32_fits(b[i][j], MTX_RANGE)) {
+                return FALSE;
+            }
+            fa[i][j] = f32_to_fix(a[i][j], MTX_FRAC);
+            fb[i][j] = f32_to_fix(b[i][j], MTX_FRAC);
+        }
+        if (!f32_fits(a[3][i], POS_RANGE) || !f32_fits(b[3][i], POS_RANGE)) {
+            return FALSE;
+        }
+        fa[3][i] = f32_to_fix(a[3][i], POS_FRAC);
+        fb[3][i] = f32_to_fix(b[3][i], POS_FRAC);
+    }
+
+    // both matrices are copied by now, so dest may be one of them
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            dest[i][j] = fix_to_f32((s64) fa[i][0] * fb[0][j] + (s64) fa[i][1] * fb[1][j]
+                                        + (s64) fa[i][2] * fb[2][j],
+                                    MTX_FRAC * 2);
+        }
+        dest[i][3] = 0;
+    }
+    for (j = 0; j < 3; j++) {
+        dest[3][j] = fix_to_f32((s64) fa[3][0] * fb[0][j] + (s64) fa[3][1] * fb[1][j]
+                                    + (s64) fa[3][2] * fb[2][j] + ((s64) fb[3][j] << MTX_FRAC),
+                                POS_FRAC + MTX_FRAC);
+    }
+    dest[3][3] = 1;
+    return TRUE;
+}
+
+static s32 mtxf_rotate_zxy_and_translate_fixed(Mat4 dest, Vec3f translate, Vec3s rotate) {
+    s32 sx = f32_to_fix(sins(rotate[0]), TRIG_FRAC);
+    s32 cx = f32_to_fix(coss(rotate[0]), TRIG_FRAC);
+    s32 sy = f32_to_fix(sins(rotate[1]), TRIG_FRAC);
+    s32 cy = f32_to_fix(coss(rotate[1]), TRIG_FRAC);
+    s32 sz = f32_to_fix(sins(rotate[2]), TRIG_FRAC);
+    s32 cz = f32_to_fix(coss(rotate[2]), TRIG_FRAC);
+    s32 sxsy = ((s64) sx * sy) >> TRIG_FRAC;
+    s32 sxcy = ((s64) sx * cy) >> TRIG_FRAC;
+
+    dest[0][0] = fix_to_f32((s64) cy * cz + (s64) sxsy * sz, TRIG_FRAC * 2);
+    dest[1][0] = fix_to_f32(-(s64) cy * sz + (s64) sxsy * cz, TRIG_FRAC * 2);
+    dest[2][0] = fix_to_f32((s64) cx * sy, TRIG_FRAC * 2);
+    dest[3][0] = translate[0];
+
+    dest[0][1] = fix_to_f32((s64) cx * sz, TRIG_FRAC * 2);
+    dest[1][1] = fix_to_f32((s64) cx * cz, TRIG_FRAC * 2);
+    dest[2][1] = -sins(rotate[0]);
+    dest[3][1] = translate[1];
+
+    dest[0][2] = fix_to_f32(-(s64) sy * cz + (s64) sxcy * sz, TRIG_FRAC * 2);
+    dest[1][2] = fix_to_f32((s64) sy * sz + (s64) sxcy * cz, TRIG_FRAC * 2);
+    dest[2][2] = fix_to_f32((s64) cx * cy, TRIG_FRAC * 2);
+    dest[3][2] = translate[2];
+
+    dest[0][3] = dest[1][3] = dest[2][3] = 0.0f;
+    dest[3][3] = 1.0f;
+    return TRUE;
+}
+
+static s32 mtxf_rotate_xyz_and_translate_fixed(Mat4 dest, Vec3f b, Vec3s c) {
+    s32 sx = f32_to_fix(sins(c[0]), TRIG_FRAC);
+    s32 cx = f32_to_fix(coss(c[0]), TRIG_FRAC);
+    s32 sy = f32_to_fix(sins(c[1]), TRIG_FRAC);
+    s32 cy = f32_to_fix(coss(c[1]), TRIG_FRAC);
+    s32 sz = f32_to_fix(sins(c[2]), TRIG_FRAC);
+    s32 cz = f32_to_fix(coss(c[2]), TRIG_FRAC);
+    s32 sxsy = ((s64) sx * sy) >> TRIG_FRAC;
+    s32 cxsy = ((s64) cx * sy) >> TRIG_FRAC;
+
+    dest[0][0] = fix_to_f32((s64) cy * cz, TRIG_FRAC * 2);
+    dest[0][1] = fix_to_f32((s64) cy * sz, TRIG_FRAC * 2);
+    dest[0][2] = -sins(c[1]);
+    dest[0][3] = 0;
+
+    dest[1][0] = fix_to_f32((s64) sxsy * cz - (s64) cx * sz, TRIG_FRAC * 2);
+    dest[1][1] = fix_to_f32((s64) sxsy * sz + (s64) cx * cz, TRIG_FRAC * 2);
+    dest[1][2] = fix_to_f32((s64) sx * cy, TRIG_FRAC * 2);
+    dest[1][3] = 0;
+
+    dest[2][0] = fix_to_f32((s64) cxsy * cz + (s64) sx * sz, TRIG_FRAC * 2);
+    dest[2][1] = fix_to_f32((s64) cxsy * sz - (s64) sx * cz, TRIG_FRAC * 2);
+    dest[2][2] = fix_to_f32((s64) cx * cy, TRIG_FRAC * 2);
+    dest[2][3] = 0;
+
+    dest[3][0] = b[0];
+    dest[3][1] = b[1];
+    dest[3][2] = b[2];
+    dest[3][3] = 1;
+    return TRUE;
+}
+
+/// Converts the rotation and translation part of mtx, FALSE if they are out of range
+static s32 mtxf_to_fixed(s32 dest[4][3], Mat4 mtx) {
+    s32 i;
+    s32 j;
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            if (!f32_fits(mtx[i][j], MTX_RANGE)) {
+                return FALSE;
+            }
+            dest[i][j] = f32_to_fix(mtx[i][j], MTX_FRAC);
+        }
+        if (!f32_fits(mtx[3][i], POS_RANGE)) {
+            return FALSE;
+        }
+        dest[3][i] = f32_to_fix(mtx[3][i], POS_FRAC);
+    }
+    return TRUE;
+}
+
+static s32 mtxf_billboard_fixed(Mat4 dest, Mat4 mtx, Vec3f position, s16 angle) {
+    s32 m[4][3];
+    s32 p[3];
+    s32 i;
+
+    if (!mtxf_to_fixed(m, mtx)) {
+        return FALSE;
+    }
+    for (i = 0; i < 3; i++) {
+        if (!f32_fits(position[i], POS_RANGE)) {
+            return FALSE;
+        }
+        p[i] = f32_to_fix(position[i], POS_FRAC);
+    }
+
+    dest[0][0] = coss(angle);
+    dest[0][1] = sins(angle);
+    dest[0][2] = 0;
+    dest[0][3] = 0;
+
+    dest[1][0] = -dest[0][1];
+    dest[1][1] = dest[0][0];
+    dest[1][2] = 0;
+    dest[1][3] = 0;
+
+    dest[2][0] = 0;
+    dest[2][1] = 0;
+    dest[2][2] = 1;
+    dest[2][3] = 0;
+
+    for (i = 0; i < 3; i++) {
+        dest[3][i] = fix_to_f32((s64) m[0][i] * p[0] + (s64) m[1][i] * p[1] + (s64) m[2][i] * p[2]
+                                    + ((s64) m[3][i] << MTX_FRAC),
+                                POS_FRAC + MTX_FRAC);
+    }
+    dest[3][3] = 1;
+    return TRUE;
+}
+
+static s32 mtxf_mul_vec3s_fixed(Mat4 mtx, Vec3s b) {
+    s32 m[4][3];
+    s32 x = b[0];
+    s32 y = b[1];
+    s32 z = b[2];
+    s64 v;
+    s32 i;
+
+    if (!mtxf_to_fixed(m, mtx)) {
+        return FALSE;
+    }
+    for (i = 0; i < 3; i++) {
+        v = (s64) x * m[0][i] + (s64) y * m[1][i] + (s64) z * m[2][i] + ((s64) m[3][i] << (MTX_FRAC - POS_FRAC));
+        // truncate toward zero like the float to s16 conversion
+        b[i] = (v < 0) ? -(-v >> MTX_FRAC) : (v >> MTX_FRAC);
+    }
+    return TRUE;
+}
@@ -7,11 +7,93 @@
 #include "game/object_list_processor.h"
 #include "surface_collision.h"
 #include "surface_load.h"
+#include "pc/profiling.h"
 
 /**************************************************
  *                      WALLS                     *
  **************************************************/
 
+/**
+ * Check whether a point lies outside of a wall's triangle, in the plane the wall is
+ * projected on. `w` is the horizontal coordinate in that plane.
+ */
+static s32 point_outside_wall(f32 w1, f32 w2, f32 w3, f32 y1, f32 y2, f32 y3, f32 w, f32 y, s32 facesPositive) {
+    if (facesPositive) {
+        if ((y1 - y) * (w2 - w1) - (w1 - w) * (y2 - y1) > 0.0f) {
+            return TRUE;
+        }
+        if ((y2 - y) * (w3 - w2) - (w2 - w) * (y3 - y2) > 0.0f) {
+            return TRUE;
+        }
+        if ((y3 - y) * (w1 - w3) - (w3 - w) * (y1 - y3) > 0.0f) {
+            return TRUE;
+        }
+    } else {
+        if ((y1 - y) * (w2 - w1) - (w1 - w) * (y2 - y1) < 0.0f) {
+            return TRUE;
+        }
+        if ((y2 - y) * (w3 - w2) - (w2 - w) * (y3 - y2) < 0.0f) {
+            return TRUE;
+        }
+        if ((y3 - y) * (w1 - w3) - (w3 - w) * (y1 - y3) < 0.0f) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Check whether a wall the point is against doesn't apply to the current object or camera.
+ */
+static s32 wall_is_passable(struct Surface *surf) {
+    // Determine if checking for the camera or not.
+    if (gCheckingSurfaceCollisionsForCamera) {
+        if (surf->flags & SURFACE_FLAG_NO_CAM_COLLISION) {
+            return TRUE;
+        }
+    } else {
+        // Ignore camera only surfaces.
+        if (surf->type == SURFACE_CAMERA_BOUNDARY) {
+            return TRUE;
+        }
+
+        // If an object can pass through a vanish cap wall, pass through.
+        if (surf->type == SURFACE_VANISH_CAP_WALLS) {
+            // If an object can pass through a vanish cap wall, pass through.
+            if (gCurrentObject != NULL
+                && (gCurrentObject->activeFlags & ACTIVE_FLAG_MOVE_THROUGH_GRATE)) {
+                return TRUE;
+            }
+
+            // If Mario has a vanish cap, pass through the vanish cap wall.
+            if (gCurrentObject != NULL && gCurrentObject == gMarioObject
+                && (gMarioState->flags & MARIO_VANISH_CAP)) {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Push the point out of a wall and record the wall.
+ */
+static void add_wall_collision(struct WallCollisionData *data, struct Surface *surf, f32 radius, f32 offset) {
+    //! (Wall Overlaps) Because this doesn't update the x and z local variables,
+    //  multiple walls can push mario more than is required.
+    data->x += surf->normal.x * (radius - offset);
+    data->z += surf->normal.z * (radius - offset);
+
+    //! (Unreferenced Walls) Since this only returns the first four walls,
+    //  this can lead to wall interaction being missed. Typically unreferenced walls
+    //  come from only using one wall, however.
+    if (data->numWalls < 4) {
+        data->walls[data->numWalls++] = surf;
+    }
+}
+
 /**
  * Iterate through the list of walls until all walls are checked and
  * have given their wall push.
@@ -25,8 +107,6 @@ static s32 find_wall_collisions_from_list(struct SurfaceNode *surfaceNode,
     register f32 y = data->y + data->offsetY;
     register f32 z = data->z;
     register f32 px, pz;
-    register f32 w1, w2, w3;
-    register f32 y1, y2, y3;
     s32 numCols = 0;
 
     // Max collision radius = 200
@@ -57,96 +137,81 @@ static s32 find_wall_collisions_from_list(struct SurfaceNode *surfaceNode,
         //  the fact they are floating point, certain floating point positions
         //  along the seam of two walls may collide with neither wall or both walls.
         if (surf->flags & SURFACE_FLAG_X_PROJECTION) {
-            w1 = -surf->vertex1[2];            w2 = -surf->vertex2[2];            w3 = -surf->vertex3[2];
-            y1 = surf->vertex1[1];            y2 = surf->vertex2[1];            y3 = surf->vertex3[1];
-
-            if (surf->normal.x > 0.0f) {
-                if ((y1 - y) * (w2 - w1) - (w1 - -pz) * (y2 - y1) > 0.0f) {
-                    continue;
-                }
-                if ((y2 - y) * (w3 - w2) - (w2 - -pz) * (y3 - y2) > 0.0f) {
-                    continue;
-                }
-                if ((y3 - y) * (w1 - w3) - (w3 - -pz) * (y1 - y3) > 0.0f) {
-                    continue;
-                }
-            } else {
-                if ((y1 - y) * (w2 - w1) - (w1 - -pz) * (y2 - y1) < 0.0f) {
-                    continue;
-                }
-                if ((y2 - y) * (w3 - w2) - (w2 - -pz) * (y3 - y2) < 0.0f) {
-                    continue;
-                }
-                if ((y3 - y) * (w1 - w3) - (w3 - -pz) * (y1 - y3) < 0.0f) {
-                    continue;
-                }
+            if (point_outside_wall(-surf->vertex1[2], -surf->vertex2[2], -surf->vertex3[2],
+                                   surf->vertex1[1], surf->vertex2[1], surf->vertex3[1],
+                                   -pz, y, surf->normal.x > 0.0f)) {
+                continue;
             }
         } else {
-            w1 = surf->vertex1[0];            w2 = surf->vertex2[0];            w3 = surf->vertex3[0];
-            y1 = surf->vertex1[1];            y2 = surf->vertex2[1];            y3 = surf->vertex3[1];
-
-            if (surf->normal.z > 0.0f) {
-                if ((y1 - y) * (w2 - w1) - (w1 - px) * (y2 - y1) > 0.0f) {
-                    continue;
-                }
-                if ((y2 - y) * (w3 - w2) - (w2 - px) * (y3 - y2) > 0.0f) {
-                    continue;
-                }
-                if ((y3 - y) * (w1 - w3) - (w3 - px) * (y1 - y3) > 0.0f) {
-                    continue;
-                }
-            } else {
-                if ((y1 - y) * (w2 - w1) - (w1 - px) * (y2 - y1) < 0.0f) {
-                    continue;
-                }
-                if ((y2 - y) * (w3 - w2) - (w2 - px) * (y3 - y2) < 0.0f) {
-                    continue;
-                }
-                if ((y3 - y) * (w1 - w3) - (w3 - px) * (y1 - y3) < 0.0f) {
-                    continue;
-                }
+            if (point_outside_wall(surf->vertex1[0], surf->vertex2[0], surf->vertex3[0],
+                                   surf->vertex1[1], surf->vertex2[1], surf->vertex3[1],
+                                   px, y, surf->normal.z > 0.0f)) {
+                continue;
             }
         }
 
-        // Determine if checking for the camera or not.
-        if (gCheckingSurfaceCollisionsForCamera) {
-            if (surf->flags & SURFACE_FLAG_NO_CAM_COLLISION) {
+        if (wall_is_passable(surf)) {
+            continue;
+        }
+
+        add_wall_collision(data, surf, radius, offset);
+        numCols++;
+    }
+
+    return numCols;
+}
+
+/**
+ * Same as find_wall_collisions_from_list, over a run of the baked static walls.
+ */
+static s32 find_wall_collisions_from_run(struct StaticSurfaceRun *run, struct WallCollisionData *data) {
+    register union StaticSurfaceEdges *edges = &gStaticSurfaceEdges[run->start];
+    register union StaticSurfaceEdges *end = edges + run->count;
+    register struct Surface *surf;
+    register f32 offset;
+    register f32 radius = data->radius;
+    register f32 x = data->x;
+    register f32 y = data->y + data->offsetY;
+    register f32 z = data->z;
+    s32 numCols = 0;
+
+    // Max collision radius = 200
+    if (radius > 200.0f) {
+        radius = 200.0f;
+    }
+
+    for (; edges < end; edges++) {
+        if (y < edges->wy.lowerY || y > edges->wy.upperY) {
+            continue;
+        }
+
+        offset = edges->wy.nx * x + edges->wy.ny * y + edges->wy.nz * z + edges->wy.originOffset;
+
+        if (offset < -radius || offset > radius) {
+            continue;
+        }
+
+        if (edges->wy.flags & SURFACE_FLAG_X_PROJECTION) {
+            if (point_outside_wall(-edges->wy.w[0], -edges->wy.w[1], -edges->wy.w[2],
+                                   edges->wy.y[0], edges->wy.y[1], edges->wy.y[2],
+                                   -z, y, edges->wy.nx > 0.0f)) {
                 continue;
             }
         } else {
-            // Ignore camera only surfaces.
-            if (surf->type == SURFACE_CAMERA_BOUNDARY) {
+            if (point_outside_wall(edges->wy.w[0], edges->wy.w[1], edges->wy.w[2],
+                                   edges->wy.y[0], edges->wy.y[1], edges->wy.y[2],
+                                   x, y, edges->wy.nz > 0.0f)) {
                 continue;
             }
-
-            // If an object can pass through a vanish cap wall, pass through.
-            if (surf->type == SURFACE_VANISH_CAP_WALLS) {
-                // If an object can pass through a vanish cap wall, pass through.
-                if (gCurrentObject != NULL
-                    && (gCurrentObject->activeFlags & ACTIVE_FLAG_MOVE_THROUGH_GRATE)) {
-                    continue;
-                }
-
-                // If Mario has a vanish cap, pass through the vanish cap wall.
-                if (gCurrentObject != NULL && gCurrentObject == gMarioObject
-                    && (gMarioState->flags & MARIO_VANISH_CAP)) {
-                    continue;
-                }
-            }
         }
 
-        //! (Wall Overlaps) Because this doesn't update the x and z local variables,
-        //  multiple walls can push mario more than is required.
-        data->x += surf->normal.x * (radius - offset);
-        data->z += surf->normal.z * (radius - offset);
+        surf = gStaticSurfaceList[edges - gStaticSurfaceEdges];
 
-        //! (Unreferenced Walls) Since this only returns the first four walls,
-        //  this can lead to wall interaction being missed. Typically unreferenced walls
-        //  come from only using one wall, however.
-        if (data->numWalls < 4) {
-            data->walls[data->numWalls++] = surf;
+        if (wall_is_passable(surf)) {
+            continue;
         }
 
+        add_wall_collision(data, surf, radius, offset);
         numCols++;
     }
 
@@ -197,18 +262,17 @@ s32 find_wall_collisions(struct WallCollisionData *colData) {
         return numCollisions;
     }
 
-    // World (level) consists of a 16x16 grid. Find where the collision is on
+    // World (level) consists of a NUM_CELLS x NUM_CELLS grid. Find where the collision is on
     // the grid (round toward -inf)
-    cellX = ((x + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & 0x0F;
-    cellZ = ((z + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & 0x0F;
+    cellX = ((x + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & (NUM_CELLS - 1);
+    cellZ = ((z + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & (NUM_CELLS - 1);
 
     // Check for surfaces belonging to objects.
     node = gDynamicSurfacePartition[cellZ][cellX][SPATIAL_PARTITION_WALLS].next;
     numCollisions += find_wall_collisions_from_list(node, colData);
 
     // Check for surfaces that are a part of level geometry.
-    node = gStaticSurfacePartition[cellZ][cellX][SPATIAL_PARTITION_WALLS].next;
-    numCollisions += find_wall_collisions_from_list(node, colData);
+    numCollisions += find_wall_collisions_from_run(&gStaticSurfaceRuns[cellZ][cellX][SPATIAL_PARTITION_WALLS], colData);
 
     // Increment the debug tracker.
     gNumCalls.wall += 1;
@@ -220,6 +284,52 @@ s32 find_wall_collisions(struct WallCollisionData *colData) {
  *                     CEILINGS                   *
  **************************************************/
 
+/**
+ * Height of a floor or ceiling at a point, with SURFACE_SLOPE_FRAC fraction bits. Taking the
+ * plane through the first vertex keeps the terms small, and the s64 products are a single
+ * multiply-accumulate each on ARM, where the f32 version of -(x * nx + nz * z + oo) / ny takes
+ * a libgcc call per operation. Floors and ceilings have |ny| > 0.01, so there's no wall to
+ * guard against.
+ */
+static s64 surface_height_at(struct Surface *surf, s32 x, s32 z) {
+    return ((s64) surf->vertex1[1] << SURFACE_SLOPE_FRAC)
+           + (s64)(x - surf->vertex1[0]) * surf->slope.x
+           + (s64)(z - surf->vertex1[2]) * surf->slope.z;
+}
+
+/**
+ * Check a ceiling that is laterally over a point: whether it applies to the current check,
+ * and if so, its height at the point.
+ */
+static s32 ceil_height_at(struct Surface *surf, s32 x, s32 y, s32 z, f32 *pheight) {
+    s64 height;
+
+    // Determine if checking for the camera or not.
+    if (gCheckingSurfaceCollisionsForCamera != 0) {
+        if (surf->flags & SURFACE_FLAG_NO_CAM_COLLISION) {
+            return FALSE;
+        }
+    }
+    // Ignore camera only surfaces.
+    else if (surf->type == SURFACE_CAMERA_BOUNDARY) {
+        return FALSE;
+    }
+
+    // Find the ceil height at the specific point.
+    height = surface_height_at(surf, x, z);
+
+    // Checks for ceiling interaction with a 78 unit buffer.
+    //! (Exposed Ceilings) Because any point above a ceiling counts
+    //  as interacting with a ceiling, ceilings far below can cause
+    // "invisible walls" that are really just exposed ceilings.
+    if (((s64)(y - 78) << SURFACE_SLOPE_FRAC) > height) {
+        return FALSE;
+    }
+
+    *pheight = (f32) height * (1.0f / (1 << SURFACE_SLOPE_FRAC));
+    return TRUE;
+}
+
 /**
  * Iterate through the list of ceilings and find the first ceiling over a given point.
  */
@@ -255,41 +365,7 @@ static struct Surface *find_ceil_from_list(struct SurfaceNode *surfaceNode, s32
             continue;
         }
 
-        // Determine if checking for the camera or not.
-        if (gCheckingSurfaceCollisionsForCamera != 0) {
-            if (surf->flags & SURFACE_FLAG_NO_CAM_COLLISION) {
-                continue;
-            }
-        }
-        // Ignore camera only surfaces.
-        else if (surf->type == SURFACE_CAMERA_BOUNDARY) {
-            continue;
-        }
-
-        {
-            f32 nx = surf->normal.x;
-            f32 ny = surf->normal.y;
-            f32 nz = surf->normal.z;
-            f32 oo = surf->originOffset;
-            f32 height;
-
-            // If a wall, ignore it. Likely a remnant, should never occur.
-            if (ny == 0.0f) {
-                continue;
-            }
-
-            // Find the ceil height at the specific point.
-            height = -(x * nx + nz * z + oo) / ny;
-
-            // Checks for ceiling interaction with a 78 unit buffer.
-            //! (Exposed Ceilings) Because any point above a ceiling counts
-            //  as interacting with a ceiling, ceilings far below can cause
-            // "invisible walls" that are really just exposed ceilings.
-            if (y - (height - -78.0f) > 0.0f) {
-                continue;
-            }
-
-            *pheight = height;
+        if (ceil_height_at(surf, x, y, z, pheight)) {
             ceil = surf;
             break;
         }
@@ -300,6 +376,35 @@ static struct Surface *find_ceil_from_list(struct SurfaceNode *surfaceNode, s32
     return ceil;
 }
 
+/**
+ * Same as find_ceil_from_list, over a run of the baked static ceilings.
+ */
+static struct Surface *find_ceil_from_run(struct StaticSurfaceRun *run, s32 x, s32 y, s32 z, f32 *pheight) {
+    register union StaticSurfaceEdges *edges = &gStaticSurfaceEdges[run->start];
+    register union StaticSurfaceEdges *end = edges + run->count;
+    register struct Surface *surf;
+
+    for (; edges < end; edges++) {
+        // Checking if point is in bounds of the triangle laterally.
+        if (edges->xz.a[0] * x + edges->xz.b[0] * z + edges->xz.c[0] > 0) {
+            continue;
+        }
+        if (edges->xz.a[1] * x + edges->xz.b[1] * z + edges->xz.c[1] > 0) {
+            continue;
+        }
+        if (edges->xz.a[2] * x + edges->xz.b[2] * z + edges->xz.c[2] > 0) {
+            continue;
+        }
+
+        surf = gStaticSurfaceList[edges - gStaticSurfaceEdges];
+        if (ceil_height_at(surf, x, y, z, pheight)) {
+            return surf;
+        }
+    }
+
+    return NULL;
+}
+
 /**
  * Find the lowest ceiling above a given position and return the height.
  */
@@ -327,16 +432,15 @@ f32 find_ceil(f32 posX, f32 posY, f32 posZ, struct Surface **pceil) {
     }
 
     // Each level is split into cells to limit load, find the appropriate cell.
-    cellX = ((x + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & 0xF;
-    cellZ = ((z + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & 0xF;
+    cellX = ((x + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & (NUM_CELLS - 1);
+    cellZ = ((z + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & (NUM_CELLS - 1);
 
     // Check for surfaces belonging to objects.
     surfaceList = gDynamicSurfacePartition[cellZ][cellX][SPATIAL_PARTITION_CEILS].next;
     dynamicCeil = find_ceil_from_list(surfaceList, x, y, z, &dynamicHeight);
 
     // Check for surfaces that are a part of level geometry.
-    surfaceList = gStaticSurfacePartition[cellZ][cellX][SPATIAL_PARTITION_CEILS].next;
-    ceil = find_ceil_from_list(surfaceList, x, y, z, &height);
+    ceil = find_ceil_from_run(&gStaticSurfaceRuns[cellZ][cellX][SPATIAL_PARTITION_CEILS], x, y, z, &height);
 
     if (dynamicHeight < height) {
         ceil = dynamicCeil;
@@ -393,15 +497,41 @@ f32 find_floor_height_and_data(f32 xPos, f32 yPos, f32 zPos, struct FloorGeometr
     return floorHeight;
 }
 
+/**
+ * Check a floor that is laterally under a point: whether it applies to the current check,
+ * and if so, its height at the point.
+ */
+static s32 floor_height_at(struct Surface *surf, s32 x, s32 y, s32 z, f32 *pheight) {
+    s64 height;
+
+    // Determine if we are checking for the camera or not.
+    if (gCheckingSurfaceCollisionsForCamera != 0) {
+        if (surf->flags & SURFACE_FLAG_NO_CAM_COLLISION) {
+            return FALSE;
+        }
+    }
+    // If we are not checking for the camera, ignore camera only floors.
+    else if (surf->type == SURFACE_CAMERA_BOUNDARY) {
+        return FALSE;
+    }
+
+    // Find the height of the floor at a given location.
+    height = surface_height_at(surf, x, z);
+    // Checks for floor interaction with a 78 unit buffer.
+    if (((s64)(y + 78) << SURFACE_SLOPE_FRAC) < height) {
+        return FALSE;
+    }
+
+    *pheight = (f32) height * (1.0f / (1 << SURFACE_SLOPE_FRAC));
+    return TRUE;
+}
+
 /**
  * Iterate through the list of floors and find the first floor under a given point.
  */
 static struct Surface *find_floor_from_list(struct SurfaceNode *surfaceNode, s32 x, s32 y, s32 z, f32 *pheight) {
     register struct Surface *surf;
     register s32 x1, z1, x2, z2, x3, z3;
-    f32 nx, ny, nz;
-    f32 oo;
-    f32 height;
     struct Surface *floor = NULL;
 
     // Iterate through the list of floors until there are no more floors.
@@ -430,42 +560,44 @@ static struct Surface *find_floor_from_list(struct SurfaceNode *surfaceNode, s32
             continue;
         }
 
-        // Determine if we are checking for the camera or not.
-        if (gCheckingSurfaceCollisionsForCamera != 0) {
-            if (surf->flags & SURFACE_FLAG_NO_CAM_COLLISION) {
-                continue;
-            }
-        }
-        // If we are not checking for the camera, ignore camera only floors.
-        else if (surf->type == SURFACE_CAMERA_BOUNDARY) {
-            continue;
+        if (floor_height_at(surf, x, y, z, pheight)) {
+            floor = surf;
+            break;
         }
+    }
 
-        nx = surf->normal.x;
-        ny = surf->normal.y;
-        nz = surf->normal.z;
-        oo = surf->originOffset;
+    //! (Surface Cucking) Since only the first floor is returned and not the highest,
+    //  higher floors can be "cucked" by lower floors.
+    return floor;
+}
+
+/**
+ * Same as find_floor_from_list, over a run of the baked static floors.
+ */
+static struct Surface *find_floor_from_run(struct StaticSurfaceRun *run, s32 x, s32 y, s32 z, f32 *pheight) {
+    register union StaticSurfaceEdges *edges = &gStaticSurfaceEdges[run->start];
+    register union StaticSurfaceEdges *end = edges + run->count;
+    register struct Surface *surf;
 
-        // If a wall, ignore it. Likely a remnant, should never occur.
-        if (ny == 0.0f) {
+    for (; edges < end; edges++) {
+        // Check that the point is within the triangle bounds.
+        if (edges->xz.a[0] * x + edges->xz.b[0] * z + edges->xz.c[0] < 0) {
             continue;
         }
-
-        // Find the height of the floor at a given location.
-        height = -(x * nx + nz * z + oo) / ny;
-        // Checks for floor interaction with a 78 unit buffer.
-        if (y - (height + -78.0f) < 0.0f) {
+        if (edges->xz.a[1] * x + edges->xz.b[1] * z + edges->xz.c[1] < 0) {
+            continue;
+        }
+        if (edges->xz.a[2] * x + edges->xz.b[2] * z + edges->xz.c[2] < 0) {
             continue;
         }
 
-        *pheight = height;
-        floor = surf;
-        break;
+        surf = gStaticSurfaceList[edges - gStaticSurfaceEdges];
+        if (floor_height_at(surf, x, y, z, pheight)) {
+            return surf;
+        }
     }
 
-    //! (Surface Cucking) Since only the first floor is returned and not the highest,
-    //  higher floors can be "cucked" by lower floors.
-    return floor;
+    return NULL;
 }
 
 /**
@@ -494,8 +626,8 @@ f32 unused_find_dynamic_floor(f32 xPos, f32 yPos, f32 zPos, struct Surface **pfl
     s16 z = (s16) zPos;
 
     // Each level is split into cells to limit load, find the appropriate cell.
-    s16 cellX = ((x + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & 0x0F;
-    s16 cellZ = ((z + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & 0x0F;
+    s16 cellX = ((x + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & (NUM_CELLS - 1);
+    s16 cellZ = ((z + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & (NUM_CELLS - 1);
 
     surfaceList = gDynamicSurfacePartition[cellZ][cellX][SPATIAL_PARTITION_FLOORS].next;
     floor = find_floor_from_list(surfaceList, x, y, z, &floorHeight);
@@ -505,6 +637,92 @@ f32 unused_find_dynamic_floor(f32 xPos, f32 yPos, f32 zPos, struct Surface **pfl
     return floorHeight;
 }
 
+/**
+ * Memo of the static part of find_floor. Objects that stay in place query the same point every
+ * frame, and the static surfaces only change when an area's terrain is loaded, which clears it.
+ * Dynamic surfaces are reloaded every frame, so they're always walked instead.
+ */
+#define FLOOR_MEMO_SIZE 64
+
+#define FLOOR_MEMO_VALID      (1 << 0)
+#define FLOOR_MEMO_CAMERA     (1 << 1)
+#define FLOOR_MEMO_INTANGIBLE (1 << 2)
+
+struct FloorMemoEntry
+{
+    s16 x, y, z;
+    s16 flags;
+    struct Surface *floor;
+    f32 height;
+};
+
+static struct FloorMemoEntry sFloorMemo[FLOOR_MEMO_SIZE];
+
+/**
+ * Forget the memoized static floors, for when the static surfaces change.
+ */
+void clear_floor_memo(void) {
+    s32 i;
+
+    for (i = 0; i < FLOOR_MEMO_SIZE; i++) {
+        sFloorMemo[i].flags = 0;
+    }
+}
+
+/**
+ * Find the highest static floor under a given position, skipping the intangible floors
+ * unless asked for them.
+ */
+static struct Surface *find_static_floor(s16 x, s16 y, s16 z, f32 *pheight) {
+    struct StaticSurfaceRun *staticFloors;
+    struct FloorMemoEntry *memo;
+    struct Surface *floor;
+    s16 flags = FLOOR_MEMO_VALID;
+
+    if (gCheckingSurfaceCollisionsForCamera != 0) {
+        flags |= FLOOR_MEMO_CAMERA;
+    }
+    if (gFindFloorIncludeSurfaceIntangible) {
+        flags |= FLOOR_MEMO_INTANGIBLE;
+    }
+
+    memo = &sFloorMemo[(x * 73 + y * 151 + z * 199) & (FLOOR_MEMO_SIZE - 1)];
+    if (memo->flags == flags && memo->x == x && memo->y == y && memo->z == z) {
+        floorMemoHits++;
+        *pheight = memo->height;
+        return memo->floor;
+    }
+    floorMemoMisses++;
+
+    // Each level is split into cells to limit load, find the appropriate cell.
+    staticFloors = &gStaticSurfaceRuns[((z + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & (NUM_CELLS - 1)]
+                                      [((x + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & (NUM_CELLS - 1)]
+                                      [SPATIAL_PARTITION_FLOORS];
+    floor = find_floor_from_run(staticFloors, x, y, z, pheight);
+
+    // To prevent the Merry-Go-Round room from loading when Mario passes above the hole that leads
+    // there, SURFACE_INTANGIBLE is used. This prevent the wrong room from loading, but can also allow
+    // Mario to pass through.
+    if (!gFindFloorIncludeSurfaceIntangible) {
+        //! (BBH Crash) Most NULL checking is done by checking the height of the floor returned
+        //  instead of checking directly for a NULL floor. If this check returns a NULL floor
+        //  (happens when there is no floor under the SURFACE_INTANGIBLE floor) but returns the height
+        //  of the SURFACE_INTANGIBLE floor instead of the typical -11000 returned for a NULL floor.
+        if (floor != NULL && floor->type == SURFACE_INTANGIBLE) {
+            floor = find_floor_from_run(staticFloors, x, (s32)(*pheight - 200.0f), z, pheight);
+        }
+    }
+
+    memo->x = x;
+    memo->y = y;
+    memo->z = z;
+    memo->flags = flags;
+    memo->floor = floor;
+    memo->height = *pheight;
+
+    return floor;
+}
+
 /**
  * Find the highest floor under a given position and return the height.
  */
@@ -534,29 +752,17 @@ f32 find_floor(f32 xPos, f32 yPos, f32 zPos, struct Surface **pfloor) {
     }
 
     // Each level is split into cells to limit load, find the appropriate cell.
-    cellX = ((x + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & 0xF;
-    cellZ = ((z + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & 0xF;
+    cellX = ((x + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & (NUM_CELLS - 1);
+    cellZ = ((z + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & (NUM_CELLS - 1);
 
     // Check for surfaces belonging to objects.
     surfaceList = gDynamicSurfacePartition[cellZ][cellX][SPATIAL_PARTITION_FLOORS].next;
     dynamicFloor = find_floor_from_list(surfaceList, x, y, z, &dynamicHeight);
 
     // Check for surfaces that are a part of level geometry.
-    surfaceList = gStaticSurfacePartition[cellZ][cellX][SPATIAL_PARTITION_FLOORS].next;
-    floor = find_floor_from_list(surfaceList, x, y, z, &height);
+    floor = find_static_floor(x, y, z, &height);
 
-    // To prevent the Merry-Go-Round room from loading when Mario passes above the hole that leads
-    // there, SURFACE_INTANGIBLE is used. This prevent the wrong room from loading, but can also allow
-    // Mario to pass through.
-    if (!gFindFloorIncludeSurfaceIntangible) {
-        //! (BBH Crash) Most NULL checking is done by checking the height of the floor returned
-        //  instead of checking directly for a NULL floor. If this check returns a NULL floor
-        //  (happens when there is no floor under the SURFACE_INTANGIBLE floor) but returns the height
-        //  of the SURFACE_INTANGIBLE floor instead of the typical -11000 returned for a NULL floor.
-        if (floor != NULL && floor->type == SURFACE_INTANGIBLE) {
-            floor = find_floor_from_list(surfaceList, x, (s32)(height - 200.0f), z, &height);
-        }
-    } else {
+    if (gFindFloorIncludeSurfaceIntangible) {
         // To prevent accidentally leaving the floor tangible, stop checking for it.
         gFindFloorIncludeSurfaceIntangible = FALSE;
     }
@@ -689,25 +895,25 @@ void debug_surface_list_info(f32 xPos, f32 zPos) {
     s32 cellX = (xPos + LEVEL_BOUNDARY_MAX) / CELL_SIZE;
     s32 cellZ = (zPos + LEVEL_BOUNDARY_MAX) / CELL_SIZE;
 
-    list = gStaticSurfacePartition[cellZ & 0x0F][cellX & 0x0F][SPATIAL_PARTITION_FLOORS].next;
+    list = gStaticSurfacePartition[cellZ & (NUM_CELLS - 1)][cellX & (NUM_CELLS - 1)][SPATIAL_PARTITION_FLOORS].next;
     numFloors += surface_list_length(list);
 
-    list = gDynamicSurfacePartition[cellZ & 0x0F][cellX & 0x0F][SPATIAL_PARTITION_FLOORS].next;
+    list = gDynamicSurfacePartition[cellZ & (NUM_CELLS - 1)][cellX & (NUM_CELLS - 1)][SPATIAL_PARTITION_FLOORS].next;
     numFloors += surface_list_length(list);
 
-    list = gStaticSurfacePartition[cellZ & 0x0F][cellX & 0x0F][SPATIAL_PARTITION_WALLS].next;
+    list = gStaticSurfacePartition[cellZ & (NUM_CELLS - 1)][cellX & (NUM_CELLS - 1)][SPATIAL_PARTITION_WALLS].next;
     numWalls += surface_list_length(list);
 
-    list = gDynamicSurfacePartition[cellZ & 0x0F][cellX & 0x0F][SPATIAL_PARTITION_WALLS].next;
+    list = gDynamicSurfacePartition[cellZ & (NUM_CELLS - 1)][cellX & (NUM_CELLS - 1)][SPATIAL_PARTITION_WALLS].next;
     numWalls += surface_list_length(list);
 
-    list = gStaticSurfacePartition[cellZ & 0x0F][cellX & 0x0F][SPATIAL_PARTITION_CEILS].next;
+    list = gStaticSurfacePartition[cellZ & (NUM_CELLS - 1)][cellX & (NUM_CELLS - 1)][SPATIAL_PARTITION_CEILS].next;
     numCeils += surface_list_length(list);
 
-    list = gDynamicSurfacePartition[cellZ & 0x0F][cellX & 0x0F][SPATIAL_PARTITION_CEILS].next;
+    list = gDynamicSurfacePartition[cellZ & (NUM_CELLS - 1)][cellX & (NUM_CELLS - 1)][SPATIAL_PARTITION_CEILS].next;
     numCeils += surface_list_length(list);
 
-    print_debug_top_down_mapinfo("area   %x", cellZ * 16 + cellX);
+    print_debug_top_down_mapinfo("area   %x", cellZ * NUM_CELLS + cellX);
 
     // Names represent ground, walls, and roofs as found in SMS.
     print_debug_top_down_mapinfo("dg %d", numFloors);
@@ -6,7 +6,16 @@
 #include "types.h"
 
 #define LEVEL_BOUNDARY_MAX 0x2000
-#define CELL_SIZE          0x400
+
+// Cells along each side of the spatial partition, set with the COLLISION_CELLS Makefile option.
+// tools/collision_histogram.py reports how long the cell lists get for each level at a given count.
+#ifndef NUM_CELLS
+#define NUM_CELLS          16
+#endif
+#if NUM_CELLS != 16 && NUM_CELLS != 32 && NUM_CELLS != 64
+#error "NUM_CELLS must be 16, 32 or 64"
+#endif
+#define CELL_SIZE          (2 * LEVEL_BOUNDARY_MAX / NUM_CELLS)
 
 struct WallCollisionData
 {
@@ -33,6 +42,7 @@ f32 find_ceil(f32 posX, f32 posY, f32 posZ, struct Surface **pceil);
 f32 find_floor_height_and_data(f32 xPos, f32 yPos, f32 zPos, struct FloorGeometry **floorGeo);
 f32 find_floor_height(f32 x, f32 y, f32 z);
 f32 find_floor(f32 xPos, f32 yPos, f32 zPos, struct Surface **pfloor);
+void clear_floor_memo(void);
 f32 find_water_level(f32 x, f32 z);
 f32 find_poison_gas_level(f32 x, f32 z);
 void debug_surface_list_info(f32 xPos, f32 zPos);
@@ -1,4 +1,5 @@
 #include <PR/ultratypes.h>
+#include <string.h>
 
 #include "prevent_bss_reordering.h"
 
@@ -19,10 +20,10 @@ s32 unused8038BE90;
 
 /**
  * Partitions for course and object surfaces. The arrays represent
- * the 16x16 cells that each level is split into.
+ * the NUM_CELLS x NUM_CELLS cells that each level is split into.
  */
-SpatialPartitionCell gStaticSurfacePartition[16][16];
-SpatialPartitionCell gDynamicSurfacePartition[16][16];
+SpatialPartitionCell gStaticSurfacePartition[NUM_CELLS][NUM_CELLS];
+SpatialPartitionCell gDynamicSurfacePartition[NUM_CELLS][NUM_CELLS];
 
 /**
  * Pools of data to contain either surface nodes or surfaces.
@@ -35,8 +36,42 @@ struct Surface *sSurfacePool;
  */
 s16 sSurfacePoolSize;
 
+/**
+ * The static partition baked into arrays: a run per cell and list, the edges of each
+ * entry and the surface it was baked from.
+ */
+struct StaticSurfaceRun gStaticSurfaceRuns[NUM_CELLS][NUM_CELLS][3];
+union StaticSurfaceEdges *gStaticSurfaceEdges;
+struct Surface **gStaticSurfaceList;
+
 u8 unused8038EEA8[0x30];
 
+/**
+ * The dynamic surface loads of the last frame, in load order. Dynamic surfaces are allocated in
+ * the same order every frame, so an object that hasn't moved finds the surfaces it loaded last
+ * frame where its new ones would go, and only has to add them to the partition again.
+ */
+#define DYNAMIC_SURFACE_LOADS 128
+
+struct DynamicSurfaceLoad
+{
+    struct Object *object;
+    const BehaviorScript *behavior;
+    s16 *collisionData;
+    s32 firstSurface;
+    s32 numSurfaces;
+    Mat4 transform;
+    Vec3f scale;
+};
+
+static struct DynamicSurfaceLoad sDynamicSurfaceLoads[DYNAMIC_SURFACE_LOADS];
+
+/**
+ * The loads made this frame, and the ones from last frame that still hold their surfaces.
+ */
+static s32 sNumDynamicSurfaceLoads;
+static s32 sNumPrevDynamicSurfaceLoads;
+
 /**
  * Allocate the part of the surface node pool to contain a surface node.
  */
@@ -46,10 +81,10 @@ static struct SurfaceNode *alloc_surface_node(void) {
 
     node->next = NULL;
 
-    //! A bounds check! If there's more surface nodes than 7000 allowed,
+    //! A bounds check! If there's more surface nodes than SURFACE_NODE_POOL_SIZE allowed,
     //  we, um...
     // Perhaps originally just debug feedback?
-    if (gSurfaceNodesAllocated >= 7000) {
+    if (gSurfaceNodesAllocated >= SURFACE_NODE_POOL_SIZE) {
     }
 
     return node;
@@ -83,7 +118,7 @@ static struct Surface *alloc_surface(void) {
  * Iterates through the entire partition, clearing the surfaces.
  */
 static void clear_spatial_partition(SpatialPartitionCell *cells) {
-    register s32 i = 16 * 16;
+    register s32 i = NUM_CELLS * NUM_CELLS;
 
     while (i--) {
         (*cells)[SPATIAL_PARTITION_FLOORS].next = NULL;
@@ -193,7 +228,7 @@ static s16 max_3(s16 a0, s16 a1, s16 a2) {
 }
 
 /**
- * Every level is split into 16 * 16 cells of surfaces (to limit computing
+ * Every level is split into NUM_CELLS * NUM_CELLS cells of surfaces (to limit computing
  * time). This function determines the lower cell for a given x/z position.
  * @param coord The coordinate to test
  */
@@ -206,13 +241,13 @@ static s16 lower_cell_index(s16 coord) {
         coord = 0;
     }
 
-    // [0, 16)
-    index = coord / 0x400;
+    // [0, NUM_CELLS)
+    index = coord / CELL_SIZE;
 
     // Include extra cell if close to boundary
     //! Some wall checks are larger than the buffer, meaning wall checks can
     //  miss walls that are near a cell border.
-    if (coord % 0x400 < 50) {
+    if (coord % CELL_SIZE < 50) {
         index -= 1;
     }
 
@@ -220,12 +255,12 @@ static s16 lower_cell_index(s16 coord) {
         index = 0;
     }
 
-    // Potentially > 15, but since the upper index is <= 15, not exploitable
+    // Potentially > NUM_CELLS - 1, but since the upper index is <= NUM_CELLS - 1, not exploitable
     return index;
 }
 
 /**
- * Every level is split into 16 * 16 cells of surfaces (to limit computing
+ * Every level is split into NUM_CELLS * NUM_CELLS cells of surfaces (to limit computing
  * time). This function determines the upper cell for a given x/z position.
  * @param coord The coordinate to test
  */
@@ -238,18 +273,18 @@ static s16 upper_cell_index(s16 coord) {
         coord = 0;
     }
 
-    // [0, 16)
-    index = coord / 0x400;
+    // [0, NUM_CELLS)
+    index = coord / CELL_SIZE;
 
     // Include extra cell if close to boundary
     //! Some wall checks are larger than the buffer, meaning wall checks can
     //  miss walls that are near a cell border.
-    if (coord % 0x400 > 0x400 - 50) {
+    if (coord % CELL_SIZE > CELL_SIZE - 50) {
         index += 1;
     }
 
-    if (index > 15) {
-        index = 15;
+    if (index > NUM_CELLS - 1) {
+        index = NUM_CELLS - 1;
     }
 
     // Potentially < 0, but since lower index is >= 0, not exploitable
@@ -257,7 +292,7 @@ static s16 upper_cell_index(s16 coord) {
 }
 
 /**
- * Every level is split into 16x16 cells, this takes a surface, finds
+ * Every level is split into NUM_CELLS x NUM_CELLS cells, this takes a surface, finds
  * the appropriate cells (with a buffer), and adds the surface to those
  * cells.
  * @param surface The surface to check
@@ -377,12 +412,97 @@ static struct Surface *read_surface_data(s16 *vertexData, s16 **vertexIndices) {
 
     surface->originOffset = -(nx * x1 + ny * y1 + nz * z1);
 
+    // The queries find the height of floors and ceilings at a point as
+    // y1 + slope.x * (x - x1) + slope.z * (z - z1), in integer math.
+    if (ny > 0.01 || ny < -0.01) {
+        mag = -(f32)(1 << SURFACE_SLOPE_FRAC) / ny;
+        surface->slope.x = nx * mag;
+        surface->slope.z = nz * mag;
+    } else {
+        surface->slope.x = 0;
+        surface->slope.z = 0;
+    }
+
     surface->lowerY = minY - 5;
     surface->upperY = maxY + 5;
 
     return surface;
 }
 
+/**
+ * Fill in the baked edges of a surface. Floor and ceiling edges are the point-in-triangle tests of the
+ * queries, (z1 - z) * (x2 - x1) - (x1 - x) * (z2 - z1), expanded into a * x + b * z + c. With wrapping
+ * s32 math both forms give the same value.
+ */
+static void bake_surface_edges(union StaticSurfaceEdges *edges, struct Surface *surface, s32 listIndex) {
+    s16 *vertices[3];
+    s32 x1, z1, x2, z2;
+    s32 i;
+
+    if (listIndex == SPATIAL_PARTITION_WALLS) {
+        s32 axis = (surface->flags & SURFACE_FLAG_X_PROJECTION) ? 2 : 0;
+
+        edges->wy.lowerY = surface->lowerY;
+        edges->wy.upperY = surface->upperY;
+        edges->wy.nx = surface->normal.x;
+        edges->wy.ny = surface->normal.y;
+        edges->wy.nz = surface->normal.z;
+        edges->wy.originOffset = surface->originOffset;
+        edges->wy.w[0] = surface->vertex1[axis];
+        edges->wy.w[1] = surface->vertex2[axis];
+        edges->wy.w[2] = surface->vertex3[axis];
+        edges->wy.y[0] = surface->vertex1[1];
+        edges->wy.y[1] = surface->vertex2[1];
+        edges->wy.y[2] = surface->vertex3[1];
+        edges->wy.flags = surface->flags;
+        return;
+    }
+
+    vertices[0] = surface->vertex1;
+    vertices[1] = surface->vertex2;
+    vertices[2] = surface->vertex3;
+
+    for (i = 0; i < 3; i++) {
+        x1 = vertices[i][0];
+        z1 = vertices[i][2];
+        x2 = vertices[(i + 1) % 3][0];
+        z2 = vertices[(i + 1) % 3][2];
+
+        edges->xz.a[i] = z2 - z1;
+        edges->xz.b[i] = x1 - x2;
+        edges->xz.c[i] = z1 * (x2 - x1) - x1 * (z2 - z1);
+    }
+}
+
+/**
+ * Bake the static partition into runs of gStaticSurfaceEdges. The runs keep the order of
+ * the lists, so the queries still pick the same surface when several fit.
+ */
+static void bake_static_surfaces(void) {
+    struct StaticSurfaceRun *run;
+    struct SurfaceNode *node;
+    s32 cellX, cellZ, listIndex;
+    s32 count = 0;
+
+    for (cellZ = 0; cellZ < NUM_CELLS; cellZ++) {
+        for (cellX = 0; cellX < NUM_CELLS; cellX++) {
+            for (listIndex = 0; listIndex < 3; listIndex++) {
+                run = &gStaticSurfaceRuns[cellZ][cellX][listIndex];
+                run->start = count;
+
+                node = gStaticSurfacePartition[cellZ][cellX][listIndex].next;
+                while (node != NULL) {
+                    bake_surface_edges(&gStaticSurfaceEdges[count], node->surface, listIndex);
+                    gStaticSurfaceList[count++] = node->surface;
+                    node = node->next;
+                }
+
+                run->count = count - run->start;
+            }
+        }
+    }
+}
+
 /**
  * Returns whether a surface has exertion/moves Mario
  * based on the surface type.
@@ -521,12 +641,15 @@ static void load_environmental_regions(s16 **data) {
 }
 
 /**
- * Allocate some of the main pool for surfaces (2300 surf) and for surface nodes (7000 nodes).
+ * Allocate some of the main pool for surfaces (2300 surf), for surface nodes
+ * (SURFACE_NODE_POOL_SIZE nodes) and for the baked static partition (a node each).
  */
 void alloc_surface_pools(void) {
     sSurfacePoolSize = 2300;
-    sSurfaceNodePool = main_pool_alloc(7000 * sizeof(struct SurfaceNode), MEMORY_POOL_LEFT);
+    sSurfaceNodePool = main_pool_alloc(SURFACE_NODE_POOL_SIZE * sizeof(struct SurfaceNode), MEMORY_POOL_LEFT);
     sSurfacePool = main_pool_alloc(sSurfacePoolSize * sizeof(struct Surface), MEMORY_POOL_LEFT);
+    gStaticSurfaceEdges = main_pool_alloc(SURFACE_NODE_POOL_SIZE * sizeof(union StaticSurfaceEdges), MEMORY_POOL_LEFT);
+    gStaticSurfaceList = main_pool_alloc(SURFACE_NODE_POOL_SIZE * sizeof(struct Surface *), MEMORY_POOL_LEFT);
 
     gCCMEnteredSlide = 0;
     reset_red_coins_collected();
@@ -597,6 +720,8 @@ void load_area_terrain(s16 index, s16 *data, s8 *surfaceRooms, s16 *macroObjects
     unused8038BE90 = 0;
     gSurfaceNodesAllocated = 0;
     gSurfacesAllocated = 0;
+    sNumDynamicSurfaceLoads = 0;
+    sNumPrevDynamicSurfaceLoads = 0;
 
     clear_static_surfaces();
 
@@ -625,6 +750,9 @@ void load_area_terrain(s16 index, s16 *data, s8 *surfaceRooms, s16 *macroObjects
         }
     }
 
+    bake_static_surfaces();
+    clear_floor_memo();
+
     if (macroObjects != NULL && *macroObjects != -1) {
         // If the first macro object presetID is within the range [0, 29].
         // Generally an early spawning method, every object is in BBH (the first level).
@@ -648,6 +776,8 @@ void clear_dynamic_surfaces(void) {
     if (!(gTimeStopState & TIME_STOP_ACTIVE)) {
         gSurfacesAllocated = gNumStaticSurfaces;
         gSurfaceNodesAllocated = gNumStaticSurfaceNodes;
+        sNumPrevDynamicSurfaceLoads = sNumDynamicSurfaceLoads;
+        sNumDynamicSurfaceLoads = 0;
 
         clear_spatial_partition(&gDynamicSurfacePartition[0][0]);
     }
@@ -752,6 +882,45 @@ void load_object_surfaces(s16 **data, s16 *vertexData) {
     }
 }
 
+/**
+ * Add the surfaces gCurrentObject loaded last frame to the partition again, if they're where its
+ * surfaces would be allocated and it hasn't moved since. Each frame's surfaces are allocated in
+ * load order, so the ones past the allocation cursor are still those of the last frame.
+ */
+static s32 reload_unmoved_object_surfaces(struct DynamicSurfaceLoad *load, s16 *collisionData) {
+    s32 i;
+
+    if (load->object != gCurrentObject || load->behavior != gCurrentObject->behavior
+        || load->collisionData != collisionData || load->firstSurface != gSurfacesAllocated
+        || gCurrentObject->header.gfx.throwMatrix == NULL) {
+        return FALSE;
+    }
+    // Compare the bits, the float compares are library calls without an FPU
+    if (memcmp(load->transform, gCurrentObject->transform, sizeof(Mat4)) != 0
+        || memcmp(load->scale, gCurrentObject->header.gfx.scale, sizeof(Vec3f)) != 0) {
+        return FALSE;
+    }
+
+    for (i = 0; i < load->numSurfaces; i++) {
+        add_surface(&sSurfacePool[gSurfacesAllocated++], TRUE);
+    }
+
+    return TRUE;
+}
+
+/**
+ * Remember the surfaces gCurrentObject just loaded, and the transform they were loaded with.
+ */
+static void record_dynamic_surface_load(struct DynamicSurfaceLoad *load, s16 *collisionData, s32 firstSurface) {
+    load->object = gCurrentObject;
+    load->behavior = gCurrentObject->behavior;
+    load->collisionData = collisionData;
+    load->firstSurface = firstSurface;
+    load->numSurfaces = gSurfacesAllocated - firstSurface;
+    memcpy(load->transform, gCurrentObject->transform, sizeof(Mat4));
+    memcpy(load->scale, gCurrentObject->header.gfx.scale, sizeof(Vec3f));
+}
+
 /**
  * Transform an object's vertices, reload them, and render the object.
  */
@@ -760,6 +929,7 @@ void load_object_collision_model(void) {
     s16 vertexData[600];
 
     s16 *collisionData = gCurrentObject->collisionData;
+    struct DynamicSurfaceLoad *load;
     f32 marioDist = gCurrentObject->oDistanceToMario;
     f32 tangibleDist = gCurrentObject->oCollisionDistance;
 
@@ -779,11 +949,27 @@ void load_object_collision_model(void) {
     if (!(gTimeStopState & TIME_STOP_ACTIVE) && marioDist < tangibleDist
         && !(gCurrentObject->activeFlags & ACTIVE_FLAG_IN_DIFFERENT_ROOM)) {
         collisionData++;
-        transform_object_vertices(&collisionData, vertexData);
 
-        // TERRAIN_LOAD_CONTINUE acts as an "end" to the terrain data.
-        while (*collisionData != TERRAIN_LOAD_CONTINUE) {
-            load_object_surfaces(&collisionData, vertexData);
+        load = NULL;
+        if (sNumDynamicSurfaceLoads < DYNAMIC_SURFACE_LOADS) {
+            load = &sDynamicSurfaceLoads[sNumDynamicSurfaceLoads++];
+        }
+
+        if (load == NULL || sNumDynamicSurfaceLoads > sNumPrevDynamicSurfaceLoads
+            || !reload_unmoved_object_surfaces(load, collisionData)) {
+            s16 *objectData = collisionData;
+            s32 firstSurface = gSurfacesAllocated;
+
+            transform_object_vertices(&collisionData, vertexData);
+
+            // TERRAIN_LOAD_CONTINUE acts as an "end" to the terrain data.
+            while (*collisionData != TERRAIN_LOAD_CONTINUE) {
+                load_object_surfaces(&collisionData, vertexData);
+            }
+
+            if (load != NULL) {
+                record_dynamic_surface_load(load, objectData, firstSurface);
+            }
         }
     }
 
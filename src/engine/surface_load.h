@@ -4,6 +4,7 @@
 #include <PR/ultratypes.h>
 
 #include "types.h"
+#include "surface_collision.h"
 
 struct SurfaceNode
 {
@@ -20,14 +21,76 @@ enum
 
 typedef struct SurfaceNode SpatialPartitionCell[3];
 
+/**
+ * The static partition lists are baked into flat arrays once an area's terrain is loaded. Each cell's
+ * floors, ceilings and walls are a run of consecutive entries in list order, so the collision queries
+ * walk them without chasing SurfaceNodes or reading the Surface of every candidate they reject.
+ */
+union StaticSurfaceEdges
+{
+    // Floors and ceilings: edge i of the triangle is a[i] * x + b[i] * z + c[i].
+    struct {
+        s32 a[3];
+        s32 b[3];
+        s32 c[3];
+    } xz;
+    // Walls: the y range and plane, and the vertices in the plane the wall is projected on,
+    // with w being z for SURFACE_FLAG_X_PROJECTION walls and x for the rest.
+    struct {
+        s16 lowerY;
+        s16 upperY;
+        f32 nx, ny, nz;
+        f32 originOffset;
+        s16 w[3];
+        s16 y[3];
+        s8 flags;
+    } wy;
+};
+
+/**
+ * Surface nodes in the pool. Finer partitions put each surface in more cells; the counts leave
+ * room for the dynamic surfaces above the worst level (5969, 13012 and 38517 static nodes).
+ */
+#if NUM_CELLS == 16
+#define SURFACE_NODE_POOL_SIZE 7000
+#elif NUM_CELLS == 32
+#define SURFACE_NODE_POOL_SIZE 15000
+#else
+#define SURFACE_NODE_POOL_SIZE 42000
+#endif
+
+/**
+ * Main pool bytes that alloc_surface_pools takes beyond the original pools, for the extra nodes,
+ * the baked static partition and the surface slopes.
+ */
+#define SURFACE_POOLS_EXTRA_SIZE                                                                 \
+    ((SURFACE_NODE_POOL_SIZE - 7000) * sizeof(struct SurfaceNode)                               \
+     + SURFACE_NODE_POOL_SIZE * (sizeof(union StaticSurfaceEdges) + sizeof(struct Surface *))   \
+     + 2300 * 2 * sizeof(s32))
+
+/**
+ * Fraction bits of the surface slopes. Floors and ceilings have |ny| > 0.01, so a slope is below
+ * 100 and fits an s32 with 24 fraction bits.
+ */
+#define SURFACE_SLOPE_FRAC 24
+
+struct StaticSurfaceRun
+{
+    u16 start;
+    u16 count;
+};
+
 // Needed for bs bss reordering memes.
 extern s32 unused8038BE90;
 
-extern SpatialPartitionCell gStaticSurfacePartition[16][16];
-extern SpatialPartitionCell gDynamicSurfacePartition[16][16];
+extern SpatialPartitionCell gStaticSurfacePartition[NUM_CELLS][NUM_CELLS];
+extern SpatialPartitionCell gDynamicSurfacePartition[NUM_CELLS][NUM_CELLS];
 extern struct SurfaceNode *sSurfaceNodePool;
 extern struct Surface *sSurfacePool;
 extern s16 sSurfacePoolSize;
+extern struct StaticSurfaceRun gStaticSurfaceRuns[NUM_CELLS][NUM_CELLS][3];
+extern union StaticSurfaceEdges *gStaticSurfaceEdges;
+extern struct Surface **gStaticSurfaceList;
 
 void alloc_surface_pools(void);
 #ifdef NO_SEGMENTED_MEMORY
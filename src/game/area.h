@@ -138,6 +138,10 @@ extern struct Area *gCurrentArea;
 extern s16 gCurrSaveFileNum;
 extern s16 gCurrLevelNum;
 
+// Viewport and scissor set by override_viewport_and_clip, NULL when not overridden
+extern Vp *D_8032CE74;
+extern Vp *D_8032CE78;
+
 
 void override_viewport_and_clip(Vp *a, Vp *b, u8 c, u8 d, u8 e);
 void print_intro_text(void);
@@ -40,6 +40,39 @@ s16 gMatStackIndex;
 Mat4 gMatStack[32];
 Mtx *gMatStackFixed[32];
 
+#ifdef TARGET_N64
+#define MTX_STACK_FLAGS 0
+#define mtxf_to_stack_mtx(dest, src) mtxf_to_mtx(dest, src)
+#else
+// On PC the fixed point stack holds plain copies of the float matrices, which the
+// frontend reads directly instead of packing and unpacking the N64's s15.16 format
+#define MTX_STACK_FLAGS G_MTX_FLOAT
+#define mtxf_to_stack_mtx(dest, src) mtxf_copy((f32 (*)[4]) (dest), src)
+#endif
+
+#ifdef TARGET_N64
+#define gDPLayerTag(pkt, layer, zbuffer)
+#define gDPLayerEndTag(pkt)
+#else
+// Lets the frontend know which layer it is drawing, it may reorder the opaque ones by render state
+// as long as the depth buffer keeps the result the same
+#define gDPLayerTag(pkt, layer, zbuffer) \
+    gDPNoOpTag(pkt, G_TAG_LAYER | (layer) | \
+        (((zbuffer) && (layer) >= LAYER_OPAQUE && (layer) <= LAYER_ALPHA) ? G_TAG_LAYER_SORTABLE : 0))
+#define gDPLayerEndTag(pkt) gDPNoOpTag(pkt, G_TAG_LAYER_END)
+#endif
+
+#ifdef TARGET_N64
+#define gDPStaticListTag(pkt, displayList)
+#else
+// Display lists outside the gfx pool come straight from the geo layouts and never change,
+// the frontend may record them the first time and replay them after that
+#define gDPStaticListTag(pkt, displayList) \
+    if ((Gfx *) (displayList) < gGfxPool->buffer \
+        || (Gfx *) (displayList) >= gGfxPool->buffer + GFX_POOL_SIZE) \
+            gDPNoOpTag(pkt, G_TAG_STATIC_DL)
+#endif
+
 /**
  * Animation nodes have state in global variables, so this struct captures
  * the animation state so a 'context switch' can be made when rendering the
@@ -154,15 +187,18 @@ static void geo_process_master_list_sub(struct GraphNodeMasterList *node) {
 
     for (i = 0; i < GFX_NUM_MASTER_LISTS; i++) {
         if ((currList = node->listHeads[i]) != NULL) {
+            gDPLayerTag(gDisplayListHead++, i, enableZBuffer);
             gDPSetRenderMode(gDisplayListHead++, modeList->modes[i], mode2List->modes[i]);
             while (currList != NULL) {
                 gSPMatrix(gDisplayListHead++, VIRTUAL_TO_PHYSICAL(currList->transform),
-                          G_MTX_MODELVIEW | G_MTX_LOAD | G_MTX_NOPUSH);
+                          G_MTX_MODELVIEW | G_MTX_LOAD | G_MTX_NOPUSH | MTX_STACK_FLAGS);
+                gDPStaticListTag(gDisplayListHead++, currList->displayList);
                 gSPDisplayList(gDisplayListHead++, currList->displayList);
                 currList = currList->next;
             }
         }
     }
+    gDPLayerEndTag(gDisplayListHead++);
     if (enableZBuffer != 0) {
         gDPPipeSync(gDisplayListHead++);
         gSPClearGeometryMode(gDisplayListHead++, G_ZBUFFER);
@@ -267,7 +303,10 @@ static void geo_process_perspective(struct GraphNodePerspective *node) {
  * range of this node.
  */
 static void geo_process_level_of_detail(struct GraphNodeLevelOfDetail *node) {
-#ifdef GBI_FLOATS
+#ifndef TARGET_N64
+    // gMatStackFixed holds float matrices, see mtxf_to_stack_mtx()
+    s16 distanceFromCam = (s32) -gMatStack[gMatStackIndex][3][2]; // z-component of the translation column
+#elif defined(GBI_FLOATS)
     Mtx *mtx = gMatStackFixed[gMatStackIndex];
     s16 distanceFromCam = (s32) -mtx->m[3][2]; // z-component of the translation column
 #else
@@ -327,7 +366,7 @@ static void geo_process_camera(struct GraphNodeCamera *node) {
     mtxf_lookat(cameraTransform, node->pos, node->focus, node->roll);
     mtxf_mul(gMatStack[gMatStackIndex + 1], cameraTransform, gMatStack[gMatStackIndex]);
     gMatStackIndex++;
-    mtxf_to_mtx(mtx, gMatStack[gMatStackIndex]);
+    mtxf_to_stack_mtx(mtx, gMatStack[gMatStackIndex]);
     gMatStackFixed[gMatStackIndex] = mtx;
     if (node->fnNode.node.children != 0) {
         gCurGraphNodeCamera = node;
@@ -353,7 +392,7 @@ static void geo_process_translation_rotation(struct GraphNodeTranslationRotation
     mtxf_rotate_zxy_and_translate(mtxf, translation, node->rotation);
     mtxf_mul(gMatStack[gMatStackIndex + 1], mtxf, gMatStack[gMatStackIndex]);
     gMatStackIndex++;
-    mtxf_to_mtx(mtx, gMatStack[gMatStackIndex]);
+    mtxf_to_stack_mtx(mtx, gMatStack[gMatStackIndex]);
     gMatStackFixed[gMatStackIndex] = mtx;
     if (node->displayList != NULL) {
         geo_append_display_list(node->displayList, node->node.flags >> 8);
@@ -378,7 +417,7 @@ static void geo_process_translation(struct GraphNodeTranslation *node) {
     mtxf_rotate_zxy_and_translate(mtxf, translation, gVec3sZero);
     mtxf_mul(gMatStack[gMatStackIndex + 1], mtxf, gMatStack[gMatStackIndex]);
     gMatStackIndex++;
-    mtxf_to_mtx(mtx, gMatStack[gMatStackIndex]);
+    mtxf_to_stack_mtx(mtx, gMatStack[gMatStackIndex]);
     gMatStackFixed[gMatStackIndex] = mtx;
     if (node->displayList != NULL) {
         geo_append_display_list(node->displayList, node->node.flags >> 8);
@@ -401,7 +440,7 @@ static void geo_process_rotation(struct GraphNodeRotation *node) {
     mtxf_rotate_zxy_and_translate(mtxf, gVec3fZero, node->rotation);
     mtxf_mul(gMatStack[gMatStackIndex + 1], mtxf, gMatStack[gMatStackIndex]);
     gMatStackIndex++;
-    mtxf_to_mtx(mtx, gMatStack[gMatStackIndex]);
+    mtxf_to_stack_mtx(mtx, gMatStack[gMatStackIndex]);
     gMatStackFixed[gMatStackIndex] = mtx;
     if (node->displayList != NULL) {
         geo_append_display_list(node->displayList, node->node.flags >> 8);
@@ -425,7 +464,7 @@ static void geo_process_scale(struct GraphNodeScale *node) {
     vec3f_set(scaleVec, node->scale, node->scale, node->scale);
     mtxf_scale_vec3f(gMatStack[gMatStackIndex + 1], gMatStack[gMatStackIndex], scaleVec);
     gMatStackIndex++;
-    mtxf_to_mtx(mtx, gMatStack[gMatStackIndex]);
+    mtxf_to_stack_mtx(mtx, gMatStack[gMatStackIndex]);
     gMatStackFixed[gMatStackIndex] = mtx;
     if (node->displayList != NULL) {
         geo_append_display_list(node->displayList, node->node.flags >> 8);
@@ -458,7 +497,7 @@ static void geo_process_billboard(struct GraphNodeBillboard *node) {
                          gCurGraphNodeObject->scale);
     }
 
-    mtxf_to_mtx(mtx, gMatStack[gMatStackIndex]);
+    mtxf_to_stack_mtx(mtx, gMatStack[gMatStackIndex]);
     gMatStackFixed[gMatStackIndex] = mtx;
     if (node->displayList != NULL) {
         geo_append_display_list(node->displayList, node->node.flags >> 8);
@@ -592,7 +631,7 @@ static void geo_process_animated_part(struct GraphNodeAnimatedPart *node) {
     mtxf_rotate_xyz_and_translate(matrix, translation, rotation);
     mtxf_mul(gMatStack[gMatStackIndex + 1], matrix, gMatStack[gMatStackIndex]);
     gMatStackIndex++;
-    mtxf_to_mtx(matrixPtr, gMatStack[gMatStackIndex]);
+    mtxf_to_stack_mtx(matrixPtr, gMatStack[gMatStackIndex]);
     gMatStackFixed[gMatStackIndex] = matrixPtr;
     if (node->displayList != NULL) {
         geo_append_display_list(node->displayList, node->node.flags >> 8);
@@ -697,7 +736,7 @@ static void geo_process_shadow(struct GraphNodeShadow *node) {
             gMatStackIndex++;
             mtxf_translate(mtxf, shadowPos);
             mtxf_mul(gMatStack[gMatStackIndex], mtxf, *gCurGraphNodeCamera->matrixPtr);
-            mtxf_to_mtx(mtx, gMatStack[gMatStackIndex]);
+            mtxf_to_stack_mtx(mtx, gMatStack[gMatStackIndex]);
             gMatStackFixed[gMatStackIndex] = mtx;
             if (gShadowAboveWaterOrLava == 1) {
                 geo_append_display_list((void *) VIRTUAL_TO_PHYSICAL(shadowList), 4);
@@ -836,7 +875,7 @@ static void geo_process_object(struct Object *node) {
         if (obj_is_in_view(&node->header.gfx, gMatStack[gMatStackIndex])) {
             Mtx *mtx = alloc_display_list(sizeof(*mtx));
 
-            mtxf_to_mtx(mtx, gMatStack[gMatStackIndex]);
+            mtxf_to_stack_mtx(mtx, gMatStack[gMatStackIndex]);
             gMatStackFixed[gMatStackIndex] = mtx;
             if (node->header.gfx.sharedChild != NULL) {
                 gCurGraphNodeObject = (struct GraphNodeObject *) node;
@@ -907,7 +946,7 @@ void geo_process_held_object(struct GraphNodeHeldObject *node) {
                               (struct AllocOnlyPool *) gMatStack[gMatStackIndex + 1]);
         }
         gMatStackIndex++;
-        mtxf_to_mtx(mtx, gMatStack[gMatStackIndex]);
+        mtxf_to_stack_mtx(mtx, gMatStack[gMatStackIndex]);
         gMatStackFixed[gMatStackIndex] = mtx;
         gGeoTempState.type = gCurAnimType;
         gGeoTempState.enabled = gCurAnimEnabled;
@@ -1070,11 +1109,11 @@ void geo_process_root(struct GraphNodeRoot *node, Vp *b, Vp *c, s32 clearColor)
         }
 
         mtxf_identity(gMatStack[gMatStackIndex]);
-        mtxf_to_mtx(initialMatrix, gMatStack[gMatStackIndex]);
+        mtxf_to_stack_mtx(initialMatrix, gMatStack[gMatStackIndex]);
         gMatStackFixed[gMatStackIndex] = initialMatrix;
         gSPViewport(gDisplayListHead++, VIRTUAL_TO_PHYSICAL(viewport));
         gSPMatrix(gDisplayListHead++, VIRTUAL_TO_PHYSICAL(gMatStackFixed[gMatStackIndex]),
-                  G_MTX_MODELVIEW | G_MTX_LOAD | G_MTX_NOPUSH);
+                  G_MTX_MODELVIEW | G_MTX_LOAD | G_MTX_NOPUSH | MTX_STACK_FLAGS);
         gCurGraphNodeRoot = node;
         if (node->node.children != NULL) {
             geo_process_node_and_siblings(node->node.children);
@@ -6,6 +6,7 @@
 #include "gfx_dimensions.h"
 #include "level_update.h"
 #include "memory.h"
+#include "rendering_graph_node.h"
 #include "save_file.h"
 #include "segment2.h"
 #include "sm64.h"
@@ -15,6 +16,15 @@
 # if !defined(TARGET_DOS) && !defined(ENABLE_SOFTRAST)
 #  define BETTER_SKYBOX_POSITION_PRECISION
 # endif
+// The 3x3 grid always covers the screen, so the frontend can skip the frame clear before it
+# define gDPBackgroundTag(pkt) gDPNoOpTag(pkt, G_TAG_BACKGROUND)
+# if defined(ENABLE_SOFTRAST) && !defined(WIDESCREEN)
+// The ortho tiles are screen aligned, so the software renderer gets them as texture rectangles, which
+// it blits straight from the texture instead of running them through the triangle pipeline
+#  define SKYBOX_TILE_TEXRECTS
+# endif
+#else
+# define gDPBackgroundTag(pkt)
 #endif
 
 /**
@@ -273,6 +283,57 @@ void draw_skybox_tile_grid(Gfx **dlist, s8 background, s8 player, s8 colorIndex)
     }
 }
 
+#ifdef SKYBOX_TILE_TEXRECTS
+/**
+ * Texel steps of a tile rect in S5.10. Like make_skybox_rect, a tile stretches texels 0 to 31 over its
+ * width and height.
+ */
+#define SKYBOX_TILE_DSDX (((31 << 10) + SKYBOX_TILE_WIDTH / 2) / SKYBOX_TILE_WIDTH)
+#define SKYBOX_TILE_DTDY (((31 << 10) + SKYBOX_TILE_HEIGHT / 2) / SKYBOX_TILE_HEIGHT)
+
+/**
+ * Whether the skybox is drawn to the whole screen. Texture rectangles are placed in screen coordinates and
+ * the frontend doesn't clip them, so they only stand in for the ortho tiles when neither the viewport nor
+ * the scissor is narrowed, as the ending cutscene does for its letterbox.
+ */
+static s32 skybox_is_full_screen(void) {
+    struct GraphNodeRoot *root = gCurGraphNodeRoot;
+
+    return D_8032CE74 == NULL && D_8032CE78 == NULL && root != NULL
+        && root->x == SCREEN_WIDTH / 2 && root->y == SCREEN_HEIGHT / 2
+        && root->width == SCREEN_WIDTH / 2 && root->height == SCREEN_HEIGHT / 2;
+}
+
+/**
+ * Draws the same 3x3 grid as draw_skybox_tile_grid, but as texture rectangles at the screen position the
+ * ortho matrix would have put each tile at. The tiles are modulated by the environment color instead of
+ * the vertex colors.
+ */
+void draw_skybox_tile_rects(Gfx **dlist, s8 background, s8 player, s8 colorIndex) {
+    s32 row;
+    s32 col;
+
+    gDPSetCombineMode((*dlist)++, G_CC_FADEA, G_CC_FADEA);
+    gDPSetEnvColor((*dlist)++, sSkyboxColors[colorIndex][0], sSkyboxColors[colorIndex][1],
+                   sSkyboxColors[colorIndex][2], 255);
+
+    for (row = 0; row < 3; row++) {
+        for (col = 0; col < 3; col++) {
+            s32 tileIndex = sSkyBoxInfo[player].upperLeftTile + row * SKYBOX_COLS + col;
+            const u8 *const texture =
+                (*(SkyboxTexture *) segmented_to_virtual(sSkyboxTextures[background]))[tileIndex];
+            s32 x = tileIndex % SKYBOX_COLS * SKYBOX_TILE_WIDTH - sSkyBoxInfo[player].scaledX;
+            s32 y = sSkyBoxInfo[player].scaledY - (SKYBOX_HEIGHT - tileIndex / SKYBOX_COLS * SKYBOX_TILE_HEIGHT);
+
+            gLoadBlockTexture((*dlist)++, 32, 32, G_IM_FMT_RGBA, texture);
+            gSPScisTextureRectangle((*dlist)++, x << 2, y << 2, (x + SKYBOX_TILE_WIDTH) << 2,
+                                    (y + SKYBOX_TILE_HEIGHT) << 2, G_TX_RENDERTILE, 0, 0,
+                                    SKYBOX_TILE_DSDX, SKYBOX_TILE_DTDY);
+        }
+    }
+}
+#endif
+
 void *create_skybox_ortho_matrix(s8 player) {
     f32 left = sSkyBoxInfo[player].scaledX;
     f32 right = sSkyBoxInfo[player].scaledX + SCREEN_WIDTH;
@@ -302,15 +363,31 @@ void *create_skybox_ortho_matrix(s8 player) {
  * Creates the skybox's display list, then draws the 3x3 grid of tiles.
  */
 Gfx *init_skybox_display_list(s8 player, s8 background, s8 colorIndex) {
-    s32 dlCommandCount = 5 + (3 * 3) * 7; // 5 for the start and end, plus 9 skybox tiles
+#ifdef SKYBOX_TILE_TEXRECTS
+    s32 dlCommandCount = 7 + (3 * 3) * 8; // 7 for the start, end and tile color, plus 9 skybox tiles (rects or quads)
+#else
+    s32 dlCommandCount = 6 + (3 * 3) * 7; // 6 for the start and end, plus 9 skybox tiles
+#endif
     void *skybox = alloc_display_list(dlCommandCount * sizeof(Gfx));
     Gfx *dlist = skybox;
 
     if (!configDrawSky || skybox == NULL) {
         return NULL;
     } else {
+#ifdef SKYBOX_TILE_TEXRECTS
+        if (skybox_is_full_screen()) {
+            gDPBackgroundTag(dlist++);
+            gSPDisplayList(dlist++, dl_skybox_begin);
+            gSPDisplayList(dlist++, dl_skybox_tile_tex_settings);
+            draw_skybox_tile_rects(&dlist, background, player, colorIndex);
+            gSPDisplayList(dlist++, dl_skybox_end);
+            gSPEndDisplayList(dlist);
+            return skybox;
+        }
+#endif
         Mtx *ortho = create_skybox_ortho_matrix(player);
 
+        gDPBackgroundTag(dlist++);
         gSPDisplayList(dlist++, dl_skybox_begin);
         gSPMatrix(dlist++, VIRTUAL_TO_PHYSICAL(ortho), G_MTX_PROJECTION | G_MTX_MUL | G_MTX_NOPUSH);
         gSPDisplayList(dlist++, dl_skybox_tile_tex_settings);
@@ -33,6 +33,13 @@ bool configDrawSky               = true;
 bool configFiltering             = false;
 bool configEnableFog             = false;
 bool config120pMode              = true;
+bool configFastRasterizer        = true; // fix32 rasterizers instead of the fix64 reference ones
+bool configTileBinning           = false; // draw the frame tile by tile after binning all triangles
+bool configStateSorting          = false; // draw the opaque layers sorted by shader and texture
+bool configDlCache               = false; // record the static display lists once and replay them
+bool configHiZ                   = false; // skip triangles hidden behind a coarse depth buffer, draw opaque layers front to back
+unsigned int configPerspSubdiv   = 16; // pixels between perspective divides, 1 is exact, 0 is affine only
+unsigned int configTextureBudget = 2048; // KB of memory for texture data, least recently used textures are evicted past it
 unsigned int configFrameskip     = 4; // worst case scenario, renders 1 out of every (X + 1) frames
 
 // Keyboard mappings (scancode values)
@@ -73,6 +80,13 @@ static const struct ConfigOption options[] = {
     {.name = "texture_filtering", .type = CONFIG_TYPE_BOOL, .boolValue = &configFiltering},
     {.name = "enable_fog",        .type = CONFIG_TYPE_BOOL, .boolValue = &configEnableFog},
     {.name = "enable_120p_mode",  .type = CONFIG_TYPE_BOOL, .boolValue = &config120pMode},
+    {.name = "fast_rasterizer",   .type = CONFIG_TYPE_BOOL, .boolValue = &configFastRasterizer},
+    {.name = "tile_binning",      .type = CONFIG_TYPE_BOOL, .boolValue = &configTileBinning},
+    {.name = "state_sorting",     .type = CONFIG_TYPE_BOOL, .boolValue = &configStateSorting},
+    {.name = "dl_cache",          .type = CONFIG_TYPE_BOOL, .boolValue = &configDlCache},
+    {.name = "hi_z",              .type = CONFIG_TYPE_BOOL, .boolValue = &configHiZ},
+    {.name = "persp_subdiv",      .type = CONFIG_TYPE_UINT, .uintValue = &configPerspSubdiv},
+    {.name = "texture_budget",    .type = CONFIG_TYPE_UINT, .uintValue = &configTextureBudget},
     {.name = "frameskip",         .type = CONFIG_TYPE_UINT, .uintValue = &configFrameskip},
     {.name = "key_a",             .type = CONFIG_TYPE_UINT, .uintValue = &configKeyA},
     {.name = "key_b",             .type = CONFIG_TYPE_UINT, .uintValue = &configKeyB},
@@ -7,6 +7,13 @@ extern bool         configDrawSky;
 extern bool         configFiltering;
 extern bool         configEnableFog;
 extern bool			config120pMode;
+extern bool         configFastRasterizer;
+extern bool         configTileBinning;
+extern bool         configStateSorting;
+extern bool         configDlCache;
+extern bool         configHiZ;
+extern unsigned int configPerspSubdiv;
+extern unsigned int configTextureBudget;
 extern unsigned int configFrameskip;
 extern unsigned int configKeyA;
 extern unsigned int configKeyB;
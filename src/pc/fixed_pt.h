@@ -23,6 +23,15 @@ typedef int64_t fix64;
 #define FLOAT_2_FIX(f) ((fix64)((f) * (1LL << FRAC_WIDTH))) // shifting float left FRAC_WIDTH bits
 #define DOUBLE_2_FIX(d) ((fix64) ((d) * (1LL << FRAC_WIDTH))) // same as above
 
+// FLOAT_2_FIX with integer operations on the float's bits, no soft-float multiply and conversion
+static inline fix64 float_bits_2_fix(const float f) {
+    const union { float f; uint32_t i; } b = { f };
+    const int shift = (int)((b.i >> 23) & 0xFF) - (127 + 23) + FRAC_WIDTH;
+    const int64_t m = (b.i & 0x7FFFFF) | 0x800000;
+    const int64_t v = (shift > 38) ? FIX_MAX : (shift >= 0) ? m << shift : (shift > -24) ? m >> -shift : 0;
+    return (b.i >> 31) ? -v : v;
+}
+
 #define FIX_INV(fix) ((1ULL << 63) / (fix) << 1) // only loses one bit of precision (?)
 
 static inline fix64 fix_mult(const fix64 fix1, const fix64 fix2) { // multiply 2 fixes, return fix
@@ -60,5 +69,31 @@ static inline fix64 fix_div_d(const fix64 num, const fix64 denom) {
     return (fix64)((double)num / FIX_2_DOUBLE(denom)); // double precision
 }
 
+/* 32-bit fixed point, for inner loops where 64-bit math is too slow */
+
+typedef int32_t fix32;
+
+#ifndef FRAC32_WIDTH
+#define FRAC32_WIDTH 16 // 16.16 by default, override at build time if needed
+#endif
+
+#define FIX32_ONE (1 << FRAC32_WIDTH)
+#define FIX32_ONE_HALF (1 << (FRAC32_WIDTH - 1))
+
+#define FIX32_2_INT(fix) ((fix) >> FRAC32_WIDTH) // non rounding
+#define INT_2_FIX32(num) ((fix32)(num) << FRAC32_WIDTH)
+
+// multiply two fix32 numbers where `a` has FRAC32_WIDTH fraction bits, result keeps the fraction width of `b`
+// (int64_t)a * b compiles to a single smull on ARM, unlike fix_mult which needs several 64-bit multiplies
+static inline fix32 fix32_mult(const fix32 a, const fix32 b) {
+    return (fix32)(((int64_t)a * b) >> FRAC32_WIDTH);
+}
+
+// narrow a fix64 to a fix32 with `frac` fraction bits, saturating instead of wrapping
+static inline fix32 fix_narrow(const fix64 fix, const int frac) {
+    const fix64 v = fix >> (FRAC_WIDTH - frac);
+    return (v > INT32_MAX) ? INT32_MAX : (v < INT32_MIN) ? INT32_MIN : (fix32)v;
+}
+
 
 #endif
\ No newline at end of file
@@ -17,12 +17,40 @@
 #include "gfx_cc.h"
 #include "macros.h"
 
+#include "pc/configfile.h"
 #include "pc/fixed_pt.h"
+#include "pc/profiling.h"
 
 #define ALIGN(x, a) (((x) + (a - 1)) & ~(a - 1))
 
 #define MAX_TEXTURES 3072
-#define TEXCACHE_STEP 0x10000
+#define MAX_TLUTS 32
+#define MAX_SHADERS 64
+
+// screen tiles for the binning mode, small enough for a tile's color and depth to stay in the data cache
+#define BIN_TILE_SHIFT 5
+#define BIN_TILE_SIZE (1 << BIN_TILE_SHIFT)
+
+// coarse depth blocks are 1 << HIZ_SHIFT pixels square, the depth buffer is also cleared a block at a time
+#define HIZ_SHIFT 3
+#define HIZ_SIZE (1 << HIZ_SHIFT)
+// how far the interpolated depth of a pixel may stray outside the depth range of the triangle's vertices
+#define HIZ_MARGIN 16
+
+// fraction bits of the properties interpolated by the fix32 rasterizers (z, 1/w, colors, UVs)
+// everything is premultiplied by 1/w, so the integer part only has to hold a 0-255 color
+#ifndef R32_PROP_FRAC
+#define R32_PROP_FRAC 22
+#endif
+// longest run of pixels the fix32 rasterizers will lerp w over (see the persp_subdiv option)
+#define R32_SUBDIV_MAX 32
+// triangles smaller than this many pixels in both directions are drawn without perspective correction
+#define R32_AFFINE_SIZE 4
+// same for triangles whose 1/w varies by less than 1/2^this across them (nearly parallel to the screen)
+#define R32_AFFINE_SPREAD 6
+// triangles with a vertex or an edge slope (pixels per scanline) past this are drawn by the fix64
+// rasterizers instead: a fix32 x plus one step along an edge has to fit in 32 bits
+#define R32_X_MAX (1 << (30 - FRAC32_WIDTH))
 
 enum WrapType {
     WRAP_REPEAT = 0,
@@ -30,6 +58,21 @@ enum WrapType {
     WRAP_MIRROR = 2,
 };
 
+enum TexFormat {
+    TEX_RGBA32,   // aaaaaaaa bbbbbbbb gggggggg rrrrrrrr, as uploaded
+    TEX_RGB565,   // rrrrrggg gggbbbbb, for opaque textures
+    TEX_RGBA5551, // rrrrrggg ggbbbbba, for textures with 1-bit alpha
+    TEX_RGBA4444, // rrrrgggg bbbbaaaa, for everything else
+    TEX_IA4,      // iiia, two texels per byte, high nibble first
+    TEX_IA8,      // iiiiaaaa
+    TEX_IA16,     // iiiiiiii aaaaaaaa
+    TEX_I4,       // iiii, two texels per byte, high nibble first
+    TEX_I8,       // iiiiiiii
+    TEX_CI4,      // 4-bit palette index, two texels per byte, high nibble first
+    TEX_CI8,      // 8-bit palette index
+    TEX_FMT_COUNT
+};
+
 enum DrawFlags {
     DRAW_ZWRITE = 1,
     DRAW_BLEND = 2,
@@ -45,6 +88,26 @@ enum MixType {
     SH_MT_TEXTURE_TEXTURE = 1 << 4,
 };
 
+enum CombinerType {
+    CMB_RGB,
+    CMB_RGBA,
+    CMB_FOG_RGB,
+    CMB_FOG_RGBA,
+    CMB_RGBA_RGBA,
+    CMB_TEX,
+    CMB_TEX_FOG,
+    CMB_TEX_RGB,
+    CMB_TEX_FOG_RGB,
+    CMB_TEX_RGB_DECAL,
+    CMB_TEX_RGBA,
+    CMB_TEX_RGBA_TEXA,
+    CMB_TEX_FOG_RGBA,
+    CMB_TEX_RGBA_DECAL,
+    CMB_TEX_RGB_RGB,
+    CMB_TEX_TEX_RGBA,
+    CMB_COUNT
+};
+
 typedef union Vector2 { 
     struct { fix64 x, y; };
     struct { fix64 u, v; };
@@ -78,12 +141,25 @@ struct Tri {
 
 struct Texture;
 
+struct Span {
+    int idx;          // index of the first pixel
+    int len;          // amount of pixels
+    int prop_count;   // amount of props, including XYZW
+    int zoff;         // depth offset for decal mode
+    int subdiv;       // pixels between w recalculations for perspective spans
+    fix32 w;          // constant w for affine spans
+    fix32 *p;         // props at the first pixel, advanced in place
+    const fix32 *dp;  // X increments for props
+};
+
 // texture sampling function: takes integer u,v and wraps/clamps it, samples texture, returns color
 typedef Color4 (*sample_fn_t)(const struct Texture * const, const int, const int);
 // pixel drawing function: does blending, zwriting, alpha edge checking or whatever else, then plots pixel
 typedef void (*draw_fn_t)(const int idx, uint16_t uz, const Color4 src);
 // color combiner: takes float vertex properties and obtains final fragment color from them
 typedef Color4 (*combine_fn_t)(const fix64 z, const fix64 *props);
+// span kernel: draws one scanline for the fix32 rasterizers, with the combiner and plotter inlined
+typedef void (*span_fn_t)(const struct Span *span);
 // rasterizer: walks the triangle and interpolates a fixed amount of vertex properties
 typedef void (*rast_fn_t)(const struct Tri tri);
 
@@ -93,15 +169,30 @@ struct ShaderProgram {
     enum MixType mix;
     uint32_t draw_flags;
     int num_props;
+    enum CombinerType comb;
     combine_fn_t combine;
+    span_fn_t const (*spans)[2][2]; // fix32 span kernels for this combiner, [draw flags | zwrite][ztest][persp]
     rast_fn_t rast;
 };
 
+// palette of CI textures, shared by all textures that were loaded with the same one
+struct Tlut {
+    uint8_t raw[256 * 2]; // RGBA16 colors as loaded, big endian
+    Color4 c[256];        // the same colors expanded
+    int num;              // 16 or 256 entries, 0 if unused
+    int refs;             // resident textures using this palette
+};
+
 struct Texture {
     int w, h;           // size
     int wrap_w, wrap_h; // size - 1 for wrapping
     bool filter;        // linear filter
+    enum TexFormat fmt; // texel format in texcache
+    int wrap;           // wrap mode for both axes, see gfx_soft_set_sampler_parameters()
     uint32_t addr;      // offset into texcache
+    uint32_t size;      // bytes taken up in texcache, 0 if not resident
+    uint32_t last_use;  // tex_frame this was last selected in
+    struct Tlut *tlut;  // palette for TEX_CI4 and TEX_CI8
     sample_fn_t sample; // sampling function (does wrapping/clamping)
 };
 
@@ -117,23 +208,51 @@ struct ClipRect {
     int x1, y1; // bottom right
 };
 
-uint32_t *gfx_output;
+// render state of a batch of binned triangles, replayed when the tiles are drawn
+struct BinState {
+    struct ShaderProgram *shader;
+    struct Texture tex[2];  // copies, the sampler might change before the tiles are drawn
+    struct ClipRect clip;
+    fix64 z_offset;
+    Color4 fog_color;
+    bool z_test;
+    bool z_write;
+};
+
+struct BinTri {
+    uint32_t v[3];  // offsets of the Y sorted vertices in bin_vtx
+    uint32_t state; // index into bin_state
+};
+
+struct Bin {
+    uint32_t *tris; // indices into bin_tri, in submission order
+    uint32_t num;
+    uint32_t cap;
+};
+
+gfx_pixel_t *gfx_output;
+static gfx_pixel_t *scr_output; // our own color buffer, gfx_output unless gfx_soft_set_output() says otherwise
 
 // this is set in the drawing functions
 static draw_fn_t draw_fn;
+static span_fn_t span_fn[2]; // [0] for triangles with constant w, [1] for perspective ones
 
-static struct ShaderProgram shader_program_pool[0];
+static struct ShaderProgram shader_program_pool[MAX_SHADERS];
 static uint8_t shader_program_pool_size;
 static struct ShaderProgram *cur_shader = NULL;
 
 static struct Texture *cur_tex[2]; // currently selected textures for both tiles
 static struct Texture tex_hdr[MAX_TEXTURES];
+static uint32_t tex_num; // amount of texture ids handed out
 static int cur_tmu = 0; // select tile (used only for uploading)
+static struct Tlut tluts[MAX_TLUTS];
 
-// texture cache: linearly stores RGBA data of every cached texture
+// texture cache: a fixed budget of texel data, allocated linearly and compacted when it runs out
 static uint8_t *texcache;
 static uint32_t texcache_addr; // current offset into cache
 static uint32_t texcache_size; // cache capacity
+static uint32_t texcache_used; // bytes held by resident textures, the rest below texcache_addr are holes
+static uint32_t tex_frame;     // frame counter for LRU eviction
 
 static bool do_blend; // fragment blending toggle
 static bool do_clip;  // scissor toggle
@@ -147,19 +266,46 @@ static bool z_test;        // whether to perform depth testing
 static bool z_write;       // whether to write into the Z buffer
 static fix64 z_offset;     // offset for decal mode
 static uint16_t *z_buffer;
+static uint16_t *hiz;   // coarse depth, no pixel of a block is farther than its entry
+static uint8_t *z_stale; // per block: its part of z_buffer hasn't been cleared since the last depth_clear()
+static int hiz_w, hiz_h; // screen size in coarse depth blocks
 
 static int scr_width;
 static int scr_height;
 static int scr_size; // scr_width * scr_height
 
+// current render target: the screen, or a tile when drawing binned triangles
+// it is flipped vertically, so pixel (x, y) is at r_base - y * r_pitch + x
+static gfx_pixel_t *r_color;
+static uint16_t *r_depth;
+static int r_base;
+static int r_pitch;
+
+// binned triangles, their vertices and render states for this frame
+static fix64 *bin_vtx;
+static uint32_t bin_vtx_num, bin_vtx_cap;
+static struct BinTri *bin_tri;
+static uint32_t bin_tri_num, bin_tri_cap;
+static struct BinState *bin_state;
+static uint32_t bin_state_num, bin_state_cap;
+static struct Bin *bins;
+static int bins_w, bins_h; // screen size in tiles
+// color and depth of the tile being drawn
+static gfx_pixel_t tile_color[BIN_TILE_SIZE * BIN_TILE_SIZE];
+static uint16_t tile_depth[BIN_TILE_SIZE * BIN_TILE_SIZE];
+
 static int num = 0;
 
+static int persp_subdiv; // pixels between perspective divides, 0 if everything is drawn affine
+
 // color component interpolation table:
 // lerp(x, y, t) = x + (y - x) * t
 // the first index is x, the second is (y - x) + 256
 static uint8_t lerp_tab[256][256 * 2 + 1];
 // color component multiplication table: [x][y] = (x * y) / 256;
 static uint8_t mult_tab[256][256];
+// reciprocal table for lerping w over a run of pixels: [n] = 65536 / n
+static int32_t recip_tab[R32_SUBDIV_MAX + 1];
 // dither kernel for unreal texture filtering
 static const Vector2 dither_tab[2][2] = {
     //{ {{ 0.25f, 0.00f }}, {{ 0.50f, 0.75f }} },
@@ -237,6 +383,42 @@ static inline Color4 rgba_lerp(const Color4 c1, const Color4 c2, const uint8_t t
     }};
 }
 
+#ifdef SOFTRAST_RGB565
+
+// aaaaaaaa bbbbbbbb gggggggg rrrrrrrr -> rrrrrggg gggbbbbb
+static inline gfx_pixel_t rgba_to_pixel(const Color4 c) {
+    return ((c.c & 0xF8) << 8) | ((c.c & 0xFC00) >> 5) | ((c.c >> 19) & 0x1F);
+}
+
+// alpha blends src over a 565 pixel; the channels are spread out to 00000ggg ggg00000 rrrrr000 000bbbbb
+// so all three can be blended with a single multiply by a 5-bit alpha
+static inline gfx_pixel_t pixel_blend(const Color4 src, const gfx_pixel_t dst) {
+    const uint32_t a = (src.a + 4) >> 3;
+    const uint32_t s = rgba_to_pixel(src);
+    const uint32_t sw = (s | (s << 16)) & 0x07E0F81F;
+    const uint32_t dw = (dst | (dst << 16)) & 0x07E0F81F;
+    const uint32_t res = ((((sw - dw) * a) >> 5) + dw) & 0x07E0F81F;
+    return res | (res >> 16);
+}
+
+#else
+
+static inline gfx_pixel_t rgba_to_pixel(const Color4 c) {
+    return c.c;
+}
+
+static inline gfx_pixel_t pixel_blend(Color4 src, const gfx_pixel_t dst) {
+    const uint8_t a = src.a;
+    const uint8_t ia = 255 - a;
+    const Color4 d = (Color4) { .c = dst };
+    src.r = mult_tab[src.r][a] + mult_tab[d.r][ia];
+    src.g = mult_tab[src.g][a] + mult_tab[d.g][ia];
+    src.b = mult_tab[src.b][a] + mult_tab[d.b][ia];
+    return src.c;
+}
+
+#endif
+
 static inline int imin(const int a, const int b) {
     return (a < b) ? a : b;
 }
@@ -245,6 +427,41 @@ static inline int imax(const int a, const int b) {
     return (a > b) ? a : b;
 }
 
+static inline fix64 fix_min(const fix64 a, const fix64 b) {
+    return (a < b) ? a : b;
+}
+
+static inline fix64 fix_max(const fix64 a, const fix64 b) {
+    return (a > b) ? a : b;
+}
+
+// z/w with R32_PROP_FRAC fraction bits -> 0-65535 depth, i.e. z * 65535 without overflowing 32 bits
+static inline int r32_depth(const fix32 z) {
+    return (z >> (R32_PROP_FRAC - 16)) - (z >> R32_PROP_FRAC);
+}
+
+// picks fraction bits for props 3+ so that the largest of them ends up around 2^29
+static inline int r32_prop_frac(const fix64 *v0, const fix64 *v1, const fix64 *v2, const int nprops) {
+    uint64_t m = 0;
+    for (int i = 3; i < nprops; ++i)
+        m |= llabs(v0[i]) | llabs(v1[i]) | llabs(v2[i]);
+    int frac = 29 + FRAC_WIDTH;
+    while (m >>= 1) --frac;
+    return (frac < R32_PROP_FRAC - 2) ? R32_PROP_FRAC - 2 : (frac > 30) ? 30 : frac;
+}
+
+// 1/w with R32_PROP_FRAC fraction bits -> w with FRAC32_WIDTH fraction bits
+// (with more fraction bits in 1/w the result is scaled down by the same amount)
+static inline fix32 r32_recip(const fix32 inv_w) {
+    if (inv_w <= (1 << (R32_PROP_FRAC + FRAC32_WIDTH - 31))) return INT32_MAX; // w would not fit
+    return (fix32)((float)(1LL << (R32_PROP_FRAC + FRAC32_WIDTH)) / (float)inv_w);
+}
+
+// whether an x position or x step can be walked by the fix32 rasterizers, see R32_X_MAX
+static inline bool r32_x_fits(const fix64 x) {
+    return x > -INT_2_FIX(R32_X_MAX) && x < INT_2_FIX(R32_X_MAX);
+}
+
 static inline void viewport_transform(Vector4 *v) {
     // gfx_pc.c with ENABLE_SOFTRAST defined will feed us with everything already pre-multiplied by inverse of w
     v->x = fix_mult(v->x, r_view.hw) + r_view.cx + FIX_ONE_HALF;
@@ -254,46 +471,139 @@ static inline void viewport_transform(Vector4 *v) {
 
 /* texture sampling functions */
 
-static inline Color4 tex_get(const struct Texture * const tex, const int x, const int y) {
-    return (Color4) { .c = ((const uint32_t *)(texcache + tex->addr))[y * tex->w + x] };
+static inline Color4 texel_rgba32(const struct Texture * const tex, const int i) {
+    return (Color4) { .c = ((const uint32_t *)(texcache + tex->addr))[i] };
+}
+
+static inline Color4 texel_rgb565(const struct Texture * const tex, const int i) {
+    const uint32_t c = ((const uint16_t *)(texcache + tex->addr))[i];
+    return (Color4) {{
+        .r = ((c >> 8) & 0xF8) | (c >> 13),
+        .g = ((c >> 3) & 0xFC) | ((c >> 9) & 0x03),
+        .b = ((c << 3) & 0xF8) | ((c >> 2) & 0x07),
+        .a = 0xFF,
+    }};
+}
+
+static inline Color4 texel_rgba5551(const struct Texture * const tex, const int i) {
+    const uint32_t c = ((const uint16_t *)(texcache + tex->addr))[i];
+    return (Color4) {{
+        .r = ((c >> 8) & 0xF8) | (c >> 13),
+        .g = ((c >> 3) & 0xF8) | ((c >> 8) & 0x07),
+        .b = ((c << 2) & 0xF8) | ((c >> 3) & 0x07),
+        .a = (c & 1) ? 0xFF : 0x00,
+    }};
 }
 
-static Color4 tex_sample_nearest_rr(const struct Texture * const tex, const int x, const int y) {
-    return tex_get(tex, iwrap0w(x, tex->wrap_w), iwrap0w(y, tex->wrap_h));
+static inline Color4 texel_rgba4444(const struct Texture * const tex, const int i) {
+    const uint32_t c = ((const uint16_t *)(texcache + tex->addr))[i];
+    return (Color4) {{
+        .r = (c >> 12) * 0x11,
+        .g = ((c >> 8) & 0xF) * 0x11,
+        .b = ((c >> 4) & 0xF) * 0x11,
+        .a = (c & 0xF) * 0x11,
+    }};
 }
 
-static Color4 tex_sample_nearest_rc(const struct Texture * const tex, const int x, const int y) {
-    return tex_get(tex, iwrap0w(x, tex->wrap_w), iclamp0w(y, tex->wrap_h));
+static inline uint32_t texel_nibble(const struct Texture * const tex, const int i) {
+    const uint32_t b = texcache[tex->addr + (i >> 1)];
+    return (i & 1) ? (b & 0xF) : (b >> 4);
 }
 
-static Color4 tex_sample_nearest_rm(const struct Texture * const tex, const int x, const int y) {
-    return tex_get(tex, iwrap0w(x, tex->wrap_w), imirror0w(y, tex->wrap_h));
+static inline Color4 texel_ia4(const struct Texture * const tex, const int i) {
+    const uint32_t c = texel_nibble(tex, i);
+    const uint8_t l = (c >> 1) * 0x24;
+    return (Color4) {{ .r = l, .g = l, .b = l, .a = (c & 1) ? 0xFF : 0x00 }};
 }
 
-static Color4 tex_sample_nearest_cc(const struct Texture * const tex, const int x, const int y) {
-    return tex_get(tex, iclamp0w(x, tex->wrap_w), iclamp0w(y, tex->wrap_h));
+static inline Color4 texel_ia8(const struct Texture * const tex, const int i) {
+    const uint32_t c = texcache[tex->addr + i];
+    const uint8_t l = (c >> 4) * 0x11;
+    return (Color4) {{ .r = l, .g = l, .b = l, .a = (c & 0xF) * 0x11 }};
 }
 
-static Color4 tex_sample_nearest_cr(const struct Texture * const tex, const int x, const int y) {
-    return tex_get(tex, iclamp0w(x, tex->wrap_w), iwrap0w(y, tex->wrap_h));
+static inline Color4 texel_ia16(const struct Texture * const tex, const int i) {
+    const uint8_t *c = texcache + tex->addr + i * 2;
+    return (Color4) {{ .r = c[0], .g = c[0], .b = c[0], .a = c[1] }};
 }
 
-static Color4 tex_sample_nearest_cm(const struct Texture * const tex, const int x, const int y) {
-    return tex_get(tex, iclamp0w(x, tex->wrap_w), imirror0w(y, tex->wrap_h));
+static inline Color4 texel_i4(const struct Texture * const tex, const int i) {
+    const uint8_t l = texel_nibble(tex, i) * 0x11;
+    return (Color4) {{ .r = l, .g = l, .b = l, .a = 0xFF }};
 }
 
-static Color4 tex_sample_nearest_mm(const struct Texture * const tex, const int x, const int y) {
-    return tex_get(tex, imirror0w(x, tex->wrap_w), imirror0w(y, tex->wrap_h));
+static inline Color4 texel_i8(const struct Texture * const tex, const int i) {
+    const uint8_t l = texcache[tex->addr + i];
+    return (Color4) {{ .r = l, .g = l, .b = l, .a = 0xFF }};
 }
 
-static Color4 tex_sample_nearest_mc(const struct Texture * const tex, const int x, const int y) {
-    return tex_get(tex, imirror0w(x, tex->wrap_w), iclamp0w(y, tex->wrap_h));
+static inline Color4 texel_ci4(const struct Texture * const tex, const int i) {
+    return tex->tlut->c[texel_nibble(tex, i)];
 }
 
-static Color4 tex_sample_nearest_mr(const struct Texture * const tex, const int x, const int y) {
-    return tex_get(tex, imirror0w(x, tex->wrap_w), iwrap0w(y, tex->wrap_h));
+static inline Color4 texel_ci8(const struct Texture * const tex, const int i) {
+    return tex->tlut->c[texcache[tex->addr + i]];
 }
 
+// define nearest samplers for every wrap mode combination of a texel format
+
+#define DEFINE_SAMPLER(fmt, mode, wrap_x, wrap_y) \
+    static Color4 tex_sample_nearest_ ## fmt ## _ ## mode (const struct Texture * const tex, const int x, const int y) { \
+        return texel_ ## fmt (tex, wrap_y(y, tex->wrap_h) * tex->w + wrap_x(x, tex->wrap_w)); \
+    }
+
+#define DEFINE_SAMPLERS(fmt) \
+    DEFINE_SAMPLER(fmt, rr, iwrap0w, iwrap0w) \
+    DEFINE_SAMPLER(fmt, rc, iwrap0w, iclamp0w) \
+    DEFINE_SAMPLER(fmt, rm, iwrap0w, imirror0w) \
+    DEFINE_SAMPLER(fmt, cr, iclamp0w, iwrap0w) \
+    DEFINE_SAMPLER(fmt, cc, iclamp0w, iclamp0w) \
+    DEFINE_SAMPLER(fmt, cm, iclamp0w, imirror0w) \
+    DEFINE_SAMPLER(fmt, mr, imirror0w, iwrap0w) \
+    DEFINE_SAMPLER(fmt, mc, imirror0w, iclamp0w) \
+    DEFINE_SAMPLER(fmt, mm, imirror0w, imirror0w)
+
+// indexed by (wrap_s << 2) | wrap_t
+#define GET_SAMPLERS(fmt) { \
+    tex_sample_nearest_ ## fmt ## _rr, /* 0000 */ \
+    tex_sample_nearest_ ## fmt ## _rc, /* 0001 */ \
+    tex_sample_nearest_ ## fmt ## _rm, /* 0010 */ \
+    NULL, \
+    tex_sample_nearest_ ## fmt ## _cr, /* 0100 */ \
+    tex_sample_nearest_ ## fmt ## _cc, /* 0101 */ \
+    tex_sample_nearest_ ## fmt ## _cm, /* 0110 */ \
+    NULL, \
+    tex_sample_nearest_ ## fmt ## _mr, /* 1000 */ \
+    tex_sample_nearest_ ## fmt ## _mc, /* 1001 */ \
+    tex_sample_nearest_ ## fmt ## _mm, /* 1010 */ \
+}
+
+DEFINE_SAMPLERS(rgba32)
+DEFINE_SAMPLERS(rgb565)
+DEFINE_SAMPLERS(rgba5551)
+DEFINE_SAMPLERS(rgba4444)
+DEFINE_SAMPLERS(ia4)
+DEFINE_SAMPLERS(ia8)
+DEFINE_SAMPLERS(ia16)
+DEFINE_SAMPLERS(i4)
+DEFINE_SAMPLERS(i8)
+DEFINE_SAMPLERS(ci4)
+DEFINE_SAMPLERS(ci8)
+
+static const sample_fn_t samplers[TEX_FMT_COUNT][11] = {
+    GET_SAMPLERS(rgba32),
+    GET_SAMPLERS(rgb565),
+    GET_SAMPLERS(rgba5551),
+    GET_SAMPLERS(rgba4444),
+    GET_SAMPLERS(ia4),
+    GET_SAMPLERS(ia8),
+    GET_SAMPLERS(ia16),
+    GET_SAMPLERS(i4),
+    GET_SAMPLERS(i8),
+    GET_SAMPLERS(ci4),
+    GET_SAMPLERS(ci8),
+};
+
 static inline Color4 tex_sample_linear(const struct Texture * const tex, const fix64 u, const fix64 v, const Vector2 d) {
     const int x = FIX_2_INT(d.u + u * tex->w);
     const int y = FIX_2_INT(d.v + v * tex->h);
@@ -306,207 +616,198 @@ static inline Color4 tex_sample_nearest(const struct Texture * const tex, const
     return tex->sample(tex, x, y);
 }
 
+static inline Color4 tex_sample_nearest32(const struct Texture * const tex, const fix32 u, const fix32 v) {
+    const int x = FIX32_2_INT(u * tex->w);
+    const int y = FIX32_2_INT(v * tex->h);
+    return tex->sample(tex, x, y);
+}
+
 /* color combiners */
 
-#define tex_sample tex_sample_nearest
+// fix64 combiners, used by the reference rasterizers
+#define CC_PROP fix64
+#define CC_FN(name) name
+#define CC_CHAN(p, w) fix_mult_i32(p, w)
+#define CC_TEXC(p, w) fix_mult(p, w)
+#define CC_SAMPLE tex_sample_nearest
+#include "soft/combiners.inc.c"
+#undef CC_PROP
+#undef CC_FN
+#undef CC_CHAN
+#undef CC_TEXC
+#undef CC_SAMPLE
+
+// fix32 combiners: props have R32_PROP_FRAC fraction bits, w has FRAC32_WIDTH
+#define CC_PROP fix32
+#define CC_FN(name) name ## 32
+#define CC_CHAN(p, w) (int)(((int64_t)(p) * (w)) >> (R32_PROP_FRAC + FRAC32_WIDTH))
+#define CC_TEXC(p, w) (fix32)(((int64_t)(p) * (w)) >> R32_PROP_FRAC)
+#define CC_SAMPLE tex_sample_nearest32
+#include "soft/combiners.inc.c"
+#undef CC_PROP
+#undef CC_FN
+#undef CC_CHAN
+#undef CC_TEXC
+#undef CC_SAMPLE
+
+static const combine_fn_t combine_funcs[CMB_COUNT] = {
+    combine_rgb,
+    combine_rgba,
+    combine_fog_rgb,
+    combine_fog_rgba,
+    combine_rgba_rgba,
+    combine_tex,
+    combine_tex_fog,
+    combine_tex_rgb,
+    combine_tex_fog_rgb,
+    combine_tex_rgb_decal,
+    combine_tex_rgba,
+    combine_tex_rgba_texa,
+    combine_tex_fog_rgba,
+    combine_tex_rgba_decal,
+    combine_tex_rgb_rgb,
+    combine_tex_tex_rgba,
+};
 
-static Color4 combine_rgb(const fix64 z, const fix64 *props) { // 3
-    return (Color4){ { .r = fix_mult_i32(props[0], z),
-                       .g = fix_mult_i32(props[1], z),
-                       .b = fix_mult_i32(props[2], z),
-                       .a = 0xFF } };
-}
-
-static Color4 combine_rgba(const fix64 z, const fix64 *props) { // 4
-    return (Color4){ { .r = fix_mult_i32(props[0], z),
-                       .g = fix_mult_i32(props[1], z),
-                       .b = fix_mult_i32(props[2], z),
-                       .a = fix_mult_i32(props[3], z) } };
-}
-
-static Color4 combine_fog_rgb(const fix64 z, const fix64 *props) { // 5
-    const uint8_t fog = fix_mult_i32(props[0], z);
-    const Color4 c = (Color4){ { .r = fix_mult_i32(props[1], z),
-                                 .g = fix_mult_i32(props[2], z),
-                                 .b = fix_mult_i32(props[3], z),
-                                 .a = 0xFF } };
-    return rgba_blend(fog_color, c, fog);
-}
-
-static Color4 combine_fog_rgba(const fix64 z, const fix64 *props) {
-    const uint8_t fog = fix_mult_i32(props[0], z);
-    const Color4 c = (Color4){ { .r = fix_mult_i32(props[1], z),
-                                 .g = fix_mult_i32(props[2], z),
-                                 .b = fix_mult_i32(props[3], z),
-                                 .a = fix_mult_i32(props[4], z) } };
-    return rgba_blend(fog_color, c, fog);
-}
-
-static Color4 combine_rgba_rgba(const fix64 z, const fix64 *props) {
-    const Color4 ca = (Color4){ { .r = fix_mult_i32(props[0], z),
-                                  .g = fix_mult_i32(props[1], z),
-                                  .b = fix_mult_i32(props[2], z),
-                                  .a = fix_mult_i32(props[3], z) } };
-    const Color4 cb = (Color4){ { .r = fix_mult_i32(props[4], z),
-                                  .g = fix_mult_i32(props[5], z),
-                                  .b = fix_mult_i32(props[6], z),
-                                  .a = fix_mult_i32(props[7], z) } };
-    return rgba_modulate(ca, cb);
-}
-
-static Color4 combine_tex(const fix64 z, const fix64 *props) {
-    return tex_sample(cur_tex[0], fix_mult(props[0], z), fix_mult(props[1], z));
-}
-
-static Color4 combine_tex_fog(const fix64 z, const fix64 *props) {
-    const Color4 tc = tex_sample(cur_tex[0], fix_mult(props[0], z), fix_mult(props[1], z));
-    const uint8_t fog = fix_mult_i32(props[2], z);
-    return rgba_blend(fog_color, tc, fog);
-}
-
-static Color4 combine_tex_rgb(const fix64 z, const fix64 *props) {
-    const Color4 tc = tex_sample(cur_tex[0], fix_mult(props[0], z), fix_mult(props[1], z));
-    const Color4 cc = (Color4){ { .r = fix_mult_i32(props[2], z),
-                                  .g = fix_mult_i32(props[3], z),
-                                  .b = fix_mult_i32(props[4], z),
-                                  .a = 0xFF } };
-    return rgba_modulate(tc, cc);
-}
-
-static Color4 combine_tex_fog_rgb(const fix64 z, const fix64 *props) {
-    const Color4 tc = tex_sample(cur_tex[0], fix_mult(props[0], z), fix_mult(props[1], z));
-    const uint8_t fog = fix_mult_i32(props[2], z);
-    const Color4 cc = (Color4){ { .r = fix_mult_i32(props[3], z),
-                                  .g = fix_mult_i32(props[4], z),
-                                  .b = fix_mult_i32(props[5], z),
-                                  .a = 0xFF } };
-    return rgba_blend(fog_color, rgba_modulate(tc, cc), fog);
-}
-
-static Color4 combine_tex_rgb_decal(const fix64 z, const fix64 *props) {
-    const Color4 tc = tex_sample(cur_tex[0], fix_mult(props[0], z), fix_mult(props[1], z));
-    const Color4 cc = (Color4){ { .r = fix_mult_i32(props[2], z),
-                                  .g = fix_mult_i32(props[3], z),
-                                  .b = fix_mult_i32(props[4], z),
-                                  .a = 0xFF } };
-    return rgba_blend(tc, cc, tc.a);
-}
-
-static Color4 combine_tex_rgba(const fix64 z, const fix64 *props) {
-    const Color4 tc = tex_sample(cur_tex[0], fix_mult(props[0], z), fix_mult(props[1], z));
-    const Color4 cc = (Color4){ { .r = fix_mult_i32(props[2], z),
-                                  .g = fix_mult_i32(props[3], z),
-                                  .b = fix_mult_i32(props[4], z),
-                                  .a = fix_mult_i32(props[5], z) } };
-    return rgba_modulate(tc, cc);
-}
-
-static Color4 combine_tex_rgba_texa(const fix64 z, const fix64 *props) {
-    const Color4 tc = tex_sample(cur_tex[0], fix_mult(props[0], z), fix_mult(props[1], z));
-    const Color4 cc = (Color4){ { .r = fix_mult_i32(props[2], z),
-                                  .g = fix_mult_i32(props[3], z),
-                                  .b = fix_mult_i32(props[4], z),
-                                  .a = 0xFF } };
-    return rgba_modulate(tc, cc);
-}
-
-static Color4 combine_tex_fog_rgba(const fix64 z, const fix64 *props) {
-    const Color4 tc = tex_sample(cur_tex[0], fix_mult(props[0], z), fix_mult(props[1], z));
-    const uint8_t fog = fix_mult_i32(props[2], z);
-    const Color4 cc = (Color4){ { .r = fix_mult_i32(props[3], z),
-                                  .g = fix_mult_i32(props[4], z),
-                                  .b = fix_mult_i32(props[5], z),
-                                  .a = fix_mult_i32(props[6], z) } };
-    return rgba_blend(fog_color, rgba_modulate(tc, cc), fog);
-}
-
-static Color4 combine_tex_rgba_decal(const fix64 z, const fix64 *props) {
-    const Color4 tc = tex_sample(cur_tex[0], fix_mult(props[0], z), fix_mult(props[1], z));
-    const Color4 cc = (Color4){ { .r = fix_mult_i32(props[2], z),
-                                  .g = fix_mult_i32(props[3], z),
-                                  .b = fix_mult_i32(props[4], z),
-                                  .a = fix_mult_i32(props[5], z) } };
-    return rgba_blend(tc, cc, tc.a);
-}
-
-static Color4 combine_tex_rgb_rgb(const fix64 z, const fix64 *props) {
-    const Color4 tc = tex_sample(cur_tex[0], fix_mult(props[0], z), fix_mult(props[1], z));
-    const Color4 cc1 = (Color4){ { .r = fix_mult_i32(props[2], z),
-                                   .g = fix_mult_i32(props[3], z),
-                                   .b = fix_mult_i32(props[4], z),
-                                   .a = 0xFF } };
-    const Color4 cc2 = (Color4){ { .r = fix_mult_i32(props[5], z),
-                                   .g = fix_mult_i32(props[6], z),
-                                   .b = fix_mult_i32(props[7], z),
-                                   .a = 0xFF } };
-    return rgba_lerp(cc2, cc1, tc.r);
-}
-
-static Color4 combine_tex_tex_rgba(const fix64 z, const fix64 *props) {
-    const fix64 u = fix_mult(props[0], z);
-    const fix64 v = fix_mult(props[1], z);
-    const Color4 tc1 = tex_sample(cur_tex[0], u, v);
-    const Color4 tc2 = tex_sample(cur_tex[1], u, v);
-    const uint8_t r = fix_mult_i32(props[2], z);
-    return rgba_lerp(tc1, tc2, r);
+/* fragment plotters */
+static inline void draw_pixel(const int idx, UNUSED const uint16_t z, Color4 src) {
+    r_color[idx] = rgba_to_pixel(src);
 }
 
-/* fragment plotters */
-static void draw_pixel(const int idx, UNUSED const uint16_t z, Color4 src) {
-    gfx_output[idx] = src.c;
+static inline void draw_pixel_zwrite(const int idx, const uint16_t z, Color4 src) {
+    r_color[idx] = rgba_to_pixel(src);
+    r_depth[idx] = z;
 }
 
-static void draw_pixel_zwrite(const int idx, const uint16_t z, Color4 src) {
-    gfx_output[idx] = src.c;
-    z_buffer[idx] = z;
+static inline void draw_pixel_blend(const int idx, UNUSED const uint16_t z, Color4 src) {
+    r_color[idx] = pixel_blend(src, r_color[idx]);
 }
 
-static void draw_pixel_blend(const int idx, UNUSED const uint16_t z, Color4 src) {
-    const uint8_t a = src.a;
-    const uint8_t ia = 255 - a;
-    const Color4 dst = (Color4) { .c = gfx_output[idx] };
-    src.r = mult_tab[src.r][a] + mult_tab[dst.r][ia];
-    src.g = mult_tab[src.g][a] + mult_tab[dst.g][ia];
-    src.b = mult_tab[src.b][a] + mult_tab[dst.b][ia];
-    gfx_output[idx] = src.c;
+static inline void draw_pixel_blend_zwrite(const int idx, const uint16_t z, Color4 src) {
+    r_color[idx] = pixel_blend(src, r_color[idx]);
+    r_depth[idx] = z;
 }
 
-static void draw_pixel_blend_zwrite(const int idx, const uint16_t z, Color4 src) {
-    const uint8_t a = src.a;
-    const uint8_t ia = 255 - a;
-    const Color4 dst = (Color4) { .c = gfx_output[idx] };
-    src.r = mult_tab[src.r][a] + mult_tab[dst.r][ia];
-    src.g = mult_tab[src.g][a] + mult_tab[dst.g][ia];
-    src.b = mult_tab[src.b][a] + mult_tab[dst.b][ia];
-    gfx_output[idx] = src.c;
-    z_buffer[idx] = z;
+static inline void draw_pixel_blend_edge(const int idx, UNUSED const uint16_t z, Color4 src) {
+    if (src.a > 0x80)
+        r_color[idx] = pixel_blend(src, r_color[idx]);
 }
 
-static void draw_pixel_blend_edge(const int idx, UNUSED const uint16_t z, Color4 src) {
+static inline void draw_pixel_blend_edge_zwrite(const int idx, const uint16_t z, Color4 src) {
     if (src.a > 0x80) {
-        const uint8_t a = src.a;
-        const uint8_t ia = 255 - a;
-        const Color4 dst = (Color4) { .c = gfx_output[idx] };
-        src.r = mult_tab[src.r][a] + mult_tab[dst.r][ia];
-        src.g = mult_tab[src.g][a] + mult_tab[dst.g][ia];
-        src.b = mult_tab[src.b][a] + mult_tab[dst.b][ia];
-        gfx_output[idx] = src.c;
+        r_color[idx] = pixel_blend(src, r_color[idx]);
+        r_depth[idx] = z;
     }
 }
 
-static void draw_pixel_blend_edge_zwrite(const int idx, const uint16_t z, Color4 src) {
-    if (src.a > 0x80) {
-        const uint8_t a = src.a;
-        const uint8_t ia = 255 - a;
-        const Color4 dst = (Color4) { .c = gfx_output[idx] };
-        src.r = mult_tab[src.r][a] + mult_tab[dst.r][ia];
-        src.g = mult_tab[src.g][a] + mult_tab[dst.g][ia];
-        src.b = mult_tab[src.b][a] + mult_tab[dst.b][ia];
-
-        gfx_output[idx] = src.c;
-        z_buffer[idx] = z;
+/* fix32 span kernels */
+
+// one kernel per combiner, plotter, depth test and perspective mode, so the inner loop has no indirect calls
+// and no per-pixel branches on render state
+
+// perspective spans only compute the real w every persp_subdiv pixels and lerp it in between,
+// affine spans get a constant w from the rasterizer
+#define R_SPAN32(combine, draw, ztest, persp) \
+    register int idx = span->idx; \
+    register int n = span->len; \
+    register int i, seg; \
+    fix32 * const p = span->p; \
+    const fix32 * const dp = span->dp; \
+    const int nprops = span->prop_count; \
+    const int zoff = span->zoff; \
+    fix32 w = (persp) ? r32_recip(p[3]) : span->w; \
+    fix32 w_next = w, dw = 0; \
+    uint16_t uz; \
+    while (n > 0) { \
+        seg = (persp) ? imin(n, span->subdiv) : n; \
+        n -= seg; \
+        if (persp) { \
+            /* lerp w towards the first pixel of the next run, or the last pixel of this one */ \
+            const int t = n ? seg : seg - 1; \
+            if (t) { \
+                w_next = r32_recip(p[3] + dp[3] * t); \
+                dw = (fix32)(((int64_t)(w_next - w) * recip_tab[t]) >> 16); \
+            } \
+        } \
+        while (seg--) { \
+            uz = u16clamp(r32_depth(p[2]) + zoff); \
+            if (!(ztest) || uz <= r_depth[idx]) \
+                draw(idx, uz, combine(w, p + 4)); \
+            for (i = 2; i < nprops; ++i) p[i] += dp[i]; \
+            ++idx; \
+            w += dw; \
+        } \
+        w = w_next; \
     }
-}
+
+#define SPAN32_FN(combine, draw, ztest, persp) span_ ## combine ## _ ## draw ## _ ## ztest ## persp
+
+#define DEFINE_SPAN32_FUNC(combine, draw, ztest, persp) \
+    static void SPAN32_FN(combine, draw, ztest, persp) (const struct Span *span) { R_SPAN32(combine, draw, ztest, persp); }
+
+#define DEFINE_SPAN32_DRAW(combine, draw) \
+    DEFINE_SPAN32_FUNC(combine, draw, 0, 0) \
+    DEFINE_SPAN32_FUNC(combine, draw, 0, 1) \
+    DEFINE_SPAN32_FUNC(combine, draw, 1, 0) \
+    DEFINE_SPAN32_FUNC(combine, draw, 1, 1)
+
+#define DEFINE_SPAN32_COMBINER(combine) \
+    DEFINE_SPAN32_DRAW(combine, draw_pixel) \
+    DEFINE_SPAN32_DRAW(combine, draw_pixel_zwrite) \
+    DEFINE_SPAN32_DRAW(combine, draw_pixel_blend) \
+    DEFINE_SPAN32_DRAW(combine, draw_pixel_blend_zwrite) \
+    DEFINE_SPAN32_DRAW(combine, draw_pixel_blend_edge) \
+    DEFINE_SPAN32_DRAW(combine, draw_pixel_blend_edge_zwrite)
+
+// table rows, in the same order as the draw_funcs table in gfx_soft_pick_draw_func()
+
+#define GET_SPAN32_DRAW(combine, draw) \
+    { { SPAN32_FN(combine, draw, 0, 0), SPAN32_FN(combine, draw, 0, 1) }, \
+      { SPAN32_FN(combine, draw, 1, 0), SPAN32_FN(combine, draw, 1, 1) } }
+
+#define GET_SPAN32_COMBINER(combine) { \
+    GET_SPAN32_DRAW(combine, draw_pixel), \
+    GET_SPAN32_DRAW(combine, draw_pixel_zwrite), \
+    GET_SPAN32_DRAW(combine, draw_pixel_blend), \
+    GET_SPAN32_DRAW(combine, draw_pixel_blend_zwrite), \
+    GET_SPAN32_DRAW(combine, draw_pixel_blend_edge), \
+    GET_SPAN32_DRAW(combine, draw_pixel_blend_edge_zwrite) }
+
+DEFINE_SPAN32_COMBINER(combine_rgb32)
+DEFINE_SPAN32_COMBINER(combine_rgba32)
+DEFINE_SPAN32_COMBINER(combine_fog_rgb32)
+DEFINE_SPAN32_COMBINER(combine_fog_rgba32)
+DEFINE_SPAN32_COMBINER(combine_rgba_rgba32)
+DEFINE_SPAN32_COMBINER(combine_tex32)
+DEFINE_SPAN32_COMBINER(combine_tex_fog32)
+DEFINE_SPAN32_COMBINER(combine_tex_rgb32)
+DEFINE_SPAN32_COMBINER(combine_tex_fog_rgb32)
+DEFINE_SPAN32_COMBINER(combine_tex_rgb_decal32)
+DEFINE_SPAN32_COMBINER(combine_tex_rgba32)
+DEFINE_SPAN32_COMBINER(combine_tex_rgba_texa32)
+DEFINE_SPAN32_COMBINER(combine_tex_fog_rgba32)
+DEFINE_SPAN32_COMBINER(combine_tex_rgba_decal32)
+DEFINE_SPAN32_COMBINER(combine_tex_rgb_rgb32)
+DEFINE_SPAN32_COMBINER(combine_tex_tex_rgba32)
+
+static const span_fn_t span32_funcs[CMB_COUNT][6][2][2] = {
+    GET_SPAN32_COMBINER(combine_rgb32),
+    GET_SPAN32_COMBINER(combine_rgba32),
+    GET_SPAN32_COMBINER(combine_fog_rgb32),
+    GET_SPAN32_COMBINER(combine_fog_rgba32),
+    GET_SPAN32_COMBINER(combine_rgba_rgba32),
+    GET_SPAN32_COMBINER(combine_tex32),
+    GET_SPAN32_COMBINER(combine_tex_fog32),
+    GET_SPAN32_COMBINER(combine_tex_rgb32),
+    GET_SPAN32_COMBINER(combine_tex_fog_rgb32),
+    GET_SPAN32_COMBINER(combine_tex_rgb_decal32),
+    GET_SPAN32_COMBINER(combine_tex_rgba32),
+    GET_SPAN32_COMBINER(combine_tex_rgba_texa32),
+    GET_SPAN32_COMBINER(combine_tex_fog_rgba32),
+    GET_SPAN32_COMBINER(combine_tex_rgba_decal32),
+    GET_SPAN32_COMBINER(combine_tex_rgb_rgb32),
+    GET_SPAN32_COMBINER(combine_tex_tex_rgba32),
+};
 
 /* rasterizers */
 
@@ -525,11 +826,11 @@ static void draw_pixel_blend_edge_zwrite(const int idx, const uint16_t z, Color4
         /* do X subpixel prestepping */ \
         dx = FIX_ONE - (x_a - INT_2_FIX(x)); \
         for (i = 2; i < nprops; ++i) p[i] = p_a[i] + fix_mult(dx, dp[i].x); \
-        idx = scr_width * (scr_height - y - 1) + x; \
+        idx = r_base - y * r_pitch + x; \
         /* draw scanline from current x_a to current x_b */ \
          while (x++ < x_end) { \
             uz = u16clamp(FIX_2_INT(p[2] * 65535 + z_offset)); \
-            if (!z_test || uz <= z_buffer[idx]) { \
+            if (!z_test || uz <= r_depth[idx]) { \
                 /* Improve efficiency here? w is 1 very often */ \
                 w = p[3] == FIX_ONE ? FIX_ONE : fix_div_s(FIX_ONE, p[3]); /*  the combiner will multiply by w any props it needs to persp correct */ \
                 draw_fn(idx, uz, cur_shader->combine(w, p + 4)); \
@@ -549,8 +850,8 @@ static void draw_pixel_blend_edge_zwrite(const int idx, const uint16_t z, Color4
     const fix64 *v1 = (fix64 *) tri.v1; \
     const fix64 *v2 = (fix64 *) tri.v2; \
     const int y0i = imax(r_clip.y0, FIX_2_INT(v0[1])); \
-    const int y1i = imax(y0i, FIX_2_INT(v1[1])); \
     const int y2i = imin(r_clip.y1, FIX_2_INT(v2[1])); \
+    const int y1i = imin(y2i, imax(y0i, FIX_2_INT(v1[1]))); /* the first segment has to be clipped too */ \
     if ((y0i == y1i && y0i == y2i) || (FIX_2_INT(v0[0]) == FIX_2_INT(v1[0]) && FIX_2_INT(v0[0]) == FIX_2_INT(v2[0]))) \
         return; /* triangle has zero area */  \
     const Vector4 ab = (Vector4) {{ v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2], v1[3] - v0[3] }}; \
@@ -642,32 +943,331 @@ DEFINE_RAST_FUNC(12)
 DEFINE_RAST_FUNC(13)
 DEFINE_RAST_FUNC(14)
 
-static inline void pop_triangle(const fix64 *buf, const int stride) {
+/* fix32 rasterizers */
+
+// same walk as above, but only the triangle setup is done in fix64: edges and properties are then
+// narrowed to fix32 (x/y with FRAC32_WIDTH fraction bits, z with R32_PROP_FRAC) so the per-scanline
+// and per-pixel work only needs 32-bit adds and 32x32->64 multiplies
+// 1/w and the props premultiplied by it get as many fraction bits as the triangle allows: far away
+// they are tiny and would lose most of their precision otherwise. the combiners still shift by
+// R32_PROP_FRAC since the extra scale cancels out between a prop and the 1/(1/w) it is multiplied by
+// the scanlines themselves are drawn by the span kernels picked in gfx_soft_pick_draw_func()
+
+// fraction bits used for prop i
+#define R32_FRAC(i) ((i) == 2 ? R32_PROP_FRAC : frac)
+
+#define R_RASTERIZE32_TRI_SEG(y_a, y_b, nprops) \
+    register int y = y_a; \
+    register int y_end = y_b; \
+    register int x, x_end; \
+    fix32 dx; \
+    /* draw triangle segment from y_a to y_b */ \
+    while (y < y_end) { \
+        /* do scissor clipping */ \
+        x = imax(r_clip.x0, FIX32_2_INT(x_a)); \
+        x_end = imin(r_clip.x1, FIX32_2_INT(x_b)); \
+        /* do X subpixel prestepping */ \
+        dx = FIX32_ONE - (x_a - INT_2_FIX32(x)); \
+        for (i = 2; i < nprops; ++i) p[i] = p_a[i] + fix32_mult(dx, dp_x[i]); \
+        /* draw scanline from current x_a to current x_b */ \
+        if (x < x_end) { \
+            span.idx = r_base - y * r_pitch + x; \
+            span.len = x_end - x; \
+            span_draw(&span); \
+        } \
+        /* advance scanline start and end and prop starts */ \
+        x_a += dxdy_a; \
+        x_b += dxdy_b; \
+        for (i = 2; i < nprops; ++i) p_a[i] += dpdy_a[i]; \
+        ++y; \
+    }
+
+#define R_RASTERIZE32(tri, nprops) \
+    const fix64 *v0 = (fix64 *) tri.v0; \
+    const fix64 *v1 = (fix64 *) tri.v1; \
+    const fix64 *v2 = (fix64 *) tri.v2; \
+    const int y0i = imax(r_clip.y0, FIX_2_INT(v0[1])); \
+    const int y2i = imin(r_clip.y1, FIX_2_INT(v2[1])); \
+    const int y1i = imin(y2i, imax(y0i, FIX_2_INT(v1[1]))); /* the first segment has to be clipped too */ \
+    if ((y0i == y1i && y0i == y2i) || (FIX_2_INT(v0[0]) == FIX_2_INT(v1[0]) && FIX_2_INT(v0[0]) == FIX_2_INT(v2[0]))) \
+        return; /* triangle has zero area */  \
+    const Vector4 ab = (Vector4) {{ v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2], v1[3] - v0[3] }}; \
+    const Vector4 ac = (Vector4) {{ v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2], v2[3] - v0[3] }}; \
+    const Vector2 bc = (Vector2) {{ v2[0] - v1[0], v2[1] - v1[1] }}; \
+    const fix64 denom = fix_div_s(FIX_ONE, fix_mult(ac.x, ab.y) - fix_mult(ab.x, ac.y)); \
+    const fix64 dxdy_ab = ab.y != 0 ? fix_div_s(ab.x, ab.y) : ab.x > 0 ? FIX_MAX : FIX_MIN; /* x increment along ab */ \
+    const fix64 dxdy_ac = ac.y != 0 ? fix_div_s(ac.x, ac.y) : ac.x > 0 ? FIX_MAX : FIX_MIN; /* x increment along ac */ \
+    const fix64 dxdy_bc = bc.y != 0 ? fix_div_s(bc.x, bc.y) : bc.x > 0 ? FIX_MAX : FIX_MIN; \
+    /* saturated slopes (flat edges) are fine as long as their segment is empty and they are never stepped */ \
+    if (!r32_x_fits(v0[0]) || !r32_x_fits(v1[0]) || !r32_x_fits(v2[0]) || !r32_x_fits(dxdy_ac) || \
+        (y0i < y1i && !r32_x_fits(dxdy_ab)) || (y1i < y2i && !r32_x_fits(dxdy_bc))) { \
+        rast_fn_ ## nprops (tri); /* the edge walk would overflow */ \
+        return; \
+    } \
+    const bool side = dxdy_ac > dxdy_ab; /* which side the longer edge (AC) is on */ \
+    const fix64 y_pre0 = FIX_ONE - (v0[1] - INT_2_FIX(y0i));  /* subpixel pre-step */ \
+    const int frac = r32_prop_frac(v0, v1, v2, nprops); /* fraction bits for everything past z */ \
+    const fix32 one_w = 1 << frac; /* 1/w == 1 */ \
+    const fix32 w_one = 1 << (R32_PROP_FRAC + FRAC32_WIDTH - frac); /* w for the above */ \
+    const fix64 inv_w_min = fix_min(v0[3], fix_min(v1[3], v2[3])); \
+    const fix64 inv_w_max = fix_max(v0[3], fix_max(v1[3], v2[3])); \
+    const fix32 inv_w = fix_narrow((inv_w_min + inv_w_max) >> 1, frac); /* for affine spans */ \
+    /* skip perspective correction if w is constant over the triangle, or unless in exact mode, */ \
+    /* if it is nearly constant or the triangle is tiny anyway */ \
+    const bool persp = persp_subdiv && inv_w_max != inv_w_min && (persp_subdiv == 1 || \
+        (inv_w_max - inv_w_min > (inv_w_min >> R32_AFFINE_SPREAD) && \
+         (y2i - y0i >= R32_AFFINE_SIZE || \
+          FIX_2_INT(fix_max(v0[0], fix_max(v1[0], v2[0])) - fix_min(v0[0], fix_min(v1[0], v2[0]))) >= R32_AFFINE_SIZE))); \
+    const span_fn_t span_draw = span_fn[persp]; \
+    fix32 dpdy_a[nprops]; /* vertex prop increments along left edge */ \
+    fix32 p_a[nprops];    /* vertex leftmost points */ \
+    fix32 p[nprops];      /* current vertex prop values */ \
+    fix32 dp_x[nprops];   /* X increments for vertex props */ \
+    Vector2 dp[nprops];   /* X and Y increments for vertex props, fix64 for the setup */ \
+    register int i; \
+    struct Span span = (struct Span) { \
+        .prop_count = nprops, \
+        .zoff = FIX_2_INT(z_offset), \
+        .subdiv = persp_subdiv, \
+        .w = inv_w == one_w ? w_one : r32_recip(inv_w), \
+        .p = p, \
+        .dp = dp_x, \
+    }; \
+    /* we'll interpolate z/w (p[2]), 1/w (p[3]) and the other properties (also divided by w) */ \
+    for (i = 2; i < nprops; ++i) { \
+        dp[i].x = fix_mult(fix_mult(v2[i] - v0[i], ab.y) - fix_mult(v1[i] - v0[i], ac.y), denom); \
+        dp[i].y = fix_mult(fix_mult(v1[i] - v0[i], ac.x) - fix_mult(v2[i] - v0[i], ab.x), denom); \
+        dp_x[i] = fix_narrow(dp[i].x, R32_FRAC(i)); \
+    } \
+    if (!side) { \
+        /* longer edge is on the left */ \
+        const fix32 dxdy_a = fix_narrow(dxdy_ac, FRAC32_WIDTH); \
+        /* first column of this scanline is on AC */ \
+        fix32 x_a = fix_narrow(v0[0] + fix_mult(y_pre0, dxdy_ac), FRAC32_WIDTH); \
+        for (i = 2; i < nprops; ++i) { \
+            const fix64 dpdy = fix_mult(dxdy_ac, dp[i].x) + dp[i].y; \
+            dpdy_a[i] = fix_narrow(dpdy, R32_FRAC(i)); \
+            p_a[i] = fix_narrow(v0[i] + fix_mult(y_pre0, dpdy), R32_FRAC(i)); \
+        } \
+        if (y0i < y1i) { \
+            /* left is AC, right is AB */ \
+            const fix32 dxdy_b = fix_narrow(dxdy_ab, FRAC32_WIDTH); \
+            /* last column of this scanline */ \
+            fix32 x_b = fix_narrow(v0[0] + fix_mult(y_pre0, dxdy_ab), FRAC32_WIDTH); \
+            R_RASTERIZE32_TRI_SEG(y0i, y1i, nprops); \
+        } \
+        if (y1i < y2i) { \
+            /* left is AC, right is BC */ \
+            const fix32 dxdy_b = fix_narrow(dxdy_bc, FRAC32_WIDTH); \
+            /* calculate prestep for vertex B */ \
+            const fix64 y_pre1 = FIX_ONE - (v1[1] - INT_2_FIX(y1i)); \
+            fix32 x_b = fix_narrow(v1[0] + fix_mult(y_pre1, dxdy_bc), FRAC32_WIDTH); \
+            R_RASTERIZE32_TRI_SEG(y1i, y2i, nprops); \
+        } \
+    } else { \
+        /* longer edge is on the right */ \
+        const fix32 dxdy_b = fix_narrow(dxdy_ac, FRAC32_WIDTH); \
+        /* last column of this scanline is on AC */ \
+        fix32 x_b = fix_narrow(v0[0] + fix_mult(y_pre0, dxdy_ac), FRAC32_WIDTH); \
+        if (y0i < y1i) { \
+            /* right is AC, left is AB */ \
+            const fix32 dxdy_a = fix_narrow(dxdy_ab, FRAC32_WIDTH); \
+            fix32 x_a = fix_narrow(v0[0] + fix_mult(y_pre0, dxdy_ab), FRAC32_WIDTH); \
+            for (i = 2; i < nprops; ++i) { \
+                const fix64 dpdy = fix_mult(dxdy_ab, dp[i].x) + dp[i].y; \
+                dpdy_a[i] = fix_narrow(dpdy, R32_FRAC(i)); \
+                p_a[i] = fix_narrow(v0[i] + fix_mult(y_pre0, dpdy), R32_FRAC(i)); \
+            } \
+            R_RASTERIZE32_TRI_SEG(y0i, y1i, nprops); \
+        } \
+        if (y1i < y2i) { \
+            /* right is AC, left is BC */ \
+            const fix64 y_pre1 = FIX_ONE - (v1[1] - INT_2_FIX(y1i)); \
+            const fix32 dxdy_a = fix_narrow(dxdy_bc, FRAC32_WIDTH); \
+            fix32 x_a = fix_narrow(v1[0] + fix_mult(y_pre1, dxdy_bc), FRAC32_WIDTH); \
+            for (i = 2; i < nprops; ++i) { \
+                const fix64 dpdy = fix_mult(dxdy_bc, dp[i].x) + dp[i].y; \
+                dpdy_a[i] = fix_narrow(dpdy, R32_FRAC(i)); \
+                p_a[i] = fix_narrow(v1[i] + fix_mult(y_pre1, dpdy), R32_FRAC(i)); \
+            } \
+            R_RASTERIZE32_TRI_SEG(y1i, y2i, nprops); \
+        } \
+    }
+
+#define DEFINE_RAST32_FUNC(nprops) \
+    static void rast32_fn_ ## nprops (const struct Tri tri) { R_RASTERIZE32(tri, nprops); }
+
+#define GET_RAST32_FUNC(nprops) rast32_fn_ ## nprops
+
+DEFINE_RAST32_FUNC(6)
+DEFINE_RAST32_FUNC(7)
+DEFINE_RAST32_FUNC(8)
+DEFINE_RAST32_FUNC(9)
+DEFINE_RAST32_FUNC(10)
+DEFINE_RAST32_FUNC(11)
+DEFINE_RAST32_FUNC(12)
+DEFINE_RAST32_FUNC(13)
+DEFINE_RAST32_FUNC(14)
+
+// vertices must already be in screen space
+static inline struct Tri sort_triangle(const fix64 *buf0, const fix64 *buf1, const fix64 *buf2) {
+    const fix64 *v0 = buf0, *v1 = buf1, *v2 = buf2, *vt;
+
+    // sort in Y order
+    if (v0[1] > v1[1]) { vt = v0; v0 = v1; v1 = vt; }
+    if (v0[1] > v2[1]) { vt = v0; v0 = v2; v2 = vt; }
+    if (v1[1] > v2[1]) { vt = v1; v1 = v2; v2 = vt; }
+
+    return (struct Tri) { (fix64 *)v0, (fix64 *)v1, (fix64 *)v2 };
+}
+
+static inline struct Tri setup_triangle(const fix64 *buf, const int stride) {
     Vector4 *v0 = (Vector4 *)buf;
     Vector4 *v1 = (Vector4 *)(buf + stride);
     Vector4 *v2 = (Vector4 *)(buf + (stride << 1));
-    Vector4 *vt;
 
     // the vertices come to us in clip space, but already divided by w, still gotta transform
     viewport_transform(v0);
     viewport_transform(v1);
     viewport_transform(v2);
 
-    // sort in Y order
-    if (v0->y > v1->y) { vt = v0; v0 = v1; v1 = vt; }
-    if (v0->y > v2->y) { vt = v0; v0 = v2; v2 = vt; }
-    if (v1->y > v2->y) { vt = v1; v1 = v2; v2 = vt; }
+    return sort_triangle((fix64 *)v0, (fix64 *)v1, (fix64 *)v2);
+}
+
+/* coarse depth */
+
+// a triangle whose nearest point is behind every block it touches can't pass the depth test anywhere and is
+// skipped without being rasterized. a triangle that writes depth over whole blocks lowers their entries to
+// its farthest point, so the entries follow the depth buffer as the occluders are drawn
+
+static inline int hiz_depth(const fix64 *v) {
+    return FIX_2_INT(v[2] * 65535 + z_offset);
+}
+
+// the blocks a triangle may touch inside the scissor, inclusive. false if there are none
+static inline bool tri_blocks(const struct Tri tri, struct ClipRect *b) {
+    const int x0 = imax(imax(0, r_clip.x0), FIX_2_INT(fix_min(tri.v0[0], fix_min(tri.v1[0], tri.v2[0]))));
+    const int x1 = imin(imin(scr_width, r_clip.x1) - 1, FIX_2_INT(fix_max(tri.v0[0], fix_max(tri.v1[0], tri.v2[0]))));
+    const int y0 = imax(imax(0, r_clip.y0), FIX_2_INT(tri.v0[1]));
+    const int y1 = imin(imin(scr_height, r_clip.y1) - 1, FIX_2_INT(tri.v2[1]));
+    if (x0 > x1 || y0 > y1) return false;
+    b->x0 = x0 >> HIZ_SHIFT;
+    b->y0 = y0 >> HIZ_SHIFT;
+    b->x1 = x1 >> HIZ_SHIFT;
+    b->y1 = y1 >> HIZ_SHIFT;
+    return true;
+}
+
+static inline bool hiz_occluded(const struct Tri tri, const struct ClipRect *b) {
+    const int z = u16clamp(imin(hiz_depth(tri.v0), imin(hiz_depth(tri.v1), hiz_depth(tri.v2))) - HIZ_MARGIN);
+    for (int by = b->y0; by <= b->y1; ++by)
+        for (int bx = b->x0; bx <= b->x1; ++bx)
+            if (z <= hiz[by * hiz_w + bx]) return false;
+    return true;
+}
+
+// which side of the edge from a to b the point p is on, everything in pixels with 4 fraction bits
+static inline int64_t hiz_edge(const int64_t *a, const int64_t *b, const int64_t px, const int64_t py) {
+    return (b[0] - a[0]) * (py - a[1]) - (b[1] - a[1]) * (px - a[0]);
+}
+
+static inline bool hiz_inside(const int64_t v[3][2], const int64_t sign, const int64_t px, const int64_t py) {
+    return hiz_edge(v[0], v[1], px, py) * sign >= 0 &&
+           hiz_edge(v[1], v[2], px, py) * sign >= 0 &&
+           hiz_edge(v[2], v[0], px, py) * sign >= 0;
+}
 
-    const struct Tri out = (struct Tri) { (fix64 *)v0, (fix64 *)v1, (fix64 *)v2 };
-    cur_shader->rast(out);
+static void hiz_update(const struct Tri tri, const struct ClipRect *b) {
+    if (!z_test) {
+        // depth went up wherever the triangle was drawn
+        for (int by = b->y0; by <= b->y1; ++by)
+            for (int bx = b->x0; bx <= b->x1; ++bx)
+                hiz[by * hiz_w + bx] = 0xFFFF;
+        return;
+    }
+    // pixels that fail the alpha test keep their depth
+    if (cur_shader->draw_flags == DRAW_BLEND_EDGE) return;
+
+    const int64_t v[3][2] = {
+        { tri.v0[0] >> (FRAC_WIDTH - 4), tri.v0[1] >> (FRAC_WIDTH - 4) },
+        { tri.v1[0] >> (FRAC_WIDTH - 4), tri.v1[1] >> (FRAC_WIDTH - 4) },
+        { tri.v2[0] >> (FRAC_WIDTH - 4), tri.v2[1] >> (FRAC_WIDTH - 4) },
+    };
+    // too small to cover a block
+    if (v[2][1] - v[0][1] < (HIZ_SIZE + 2) << 4) return;
+    const int64_t area = hiz_edge(v[0], v[1], v[2][0], v[2][1]);
+    if (area == 0) return;
+    const int64_t sign = area > 0 ? 1 : -1;
+    const int z = u16clamp(imax(hiz_depth(tri.v0), imax(hiz_depth(tri.v1), hiz_depth(tri.v2))) + HIZ_MARGIN);
+    const int clip_x0 = imax(0, r_clip.x0), clip_x1 = imin(scr_width, r_clip.x1);
+    const int clip_y0 = imax(0, r_clip.y0), clip_y1 = imin(scr_height, r_clip.y1);
+
+    for (int by = b->y0; by <= b->y1; ++by) {
+        const int y = by << HIZ_SHIFT;
+        if (y < clip_y0 || y + HIZ_SIZE > clip_y1) continue;
+        // a pixel further than one away from the edges is drawn whichever way its row and column are rounded
+        const int64_t py0 = (int64_t)(y - 1) << 4, py1 = (int64_t)(y + HIZ_SIZE + 1) << 4;
+        for (int bx = b->x0; bx <= b->x1; ++bx) {
+            const int x = bx << HIZ_SHIFT;
+            uint16_t *entry = &hiz[by * hiz_w + bx];
+            if (*entry <= z || x < clip_x0 || x + HIZ_SIZE > clip_x1) continue;
+            const int64_t px0 = (int64_t)(x - 1) << 4, px1 = (int64_t)(x + HIZ_SIZE + 1) << 4;
+            if (hiz_inside(v, sign, px0, py0) && hiz_inside(v, sign, px1, py0) &&
+                hiz_inside(v, sign, px0, py1) && hiz_inside(v, sign, px1, py1))
+                *entry = z;
+        }
+    }
+}
+
+// clears the stale blocks among the given ones, must be done before their depth is read or written
+static void depth_prepare(const struct ClipRect *b) {
+    for (int by = b->y0; by <= b->y1; ++by) {
+        for (int bx = b->x0; bx <= b->x1; ++bx) {
+            if (!z_stale[by * hiz_w + bx]) continue;
+            z_stale[by * hiz_w + bx] = 0;
+            const int x = bx << HIZ_SHIFT;
+            const int w = imin(HIZ_SIZE, scr_width - x);
+            const int y_end = imin((by + 1) << HIZ_SHIFT, scr_height);
+            for (int y = by << HIZ_SHIFT; y < y_end; ++y)
+                memset(z_buffer + scr_width * (scr_height - y - 1) + x, 0xFF, w * sizeof(*z_buffer));
+        }
+    }
+}
+
+static inline void depth_prepare_rect(const int x0, const int y0, const int x1, const int y1) {
+    if (x0 >= x1 || y0 >= y1) return;
+    const struct ClipRect b = { x0 >> HIZ_SHIFT, y0 >> HIZ_SHIFT, (x1 - 1) >> HIZ_SHIFT, (y1 - 1) >> HIZ_SHIFT };
+    depth_prepare(&b);
+}
+
+static inline void rast_triangle(const struct Tri tri) {
+    if (!z_test && !z_write) {
+        cur_shader->rast(tri);
+        return;
+    }
+    struct ClipRect b;
+    if (!tri_blocks(tri, &b)) return;
+    depth_prepare(&b);
+    if (configHiZ && z_test && hiz_occluded(tri, &b)) {
+        ++numOccludedTris;
+        return;
+    }
+    cur_shader->rast(tri);
+    if (configHiZ && z_write) hiz_update(tri, &b);
 }
 
+static inline void pop_triangle(const fix64 *buf, const int stride) {
+    rast_triangle(setup_triangle(buf, stride));
+}
+
+// the blocks are only cleared once something draws into them, see depth_prepare()
 static inline void depth_clear(void) {
-    memset(z_buffer, 0xFF, scr_size << 1);
+    memset(z_stale, 1, hiz_w * hiz_h);
+    memset(hiz, 0xFF, hiz_w * hiz_h * sizeof(*hiz));
 }
 
 static inline void color_clear(void) {
-    memset(gfx_output, 0x00, scr_size << 2);
+    memset(gfx_output, 0x00, scr_size * sizeof(gfx_pixel_t));
 }
 
 /* FIXME: ztrick fucks with sky blending
@@ -716,10 +1316,28 @@ static struct ShaderProgram *gfx_soft_create_and_load_new_shader(uint32_t shader
         GET_RAST_FUNC(13),
         GET_RAST_FUNC(14),
     };
+    static const rast_fn_t rast32_funcs[] = {
+        NULL,
+        NULL,
+        GET_RAST32_FUNC(6),
+        GET_RAST32_FUNC(7),
+        GET_RAST32_FUNC(8),
+        GET_RAST32_FUNC(9),
+        GET_RAST32_FUNC(10),
+        GET_RAST32_FUNC(11),
+        GET_RAST32_FUNC(12),
+        GET_RAST32_FUNC(13),
+        GET_RAST32_FUNC(14),
+    };
 
     struct CCFeatures ccf;
     gfx_cc_get_features(shader_id, &ccf);
 
+    if (shader_program_pool_size >= MAX_SHADERS) {
+        printf("gfx_soft: ran out of shader slots\n");
+        abort();
+    }
+
     struct ShaderProgram *prg = &shader_program_pool[shader_program_pool_size++];
 
     prg->shader_id = shader_id;
@@ -734,33 +1352,36 @@ static struct ShaderProgram *gfx_soft_create_and_load_new_shader(uint32_t shader
 
     if (ccf.used_textures[0] && ccf.used_textures[1]) {
         prg->mix = SH_MT_TEXTURE_TEXTURE;
-        prg->combine = combine_tex_tex_rgba; // only one such known shader
+        prg->comb = CMB_TEX_TEX_RGBA; // only one such known shader
     } else if (ccf.used_textures[0] && ccf.num_inputs) {
         prg->mix = SH_MT_TEXTURE_COLOR;
         if (ccf.num_inputs > 1)
-            prg->combine = combine_tex_rgb_rgb; // only one such known shader
+            prg->comb = CMB_TEX_RGB_RGB; // only one such known shader
         else if (shader_id == 0x0000038D || shader_id == 0x01200A00 || shader_id == 0x01045A00)
-            prg->combine = ccf.opt_alpha ? combine_tex_rgba_decal : combine_tex_rgb_decal;
+            prg->comb = ccf.opt_alpha ? CMB_TEX_RGBA_DECAL : CMB_TEX_RGB_DECAL;
         else if (ccf.opt_fog)
-            prg->combine = ccf.opt_alpha ? combine_tex_fog_rgba : combine_tex_fog_rgb;
+            prg->comb = ccf.opt_alpha ? CMB_TEX_FOG_RGBA : CMB_TEX_FOG_RGB;
         else if (ccf.opt_alpha)
-            prg->combine = shader_id == 0x01A00045 ? combine_tex_rgba_texa : combine_tex_rgba;
+            prg->comb = shader_id == 0x01A00045 ? CMB_TEX_RGBA_TEXA : CMB_TEX_RGBA;
         else
-            prg->combine = combine_tex_rgb;
+            prg->comb = CMB_TEX_RGB;
     } else if (ccf.used_textures[0]) {
         prg->mix = SH_MT_TEXTURE;
-        prg->combine = ccf.opt_fog ? combine_tex_fog : combine_tex;
+        prg->comb = ccf.opt_fog ? CMB_TEX_FOG : CMB_TEX;
     } else if (ccf.num_inputs > 1) {
         prg->mix = SH_MT_COLOR_COLOR;
-        prg->combine = combine_rgba_rgba; // only one such known shader
+        prg->comb = CMB_RGBA_RGBA; // only one such known shader
     } else if (ccf.num_inputs) {
         prg->mix = SH_MT_COLOR;
         if (ccf.opt_fog)
-            prg->combine = ccf.opt_alpha ? combine_fog_rgba : combine_fog_rgb;
+            prg->comb = ccf.opt_alpha ? CMB_FOG_RGBA : CMB_FOG_RGB;
         else
-            prg->combine = ccf.opt_alpha ? combine_rgba : combine_rgb;
+            prg->comb = ccf.opt_alpha ? CMB_RGBA : CMB_RGB;
     }
 
+    prg->combine = combine_funcs[prg->comb];
+    prg->spans = span32_funcs[prg->comb];
+
     if (ccf.opt_alpha) {
         if (ccf.opt_texture_edge)
             prg->draw_flags = DRAW_BLEND_EDGE;
@@ -772,7 +1393,7 @@ static struct ShaderProgram *gfx_soft_create_and_load_new_shader(uint32_t shader
 
     prg->num_props = num_props;
     // pick rasterizer that interps the amount of float properties this shader requires
-    prg->rast = rast_funcs[num_props];
+    prg->rast = configFastRasterizer ? rast32_funcs[num_props] : rast_funcs[num_props];
 
     gfx_soft_load_shader(prg);
 
@@ -795,50 +1416,264 @@ static void gfx_soft_shader_get_info(struct ShaderProgram *prg, uint8_t *num_inp
 }
 
 static uint32_t gfx_soft_new_texture(void) {
-    static uint16_t tex_num = 0; // amount of textures in cache
     const uint32_t id = tex_num++;
     if (tex_num > MAX_TEXTURES) {
         printf("gfx_soft: ran out of texture slots\n");
         abort();
     }
 
-    tex_hdr[id].sample = tex_sample_nearest_rr;
+    tex_hdr[id].fmt = TEX_RGBA32;
+    tex_hdr[id].wrap = 0;
+    tex_hdr[id].size = 0;
+    tex_hdr[id].tlut = NULL;
+    tex_hdr[id].last_use = tex_frame;
+    tex_hdr[id].sample = samplers[TEX_RGBA32][0];
 
     return id;
 }
 
 static void gfx_soft_select_texture(int tile, uint32_t texture_id) {
     cur_tex[tile] = tex_hdr + texture_id;
+    cur_tex[tile]->last_use = tex_frame;
     cur_tmu = tile;
 }
 
-static uint32_t tex_cache_alloc(const uint32_t w, const uint32_t h) {
-    const uint32_t size = w * h * 4;
+static void bin_flush(void);
 
-    if (texcache_addr + size > texcache_size) {
-        texcache_size += TEXCACHE_STEP + size;
-        texcache_size = ALIGN(texcache_size, TEXCACHE_STEP);
-        texcache = realloc(texcache, texcache_size);
-        if (!texcache) {
-            printf("gfx_soft: could not alloc %u bytes for texture cache\n", texcache_size);
-            abort();
+static void tex_cache_free(struct Texture *tex) {
+    if (!tex->size) return;
+    texcache_used -= tex->size;
+    if (tex->tlut) {
+        --tex->tlut->refs;
+        tex->tlut = NULL;
+    }
+    // the last allocation can be handed out again right away, unless binned triangles still sample it
+    if (tex->addr + tex->size == texcache_addr && !bin_tri_num)
+        texcache_addr = tex->addr;
+    tex->size = 0;
+    texBytes = texcache_used;
+}
+
+// drops the least recently used texture that isn't selected right now
+static void tex_cache_evict(void) {
+    struct Texture *lru = NULL;
+    for (uint32_t i = 0; i < tex_num; ++i) {
+        struct Texture *tex = &tex_hdr[i];
+        if (!tex->size || tex == cur_tex[0] || tex == cur_tex[1])
+            continue;
+        if (!lru || (int32_t)(tex->last_use - lru->last_use) < 0)
+            lru = tex;
+    }
+    if (!lru) {
+        printf("gfx_soft: texture cache is too small for the selected textures\n");
+        abort();
+    }
+    tex_cache_free(lru);
+    ++texEvictions;
+}
+
+static int tex_cmp_addr(const void *a, const void *b) {
+    const struct Texture *ta = *(struct Texture * const *)a;
+    const struct Texture *tb = *(struct Texture * const *)b;
+    return (ta->addr > tb->addr) - (ta->addr < tb->addr);
+}
+
+// slides every resident texture down to close the holes left by freed ones
+static void tex_cache_compact(void) {
+    static struct Texture *resident[MAX_TEXTURES];
+    uint32_t num = 0;
+    for (uint32_t i = 0; i < tex_num; ++i)
+        if (tex_hdr[i].size)
+            resident[num++] = &tex_hdr[i];
+
+    qsort(resident, num, sizeof(*resident), tex_cmp_addr);
+
+    texcache_addr = 0;
+    for (uint32_t i = 0; i < num; ++i) {
+        struct Texture *tex = resident[i];
+        if (tex->addr != texcache_addr) {
+            memmove(texcache + texcache_addr, texcache + tex->addr, tex->size);
+            tex->addr = texcache_addr;
         }
+        texcache_addr += tex->size;
+    }
+}
+
+static uint32_t tex_cache_alloc(uint32_t size) {
+    size = ALIGN(size, 4); // keep every texture word aligned
+
+    if (size > texcache_size) {
+        printf("gfx_soft: texture of %u bytes does not fit in the texture cache\n", size);
+        abort();
+    }
+
+    if (texcache_addr + size > texcache_size) {
+        // textures are about to move or go away, draw whatever still refers to them first
+        bin_flush();
+        while (texcache_used + size > texcache_size)
+            tex_cache_evict();
+        tex_cache_compact();
     }
 
     uint32_t ret = texcache_addr;
     texcache_addr += size;
+    texcache_used += size;
+    texBytes = texcache_used;
     return ret;
 }
 
-static void gfx_soft_upload_texture(const uint8_t *rgba32_buf, int width, int height) {
-    uint32_t addr = tex_cache_alloc(width, height);
-    memcpy(texcache + addr, rgba32_buf, width * height * 4);
-    struct Texture *tex = cur_tex[cur_tmu];
-    tex->addr = addr;
+#ifdef SOFTRAST_RGB565
+
+// picks the 16-bit format that loses the least of a texture's alpha
+static enum TexFormat tex_pick_format(const uint8_t *rgba32_buf, const int num_texels) {
+    enum TexFormat fmt = TEX_RGB565;
+    for (int i = 0; i < num_texels; ++i) {
+        const uint8_t a = rgba32_buf[i * 4 + 3];
+        if (a == 0x00)
+            fmt = TEX_RGBA5551;
+        else if (a != 0xFF)
+            return TEX_RGBA4444;
+    }
+    return fmt;
+}
+
+static void tex_convert(uint16_t *dst, const uint8_t *src, const int num_texels, const enum TexFormat fmt) {
+    for (int i = 0; i < num_texels; ++i, src += 4) {
+        switch (fmt) {
+            case TEX_RGB565:
+                dst[i] = ((src[0] & 0xF8) << 8) | ((src[1] & 0xFC) << 3) | (src[2] >> 3);
+                break;
+            case TEX_RGBA5551:
+                dst[i] = ((src[0] & 0xF8) << 8) | ((src[1] & 0xF8) << 3) | ((src[2] & 0xF8) >> 2) | (src[3] >> 7);
+                break;
+            default:
+                dst[i] = ((src[0] & 0xF0) << 8) | ((src[1] & 0xF0) << 4) | (src[2] & 0xF0) | (src[3] >> 4);
+                break;
+        }
+    }
+}
+
+#endif
+
+static void tex_set_size(struct Texture *tex, const int width, const int height) {
     tex->w = width;
     tex->h = height;
     tex->wrap_w = width - 1;
     tex->wrap_h = height - 1;
+    tex->sample = samplers[tex->fmt][tex->wrap];
+}
+
+static void gfx_soft_upload_texture(const uint8_t *rgba32_buf, int width, int height) {
+    struct Texture *tex = cur_tex[cur_tmu];
+    const int num_texels = width * height;
+    tex_cache_free(tex); // the id is being reused for a different texture
+#ifdef SOFTRAST_RGB565
+    // store textures pre-converted to 16 bits, they only need to be as precise as the framebuffer
+    tex->fmt = tex_pick_format(rgba32_buf, num_texels);
+    tex->addr = tex_cache_alloc(num_texels * 2);
+    tex->size = ALIGN(num_texels * 2, 4);
+    tex_convert((uint16_t *)(texcache + tex->addr), rgba32_buf, num_texels, tex->fmt);
+#else
+    tex->fmt = TEX_RGBA32;
+    tex->addr = tex_cache_alloc(num_texels * 4);
+    tex->size = num_texels * 4;
+    memcpy(texcache + tex->addr, rgba32_buf, num_texels * 4);
+#endif
+    tex_set_size(tex, width, height);
+}
+
+// finds or makes a shared copy of a palette, NULL if every slot is taken
+static struct Tlut *tlut_get(const uint8_t *src, const int num) {
+    struct Tlut *slot = NULL;
+    for (int i = 0; i < MAX_TLUTS; ++i) {
+        struct Tlut *tlut = &tluts[i];
+        if (tlut->num == num && !memcmp(tlut->raw, src, num * 2)) {
+            ++tlut->refs;
+            return tlut;
+        }
+        if (!tlut->refs && (!slot || !tlut->num))
+            slot = tlut;
+    }
+    if (!slot) return NULL;
+
+    if (slot->num)
+        bin_flush(); // binned textures might still point at the old palette in this slot
+    memcpy(slot->raw, src, num * 2);
+    for (int i = 0; i < num; ++i) {
+        const uint32_t c = (src[i * 2] << 8) | src[i * 2 + 1];
+        slot->c[i] = (Color4) {{
+            .r = ((c >> 11) * 0xFF) / 0x1F,
+            .g = (((c >> 6) & 0x1F) * 0xFF) / 0x1F,
+            .b = (((c >> 1) & 0x1F) * 0xFF) / 0x1F,
+            .a = (c & 1) ? 0xFF : 0x00,
+        }};
+    }
+    slot->num = num;
+    slot->refs = 1;
+    return slot;
+}
+
+// stores a texture in its N64 texel format instead of expanding it to RGBA32,
+// returns false for the formats that still have to go through upload_texture()
+static bool gfx_soft_upload_texture_native(const uint8_t *data, int width, int height, uint32_t fmt, uint32_t siz, const uint8_t *tlut) {
+    enum TexFormat tex_fmt;
+    if (fmt == G_IM_FMT_RGBA && siz == G_IM_SIZ_16b) tex_fmt = TEX_RGBA5551;
+    else if (fmt == G_IM_FMT_IA && siz == G_IM_SIZ_4b) tex_fmt = TEX_IA4;
+    else if (fmt == G_IM_FMT_IA && siz == G_IM_SIZ_8b) tex_fmt = TEX_IA8;
+    else if (fmt == G_IM_FMT_IA && siz == G_IM_SIZ_16b) tex_fmt = TEX_IA16;
+    else if (fmt == G_IM_FMT_I && siz == G_IM_SIZ_4b) tex_fmt = TEX_I4;
+    else if (fmt == G_IM_FMT_I && siz == G_IM_SIZ_8b) tex_fmt = TEX_I8;
+    else if (fmt == G_IM_FMT_CI && siz == G_IM_SIZ_4b) tex_fmt = TEX_CI4;
+    else if (fmt == G_IM_FMT_CI && siz == G_IM_SIZ_8b) tex_fmt = TEX_CI8;
+    else return false;
+
+    struct Texture *tex = cur_tex[cur_tmu];
+    const int num_texels = width * height;
+    tex_cache_free(tex); // the id is being reused for a different texture
+
+    struct Tlut *pal = NULL;
+    if (tex_fmt == TEX_CI4 || tex_fmt == TEX_CI8) {
+        pal = tlut_get(tlut, (tex_fmt == TEX_CI4) ? 16 : 256);
+        if (!pal) {
+            // out of palette slots, look the colors up now and keep them as RGBA16
+            const uint32_t size = num_texels * 2;
+            tex->addr = tex_cache_alloc(size);
+            tex->size = ALIGN(size, 4);
+            tex->fmt = TEX_RGBA5551;
+            uint16_t *dst = (uint16_t *)(texcache + tex->addr);
+            for (int i = 0; i < num_texels; ++i) {
+                const uint32_t idx = (tex_fmt == TEX_CI4) ? ((data[i >> 1] >> ((~i & 1) << 2)) & 0xF) : data[i];
+                dst[i] = (tlut[idx * 2] << 8) | tlut[idx * 2 + 1];
+            }
+            tex_set_size(tex, width, height);
+            return true;
+        }
+    }
+
+    const uint32_t size = ((num_texels << siz) + 1) >> 1; // G_IM_SIZ_4b is 0
+    tex->addr = tex_cache_alloc(size);
+    tex->size = ALIGN(size, 4);
+    tex->fmt = tex_fmt;
+    tex->tlut = pal;
+    if (tex_fmt == TEX_RGBA5551) {
+        // kept in native byte order so it can be read as one halfword
+        uint16_t *dst = (uint16_t *)(texcache + tex->addr);
+        for (int i = 0; i < num_texels; ++i)
+            dst[i] = (data[i * 2] << 8) | data[i * 2 + 1];
+    } else {
+        memcpy(texcache + tex->addr, data, size);
+    }
+    tex_set_size(tex, width, height);
+    return true;
+}
+
+static void gfx_soft_delete_texture(uint32_t texture_id) {
+    tex_cache_free(tex_hdr + texture_id);
+}
+
+// whether a texture still has its texels, if not the frontend has to upload it again
+static bool gfx_soft_texture_resident(uint32_t texture_id) {
+    return tex_hdr[texture_id].size != 0;
 }
 
 static inline int gfx_cm_to_local(uint32_t val) {
@@ -847,25 +1682,12 @@ static inline int gfx_cm_to_local(uint32_t val) {
 }
 
 static void gfx_soft_set_sampler_parameters(int tile, bool linear_filter, uint32_t cms, uint32_t cmt) {
-    static const sample_fn_t samplers[] = {
-        tex_sample_nearest_rr, // 0000
-        tex_sample_nearest_rc, // 0001
-        tex_sample_nearest_rm, // 0010
-        NULL,
-        tex_sample_nearest_cr, // 0100
-        tex_sample_nearest_cc, // 0101
-        tex_sample_nearest_cm, // 0110
-        NULL,
-        tex_sample_nearest_mr, // 1000
-        tex_sample_nearest_mc, // 1001
-        tex_sample_nearest_mm, // 1010
-    };
-
     cms = gfx_cm_to_local(cms) << 2;
     cmt = gfx_cm_to_local(cmt);
 
     cur_tex[tile]->filter = linear_filter;
-    cur_tex[tile]->sample = samplers[cms | cmt];
+    cur_tex[tile]->wrap = cms | cmt;
+    cur_tex[tile]->sample = samplers[cur_tex[tile]->fmt][cms | cmt];
 }
 
 static void gfx_soft_set_depth_test(bool depth_test) {
@@ -918,26 +1740,255 @@ static inline void gfx_soft_pick_draw_func(void) {
         draw_pixel_blend_edge,
         draw_pixel_blend_edge_zwrite,
     };
-    draw_fn = draw_funcs[cur_shader->draw_flags | z_write];
+    const uint32_t draw = cur_shader->draw_flags | z_write;
+    draw_fn = draw_funcs[draw];
+    span_fn[0] = cur_shader->spans[draw][z_test][0];
+    span_fn[1] = cur_shader->spans[draw][z_test][1];
+}
+
+/* tile binning */
+
+// triangles are binned into screen tiles over the frame instead of being drawn right away; each tile is
+// then drawn in one go into tile_color and tile_depth, which stay in the data cache unlike the full screen
+
+static void *bin_grow(void *buf, uint32_t *cap, const uint32_t need, const size_t elem_size) {
+    if (need <= *cap) return buf;
+    uint32_t new_cap = *cap ? *cap : 256;
+    while (new_cap < need) new_cap <<= 1;
+    buf = realloc(buf, new_cap * elem_size);
+    if (!buf) {
+        printf("gfx_soft: could not alloc %u bytes for binning\n", (uint32_t)(new_cap * elem_size));
+        abort();
+    }
+    *cap = new_cap;
+    return buf;
+}
+
+static inline void set_render_target_screen(void) {
+    r_color = gfx_output;
+    r_depth = z_buffer;
+    r_pitch = scr_width;
+    r_base = scr_width * (scr_height - 1);
+}
+
+static inline void set_render_target_tile(const struct ClipRect *tile) {
+    r_color = tile_color;
+    r_depth = tile_depth;
+    r_pitch = BIN_TILE_SIZE;
+    r_base = (tile->y0 + BIN_TILE_SIZE - 1) * BIN_TILE_SIZE - tile->x0;
+}
+
+static inline void bin_tile_load(const struct ClipRect *tile) {
+    const int w = tile->x1 - tile->x0;
+    depth_prepare_rect(tile->x0, tile->y0, tile->x1, tile->y1);
+    for (int y = tile->y0; y < tile->y1; ++y) {
+        const int src = scr_width * (scr_height - y - 1) + tile->x0;
+        const int dst = r_base - y * BIN_TILE_SIZE + tile->x0;
+        memcpy(tile_color + dst, gfx_output + src, w * sizeof(*tile_color));
+        memcpy(tile_depth + dst, z_buffer + src, w * sizeof(*tile_depth));
+    }
+}
+
+static inline void bin_tile_store(const struct ClipRect *tile) {
+    const int w = tile->x1 - tile->x0;
+    for (int y = tile->y0; y < tile->y1; ++y) {
+        const int src = r_base - y * BIN_TILE_SIZE + tile->x0;
+        const int dst = scr_width * (scr_height - y - 1) + tile->x0;
+        memcpy(gfx_output + dst, tile_color + src, w * sizeof(*tile_color));
+        memcpy(z_buffer + dst, tile_depth + src, w * sizeof(*tile_depth));
+    }
+}
+
+static uint32_t bin_push_state(void) {
+    struct BinState st;
+    memset(&st, 0, sizeof(st)); // padding too, so states can be compared
+    st.shader = cur_shader;
+    if (cur_tex[0]) st.tex[0] = *cur_tex[0];
+    if (cur_tex[1]) st.tex[1] = *cur_tex[1];
+    st.clip = r_clip;
+    st.z_offset = z_offset;
+    st.fog_color = fog_color;
+    st.z_test = z_test;
+    st.z_write = z_write;
+
+    // consecutive batches often share everything
+    if (bin_state_num && !memcmp(&bin_state[bin_state_num - 1], &st, sizeof(st)))
+        return bin_state_num - 1;
+
+    bin_state = bin_grow(bin_state, &bin_state_cap, bin_state_num + 1, sizeof(*bin_state));
+    memcpy(&bin_state[bin_state_num], &st, sizeof(st));
+    return bin_state_num++;
+}
+
+// drops the triangle into every tile its bounding box touches, tri has to point into bin_vtx
+static inline void bin_triangle(const struct Tri tri, const uint32_t state) {
+    // the rasterizer does the exact clipping, this only has to find the tiles a triangle might touch
+    const int clip_x0 = imax(0, r_clip.x0);
+    const int clip_y0 = imax(0, r_clip.y0);
+    const int clip_x1 = imin(scr_width, r_clip.x1) - 1;
+    const int clip_y1 = imin(scr_height, r_clip.y1) - 1;
+
+    const int x0 = imax(clip_x0, FIX_2_INT(fix_min(tri.v0[0], fix_min(tri.v1[0], tri.v2[0]))));
+    const int x1 = imin(clip_x1, FIX_2_INT(fix_max(tri.v0[0], fix_max(tri.v1[0], tri.v2[0]))));
+    const int y0 = imax(clip_y0, FIX_2_INT(tri.v0[1]));
+    const int y1 = imin(clip_y1, FIX_2_INT(tri.v2[1]));
+    if (x0 > x1 || y0 > y1) return;
+
+    struct BinTri *bt = &bin_tri[bin_tri_num];
+    bt->v[0] = tri.v0 - bin_vtx;
+    bt->v[1] = tri.v1 - bin_vtx;
+    bt->v[2] = tri.v2 - bin_vtx;
+    bt->state = state;
+
+    for (int ty = y0 >> BIN_TILE_SHIFT; ty <= y1 >> BIN_TILE_SHIFT; ++ty) {
+        for (int tx = x0 >> BIN_TILE_SHIFT; tx <= x1 >> BIN_TILE_SHIFT; ++tx) {
+            struct Bin *bin = &bins[ty * bins_w + tx];
+            bin->tris = bin_grow(bin->tris, &bin->cap, bin->num + 1, sizeof(*bin->tris));
+            bin->tris[bin->num++] = bin_tri_num;
+        }
+    }
+
+    ++bin_tri_num;
+}
+
+static void bin_triangles(const fix64 *buf, const size_t stride, const size_t num_tris) {
+    const uint32_t state = bin_push_state();
+    const uint32_t num_vtx = 3 * stride * num_tris;
+
+    bin_vtx = bin_grow(bin_vtx, &bin_vtx_cap, bin_vtx_num + num_vtx, sizeof(*bin_vtx));
+    bin_tri = bin_grow(bin_tri, &bin_tri_cap, bin_tri_num + num_tris, sizeof(*bin_tri));
+
+    fix64 *vtx = bin_vtx + bin_vtx_num;
+    memcpy(vtx, buf, num_vtx * sizeof(*bin_vtx));
+    bin_vtx_num += num_vtx;
+
+    for (size_t i = 0; i < num_tris; ++i, vtx += 3 * stride)
+        bin_triangle(setup_triangle(vtx, stride), state);
+}
+
+// same as above, but every vertex is stored and transformed once no matter how many triangles share it
+static void bin_triangles_indexed(const fix64 *buf, const size_t stride, const size_t num_verts, const uint16_t *indices, const size_t num_tris) {
+    const uint32_t state = bin_push_state();
+    const uint32_t num_vtx = stride * num_verts;
+
+    bin_vtx = bin_grow(bin_vtx, &bin_vtx_cap, bin_vtx_num + num_vtx, sizeof(*bin_vtx));
+    bin_tri = bin_grow(bin_tri, &bin_tri_cap, bin_tri_num + num_tris, sizeof(*bin_tri));
+
+    fix64 *vtx = bin_vtx + bin_vtx_num;
+    memcpy(vtx, buf, num_vtx * sizeof(*bin_vtx));
+    bin_vtx_num += num_vtx;
+
+    for (size_t i = 0; i < num_vtx; i += stride)
+        viewport_transform((Vector4 *)(vtx + i));
+
+    for (size_t i = 0; i < 3 * num_tris; i += 3)
+        bin_triangle(sort_triangle(vtx + indices[i] * stride, vtx + indices[i + 1] * stride, vtx + indices[i + 2] * stride), state);
+}
+
+// draws everything binned so far, must be done before anything else touches the screen
+static void bin_flush(void) {
+    if (!bin_tri_num) return;
+
+    // the binned states are applied as the tiles are drawn, put the current one back afterwards
+    struct ShaderProgram * const old_shader = cur_shader;
+    struct Texture * const old_tex[2] = { cur_tex[0], cur_tex[1] };
+    const struct ClipRect old_clip = r_clip;
+    const fix64 old_z_offset = z_offset;
+    const Color4 old_fog_color = fog_color;
+    const bool old_z_test = z_test;
+    const bool old_z_write = z_write;
+
+    for (int ty = 0; ty < bins_h; ++ty) {
+        for (int tx = 0; tx < bins_w; ++tx) {
+            struct Bin *bin = &bins[ty * bins_w + tx];
+            if (!bin->num) continue;
+
+            const struct ClipRect tile = {
+                tx << BIN_TILE_SHIFT,
+                ty << BIN_TILE_SHIFT,
+                imin(scr_width, (tx + 1) << BIN_TILE_SHIFT),
+                imin(scr_height, (ty + 1) << BIN_TILE_SHIFT),
+            };
+            set_render_target_tile(&tile);
+            bin_tile_load(&tile);
+
+            uint32_t last_state = UINT32_MAX;
+            for (uint32_t i = 0; i < bin->num; ++i) {
+                const struct BinTri *bt = &bin_tri[bin->tris[i]];
+                if (bt->state != last_state) {
+                    struct BinState *st = &bin_state[bt->state];
+                    last_state = bt->state;
+                    cur_shader = st->shader;
+                    cur_tex[0] = &st->tex[0];
+                    cur_tex[1] = &st->tex[1];
+                    z_offset = st->z_offset;
+                    fog_color = st->fog_color;
+                    z_test = st->z_test;
+                    z_write = st->z_write;
+                    r_clip.x0 = imax(st->clip.x0, tile.x0);
+                    r_clip.y0 = imax(st->clip.y0, tile.y0);
+                    r_clip.x1 = imin(st->clip.x1, tile.x1);
+                    r_clip.y1 = imin(st->clip.y1, tile.y1);
+                    gfx_soft_pick_draw_func();
+                }
+                rast_triangle((struct Tri) { bin_vtx + bt->v[0], bin_vtx + bt->v[1], bin_vtx + bt->v[2] });
+            }
+
+            bin_tile_store(&tile);
+            bin->num = 0;
+        }
+    }
+
+    set_render_target_screen();
+    cur_shader = old_shader;
+    cur_tex[0] = old_tex[0];
+    cur_tex[1] = old_tex[1];
+    r_clip = old_clip;
+    z_offset = old_z_offset;
+    fog_color = old_fog_color;
+    z_test = old_z_test;
+    z_write = old_z_write;
+
+    bin_vtx_num = 0;
+    bin_tri_num = 0;
+    bin_state_num = 0;
 }
 
 static void gfx_soft_draw_triangles(fix64 buf_vbo[], size_t buf_vbo_len, size_t buf_vbo_num_tris) {
-    gfx_soft_pick_draw_func();
     const size_t num_verts = 3 * buf_vbo_num_tris;
     const size_t stride = buf_vbo_len / num_verts; //how many props per vertex
+    if (configTileBinning) {
+        bin_triangles(buf_vbo, stride, buf_vbo_num_tris);
+        return;
+    }
+    gfx_soft_pick_draw_func();
     for (size_t i = 0; i < num_verts * stride; i += 3 * stride)
         pop_triangle(buf_vbo + i, stride);
 }
 
+static void gfx_soft_draw_triangles_indexed(fix64 buf_vbo[], size_t buf_vbo_len, size_t buf_vbo_num_verts, const uint16_t indices[], size_t num_tris) {
+    const size_t stride = buf_vbo_len / buf_vbo_num_verts; //how many props per vertex
+    if (configTileBinning) {
+        bin_triangles_indexed(buf_vbo, stride, buf_vbo_num_verts, indices, num_tris);
+        return;
+    }
+    gfx_soft_pick_draw_func();
+    for (size_t i = 0; i < buf_vbo_len; i += stride)
+        viewport_transform((Vector4 *)(buf_vbo + i));
+    for (size_t i = 0; i < 3 * num_tris; i += 3)
+        rast_triangle(sort_triangle(buf_vbo + indices[i] * stride, buf_vbo + indices[i + 1] * stride, buf_vbo + indices[i + 2] * stride));
+}
+
 static void gfx_soft_fill_rect(int x0, int y0, int x1, int y1, const uint8_t *rgba) {
+    bin_flush();
     // HACK: these are mainly used just to clear the screen and draw simple rects, so we ignore drawmode stuff and Z
     x0 = imax(0, x0);
     y0 = imax(0, y0);
     x1 = imin(scr_width, x1);
     y1 = imin(scr_height, y1);
-    register const uint32_t color = *(uint32_t *)rgba;
-    register uint32_t *base = gfx_output + y0 * scr_width + x0;
-    register uint32_t *p;
+    register const gfx_pixel_t color = rgba_to_pixel((Color4) { .c = *(uint32_t *)rgba });
+    register gfx_pixel_t *base = gfx_output + y0 * scr_width + x0;
+    register gfx_pixel_t *p;
     register int x, y;
     for (y = y0; y < y1; ++y, base += scr_width) {
         p = base;
@@ -946,31 +1997,39 @@ static void gfx_soft_fill_rect(int x0, int y0, int x1, int y1, const uint8_t *rg
     }
 }
 
-static inline void gfx_soft_tex_rect_replace(int x0, int y0, int x1, int y1, const float u0, const float v0, const float dudx, const float dvdy) {
+// u/v step in fix32 and a texel is only sampled again once the step crosses into the next one, so magnified
+// rects (the skybox tiles are drawn at 5x) sample each texel once per row; when nothing is blended or
+// depth-written, rows that fall on the same texel row as the one above are copied instead
+static inline void gfx_soft_tex_rect_draw(int x0, int y0, int x1, int y1, const fix32 u0, const fix32 v0, const fix32 dudx, const fix32 dvdy, const bool modulate, const Color4 rgba) {
+    const struct Texture * const tex = cur_tex[0];
+    const bool copy_rows = (draw_fn == draw_pixel);
     register int base = y0 * scr_width + x0;
     register int idx;
     register int x, y;
-    float u;
-    float v = v0;
-    for (y = y0; y < y1; ++y, base += scr_width, v += dvdy) {
-        idx = base;
-        u = u0;
-        for (x = x0; x < x1; ++x, ++idx, u += dudx)
-            draw_fn(idx, 0, cur_tex[0]->sample(cur_tex[0], u, v));
-    }
-}
-
-static inline void gfx_soft_tex_rect_modulate(int x0, int y0, int x1, int y1, const float u0, const float v0, const float dudx, const float dvdy, const Color4 rgba) {
-    register int base = y0 * scr_width + x0;
-    register int idx;
-    register int x, y;
-    float u;
-    float v = v0;
+    register fix32 u;
+    fix32 v = v0;
+    int tx, ty, last_tx, last_ty = INT_MIN;
+    Color4 c = { .c = 0 };
     for (y = y0; y < y1; ++y, base += scr_width, v += dvdy) {
+        ty = FIX32_2_INT(v);
+        if (copy_rows && ty == last_ty) {
+            memcpy(r_color + base, r_color + base - scr_width, (x1 - x0) * sizeof(*r_color));
+            continue;
+        }
+        last_ty = ty;
+        last_tx = INT_MIN;
         idx = base;
         u = u0;
-        for (x = x0; x < x1; ++x, ++idx, u += dudx)
-            draw_fn(idx, 0, rgba_modulate(cur_tex[0]->sample(cur_tex[0], u, v), rgba));
+        for (x = x0; x < x1; ++x, ++idx, u += dudx) {
+            tx = FIX32_2_INT(u);
+            if (tx != last_tx) {
+                last_tx = tx;
+                c = tex->sample(tex, tx, ty);
+                if (modulate)
+                    c = rgba_modulate(c, rgba);
+            }
+            draw_fn(idx, 0, c);
+        }
     }
 }
 
@@ -979,11 +2038,20 @@ static void gfx_soft_tex_rect(int x0, int y0, int x1, int y1, const float u0, co
     y0 = imax(0, y0);
     x1 = imin(scr_width, x1);
     y1 = imin(scr_height, y1);
+    bin_flush();
     gfx_soft_pick_draw_func();
+    if (z_write) // rect rows count from the start of the buffer, triangle rows from its end
+        depth_prepare_rect(x0, scr_height - y1, x1, scr_height - y0);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+    const fix32 u0_fix = u0 * FIX32_ONE;
+    const fix32 v0_fix = v0 * FIX32_ONE;
+    const fix32 dudx_fix = dudx * FIX32_ONE;
+    const fix32 dvdy_fix = dvdy * FIX32_ONE;
     if (cur_shader->cc.num_inputs)
-        gfx_soft_tex_rect_modulate(x0, y0, x1, y1, u0, v0, dudx, dvdy, *(Color4 *)rgba);
+        gfx_soft_tex_rect_draw(x0, y0, x1, y1, u0_fix, v0_fix, dudx_fix, dvdy_fix, true, *(Color4 *)rgba);
     else
-        gfx_soft_tex_rect_replace(x0, y0, x1, y1, u0, v0, dudx, dvdy);
+        gfx_soft_tex_rect_draw(x0, y0, x1, y1, u0_fix, v0_fix, dudx_fix, dvdy_fix, false, (Color4) { .c = 0 });
 }
 
 static void gfx_soft_prepare_tables(void) {
@@ -997,11 +2065,16 @@ static void gfx_soft_prepare_tables(void) {
     for (int x = 0; x < 0x100; ++x)
         for (int y = 0; y < 0x100; ++y)
             mult_tab[x][y] = (x * y) >> 8;
+
+    for (int n = 1; n <= R32_SUBDIV_MAX; ++n)
+        recip_tab[n] = 0x10000 / n;
 }
 
 static void gfx_soft_set_resolution(const int width, const int height) {
     if (z_buffer) free(z_buffer);
-    if (gfx_output) free(gfx_output);
+    if (hiz) free(hiz);
+    if (z_stale) free(z_stale);
+    if (scr_output) free(scr_output);
 
     scr_width = width;
     scr_height = height;
@@ -1013,21 +2086,51 @@ static void gfx_soft_set_resolution(const int width, const int height) {
         abort();
     }
 
-    gfx_output = calloc(scr_width * scr_height, sizeof(uint32_t));
+    hiz_w = (scr_width + HIZ_SIZE - 1) >> HIZ_SHIFT;
+    hiz_h = (scr_height + HIZ_SIZE - 1) >> HIZ_SHIFT;
+    hiz = malloc(hiz_w * hiz_h * sizeof(*hiz));
+    z_stale = malloc(hiz_w * hiz_h);
+    if (!hiz || !z_stale) {
+        printf("gfx_soft: could not alloc coarse depth for %dx%d\n", scr_width, scr_height);
+        abort();
+    }
+
+    scr_output = calloc(scr_width * scr_height, sizeof(gfx_pixel_t));
+    gfx_output = scr_output;
     if (!gfx_output) {
         printf("gfx_soft: could not alloc color buffer for %dx%d\n", scr_width, scr_height);
         abort();
     }
 
+    if (bins) {
+        for (int i = 0; i < bins_w * bins_h; ++i)
+            free(bins[i].tris);
+        free(bins);
+    }
+
+    bins_w = (scr_width + BIN_TILE_SIZE - 1) >> BIN_TILE_SHIFT;
+    bins_h = (scr_height + BIN_TILE_SIZE - 1) >> BIN_TILE_SHIFT;
+    bins = calloc(bins_w * bins_h, sizeof(struct Bin));
+    if (!bins) {
+        printf("gfx_soft: could not alloc %dx%d tile bins\n", bins_w, bins_h);
+        abort();
+    }
+    bin_vtx_num = 0;
+    bin_tri_num = 0;
+    bin_state_num = 0;
+
+    set_render_target_screen();
+
     depth_clear();
 }
 
 static void gfx_soft_init(void) {
-    texcache = calloc(1, TEXCACHE_STEP); // this will be realloc'd as needed
-    texcache_size = TEXCACHE_STEP;
+    texcache_size = configTextureBudget * 1024;
+    texcache = malloc(texcache_size);
     texcache_addr = 0;
+    texcache_used = 0;
     if (!texcache) {
-        printf("gfx_soft: could not alloc %u bytes for texture cache\n", TEXCACHE_STEP);
+        printf("gfx_soft: could not alloc %u bytes for texture cache\n", texcache_size);
         abort();
     }
 
@@ -1038,28 +2141,46 @@ static void gfx_soft_init(void) {
 
     gfx_soft_prepare_tables();
 
+    persp_subdiv = imin(configPerspSubdiv, R32_SUBDIV_MAX);
+
     gfx_soft_set_resolution(gfx_current_dimensions.width, gfx_current_dimensions.height);
 }
 
 static void gfx_soft_start_frame(void) {
+    ++tex_frame;
     // depth_swap(); // FIXME: ztrick
     depth_clear();
 }
 
 static void gfx_soft_shutdown(void) {
     free(z_buffer);
+    free(hiz);
+    free(z_stale);
     free(texcache);
+    for (int i = 0; i < bins_w * bins_h; ++i)
+        free(bins[i].tris);
+    free(bins);
+    free(bin_vtx);
+    free(bin_tri);
+    free(bin_state);
 }
 
 static void gfx_soft_on_resize(void) {
 }
 
 static void gfx_soft_end_frame(void) {
+    bin_flush();
 }
 
 static void gfx_soft_finish_render(void) {
 }
 
+// draw straight into a framebuffer of the current resolution, or back into our own one if buf is NULL
+void gfx_soft_set_output(gfx_pixel_t *buf) {
+    gfx_output = buf ? buf : scr_output;
+    set_render_target_screen();
+}
+
 struct GfxRenderingAPI gfx_soft_api = {
     gfx_soft_z_is_from_0_to_1,
     gfx_soft_unload_shader,
@@ -1070,6 +2191,7 @@ struct GfxRenderingAPI gfx_soft_api = {
     gfx_soft_new_texture,
     gfx_soft_select_texture,
     gfx_soft_upload_texture,
+    gfx_soft_upload_texture_native,
     gfx_soft_set_sampler_parameters,
     gfx_soft_set_depth_test,
     gfx_soft_set_depth_mask,
@@ -1078,6 +2200,7 @@ struct GfxRenderingAPI gfx_soft_api = {
     gfx_soft_set_scissor,
     gfx_soft_set_use_alpha,
     gfx_soft_draw_triangles,
+    gfx_soft_draw_triangles_indexed,
     gfx_soft_init,
     gfx_soft_on_resize,
     gfx_soft_start_frame,
@@ -1086,6 +2209,8 @@ struct GfxRenderingAPI gfx_soft_api = {
     gfx_soft_fill_rect,
     gfx_soft_tex_rect,
     gfx_soft_set_fog_color,
+    gfx_soft_delete_texture,
+    gfx_soft_texture_resident,
     gfx_soft_shutdown,
 };
 
@@ -4,6 +4,14 @@
 #include "gfx_rendering_api.h"
 
 extern struct GfxRenderingAPI gfx_soft_api;
-extern uint32_t *gfx_output;
+#ifdef SOFTRAST_RGB565
+typedef uint16_t gfx_pixel_t; // rrrrrggg gggbbbbb, what the LCD takes
+#else
+typedef uint32_t gfx_pixel_t; // aaaaaaaa bbbbbbbb gggggggg rrrrrrrr
+#endif
+
+extern gfx_pixel_t *gfx_output;
+
+void gfx_soft_set_output(gfx_pixel_t *buf);
 
 #endif
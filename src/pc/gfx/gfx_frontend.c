@@ -1,5 +1,6 @@
 #include <math.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
@@ -38,6 +39,13 @@
 #define MAX_BUFFERED 256
 #define MAX_LIGHTS 2
 #define MAX_VERTICES 64
+// Only vertices further than this many times w off to a side get clipped against it, the rasterizer
+// scissors the rest. Keeps screen coordinates well within the 16.16 range of the fast rasterizer.
+#define GUARD_BAND 8
+// memory for recorded display lists, the least recently used ones are freed to make room for new ones
+#define DL_CACHE_BUDGET (4 * 1024 * 1024)
+// frontend only: G_VTX of a recorded display list, w1 points to its CachedVertices
+#define G_VTX_CACHED 0x0f
 
 // don't put in fog color
 #define GFX_NO_FOG_COLOR 1
@@ -70,12 +78,15 @@ struct LoadedVertex {
     fix64 u, v;
     struct RGBA color;
     uint8_t clip_rej;
+    uint8_t clip_guard; // same as clip_rej, but with the x/y planes moved out to the guard band
 };
 
 struct TextureHashmapNode {
     struct TextureHashmapNode *next;
+    struct TextureHashmapNode *lru_prev, *lru_next; // most recently used first
 
     const uint8_t *texture_addr;
+    const uint8_t *tlut_addr; // palette of CI textures, NULL for the rest
     uint8_t fmt, siz;
 
     uint32_t texture_id;
@@ -86,6 +97,7 @@ static struct {
     struct TextureHashmapNode *hashmap[1024];
     struct TextureHashmapNode pool[512];
     uint32_t pool_pos;
+    struct TextureHashmapNode *lru_head, *lru_tail;
 } gfx_texture_cache;
 
 struct ColorCombiner {
@@ -94,6 +106,54 @@ struct ColorCombiner {
     uint8_t shader_input_mapping[2][4];
 };
 
+// Position after the perspective divide
+struct ProjectedVertex {
+    fix64 x, y; // NDC
+    fix64 w_inv;
+};
+
+// Everything besides the vertex itself that goes into its buf_vbo attributes
+struct VertexFormat {
+    const struct ColorCombiner *comb;
+    struct RGBA prim_color, env_color;
+    uint16_t uls, ult, tex_width, tex_height;
+    uint8_t num_inputs;
+    bool use_texture, use_fog, use_alpha, linear_filter;
+};
+
+// Everything a transformed vertex depends on besides the vertex itself. Fields that the vertex loop
+// picked by mode doesn't read are left zero, so keys compare with memcmp.
+struct VertexKey {
+    fix64 mp[4][4];
+    int32_t lights_coeffs[MAX_LIGHTS][3];
+    int32_t lookat_coeffs[2][3];
+    uint8_t light_colors[MAX_LIGHTS + 1][3];
+    uint8_t num_lights;
+    uint8_t mode; // lit, texgen, fog
+    int16_t fog_mul, fog_offset;
+    uint16_t s, t;
+};
+
+// A G_VTX of a recorded display list: a copy of its vertices and the result of their last transform
+struct CachedVertices {
+    struct VertexKey key;
+    bool valid;
+    uint8_t n_vertices, dest_index;
+    const Vtx *vertices;
+    struct LoadedVertex *out;
+};
+
+// Static display lists by address (see G_TAG_STATIC_DL), recorded the first time they are called.
+// The commands of the lists they call and branch to are copied in line and the syncs are dropped.
+struct CachedDisplayList {
+    struct CachedDisplayList *next;
+    struct CachedDisplayList *lru_prev, *lru_next; // most recently used first
+    const Gfx *addr;
+    Gfx *cmds; // NULL if it didn't fit in the budget, the original list is run instead
+    size_t size; // bytes of the recording cmds points to
+    uint32_t last_use; // frame it was last run in
+};
+
 static struct ColorCombiner color_combiner_pool[64];
 static uint8_t color_combiner_pool_size;
 
@@ -103,10 +163,14 @@ static struct RSP {
 
     fix64 MP_matrix[4][4];
     fix64 P_matrix[4][4];
+    int32_t MP_matrix32[3][4]; // upper rows of MP_matrix, shifted right by MP_shift
+    uint8_t MP_shift;
 
     Light_t current_lights[MAX_LIGHTS + 1];
     fix64 current_lights_coeffs[MAX_LIGHTS][3];
     fix64 current_lookat_coeffs[2][3]; // lookat_x, lookat_y
+    int32_t lights_coeffs32[MAX_LIGHTS][3]; // Q30, divided by 127
+    int32_t lookat_coeffs32[2][3];
     uint8_t current_num_lights; // includes ambient light
     bool lights_changed;
 
@@ -171,20 +235,220 @@ static bool dropped_frame;
 
 static fix64 buf_vbo[MAX_BUFFERED * (26 * 3)]; // 3 vertices in a triangle and 26 floats per vtx
 static size_t buf_vbo_len;
+static size_t buf_vbo_num_verts;
 static size_t buf_vbo_num_tris;
+static uint16_t buf_idx[MAX_BUFFERED * 3];
+
+// Post-transform cache: where each G_VTX slot was last emitted into buf_vbo. An entry is only valid
+// while its epoch matches, the epoch moves on with every flush and vertex format change.
+// The projected position doesn't depend on the format and stays valid until the slot is reloaded.
+static struct {
+    uint32_t epoch;
+    uint16_t idx;
+    bool projected;
+    struct ProjectedVertex pos;
+} vtx_cache[MAX_VERTICES];
+static uint32_t vtx_cache_epoch = 1;
+static struct VertexFormat vtx_cache_fmt;
+static bool vtx_cache_enabled; // backend takes indexed triangles
+
+static struct {
+    struct CachedDisplayList *hashmap[512];
+    struct CachedDisplayList *lru_head, *lru_tail;
+    size_t size_bytes;
+    uint32_t frame;
+    bool static_next; // the next G_DL calls a static display list
+} dl_cache;
 
 static struct GfxWindowManagerAPI *gfx_wapi;
 static struct GfxRenderingAPI *gfx_rapi;
 
+// Backend state a batch is drawn with
+struct DrawState {
+    struct ShaderProgram *shader_program;
+    uint32_t texture_ids[2];
+    bool has_texture[2];
+    struct XYWidthHeight viewport, scissor;
+    bool depth_test, depth_mask, decal_mode, alpha_blend;
+};
+
+// Deferred mode: while an opaque render layer is open, flushed batches are kept as packets and only
+// drawn, sorted by shader and texture, when the layer ends. With the coarse depth buffer they are drawn
+// nearest first instead. Sampler parameters and texture uploads can't be recorded, so those draw the
+// pending packets first.
+struct DrawPacket {
+    struct DrawState st;
+    uint32_t vbo_ofs, vbo_len, num_verts;
+    uint32_t idx_ofs, num_tris;
+    fix64 depth; // nearest depth of the batch
+    uint32_t seq; // keeps the sort stable
+};
+
+static struct {
+    bool active; // the current layer is being deferred
+    struct DrawPacket *packets;
+    uint32_t num_packets, cap_packets;
+    fix64 *vbo;
+    uint32_t vbo_len, cap_vbo;
+    uint16_t *idx;
+    uint32_t idx_len, cap_idx;
+} deferred;
+
+// The last fill rect isn't drawn until something else is: one that covers it replaces it, and a background
+// (G_TAG_BACKGROUND) whose scissor covers it makes it unnecessary. Mostly saves the frame clear.
+static struct {
+    bool pending;
+    int x0, y0, x1, y1;
+    struct RGBA color;
+} pending_fill;
+
+static void gfx_draw_pending_fill(void) {
+    if (pending_fill.pending) {
+        pending_fill.pending = false;
+        gfx_rapi->fill_rect(pending_fill.x0, pending_fill.y0, pending_fill.x1, pending_fill.y1, &pending_fill.color.r);
+    }
+}
+
+static void *gfx_grow(void *buf, uint32_t *cap, const uint32_t need, const size_t elem_size) {
+    if (need <= *cap) return buf;
+    uint32_t new_cap = *cap ? *cap : 256;
+    while (new_cap < need) new_cap <<= 1;
+    buf = realloc(buf, new_cap * elem_size);
+    if (!buf) {
+        printf("gfx: could not alloc %u bytes for deferred packets\n", (uint32_t)(new_cap * elem_size));
+        abort();
+    }
+    *cap = new_cap;
+    return buf;
+}
+
+static inline struct DrawState gfx_current_draw_state(void) {
+    struct DrawState st;
+    memset(&st, 0, sizeof(st));
+    st.shader_program = rendering_state.shader_program;
+    for (int i = 0; i < 2; i++) {
+        if (rendering_state.textures[i] != NULL) {
+            st.texture_ids[i] = rendering_state.textures[i]->texture_id;
+            st.has_texture[i] = true;
+        }
+    }
+    st.viewport = rendering_state.viewport;
+    st.scissor = rendering_state.scissor;
+    st.depth_test = rendering_state.depth_test;
+    st.depth_mask = rendering_state.depth_mask;
+    st.decal_mode = rendering_state.decal_mode;
+    st.alpha_blend = rendering_state.alpha_blend;
+    return st;
+}
+
+// sets what differs from prev, or everything without prev
+static void gfx_apply_draw_state(const struct DrawState *st, const struct DrawState *prev) {
+    if (!prev || st->shader_program != prev->shader_program) {
+        gfx_rapi->unload_shader(prev ? prev->shader_program : NULL);
+        gfx_rapi->load_shader(st->shader_program);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (st->has_texture[i] && (!prev || st->texture_ids[i] != prev->texture_ids[i] || !prev->has_texture[i])) {
+            gfx_rapi->select_texture(i, st->texture_ids[i]);
+        }
+    }
+    if (!prev || memcmp(&st->viewport, &prev->viewport, sizeof(st->viewport)) != 0) {
+        gfx_rapi->set_viewport(st->viewport.x, st->viewport.y, st->viewport.width, st->viewport.height);
+    }
+    if (!prev || memcmp(&st->scissor, &prev->scissor, sizeof(st->scissor)) != 0) {
+        gfx_rapi->set_scissor(st->scissor.x, st->scissor.y, st->scissor.width, st->scissor.height);
+    }
+    if (!prev || st->depth_test != prev->depth_test) gfx_rapi->set_depth_test(st->depth_test);
+    if (!prev || st->depth_mask != prev->depth_mask) gfx_rapi->set_depth_mask(st->depth_mask);
+    if (!prev || st->decal_mode != prev->decal_mode) gfx_rapi->set_zmode_decal(st->decal_mode);
+    if (!prev || st->alpha_blend != prev->alpha_blend) gfx_rapi->set_use_alpha(st->alpha_blend);
+}
+
+static inline void gfx_draw_batch(fix64 *vbo, size_t vbo_len, size_t num_verts, const uint16_t *idx, size_t num_tris) {
+    uint64_t t0 = tmr_ms();
+    gfx_draw_pending_fill();
+    if (vtx_cache_enabled) {
+        gfx_rapi->draw_triangles_indexed(vbo, vbo_len, num_verts, idx, num_tris);
+    } else {
+        // every vertex was emitted in triangle order
+        gfx_rapi->draw_triangles(vbo, vbo_len, num_tris);
+    }
+    tFlushing += tmr_ms() - t0;
+}
+
+static int gfx_packet_cmp(const void *a, const void *b) {
+    const struct DrawPacket *pa = a, *pb = b;
+    if (configHiZ && pa->depth != pb->depth) return pa->depth < pb->depth ? -1 : 1;
+    if (pa->st.shader_program != pb->st.shader_program) return (uintptr_t)pa->st.shader_program < (uintptr_t)pb->st.shader_program ? -1 : 1;
+    if (pa->st.texture_ids[0] != pb->st.texture_ids[0]) return pa->st.texture_ids[0] < pb->st.texture_ids[0] ? -1 : 1;
+    if (pa->st.texture_ids[1] != pb->st.texture_ids[1]) return pa->st.texture_ids[1] < pb->st.texture_ids[1] ? -1 : 1;
+    return pa->seq < pb->seq ? -1 : 1;
+}
+
+// draws the deferred packets and leaves the backend in the frontend's current state
+static void gfx_flush_packets(void) {
+    if (!deferred.num_packets) return;
+
+    qsort(deferred.packets, deferred.num_packets, sizeof(*deferred.packets), gfx_packet_cmp);
+
+    // the frontend kept setting the backend state while recording, so nothing about it is known
+    const struct DrawState *prev = NULL;
+    for (uint32_t i = 0; i < deferred.num_packets; i++) {
+        struct DrawPacket *p = &deferred.packets[i];
+        gfx_apply_draw_state(&p->st, prev);
+        gfx_draw_batch(deferred.vbo + p->vbo_ofs, p->vbo_len, p->num_verts, deferred.idx + p->idx_ofs, p->num_tris);
+        prev = &p->st;
+    }
+    const struct DrawState cur = gfx_current_draw_state();
+    gfx_apply_draw_state(&cur, prev);
+    numPackets += deferred.num_packets;
+
+    deferred.num_packets = 0;
+    deferred.vbo_len = 0;
+    deferred.idx_len = 0;
+}
+
+static void gfx_defer_batch(void) {
+    deferred.packets = gfx_grow(deferred.packets, &deferred.cap_packets, deferred.num_packets + 1, sizeof(*deferred.packets));
+    deferred.vbo = gfx_grow(deferred.vbo, &deferred.cap_vbo, deferred.vbo_len + buf_vbo_len, sizeof(*deferred.vbo));
+    deferred.idx = gfx_grow(deferred.idx, &deferred.cap_idx, deferred.idx_len + buf_vbo_num_tris * 3, sizeof(*deferred.idx));
+
+    struct DrawPacket *p = &deferred.packets[deferred.num_packets];
+    p->st = gfx_current_draw_state();
+    p->vbo_ofs = deferred.vbo_len;
+    p->vbo_len = buf_vbo_len;
+    p->num_verts = buf_vbo_num_verts;
+    p->idx_ofs = deferred.idx_len;
+    p->num_tris = buf_vbo_num_tris;
+    p->seq = deferred.num_packets++;
+    p->depth = FIX_ONE;
+    if (configHiZ) {
+        const size_t stride = buf_vbo_len / buf_vbo_num_verts;
+        for (size_t i = 2; i < buf_vbo_len; i += stride) {
+            if (buf_vbo[i] < p->depth) p->depth = buf_vbo[i];
+        }
+    }
+
+    memcpy(deferred.vbo + deferred.vbo_len, buf_vbo, buf_vbo_len * sizeof(*buf_vbo));
+    memcpy(deferred.idx + deferred.idx_len, buf_idx, buf_vbo_num_tris * 3 * sizeof(*buf_idx));
+    deferred.vbo_len += buf_vbo_len;
+    deferred.idx_len += buf_vbo_num_tris * 3;
+}
+
 static void gfx_flush(void) {
     if (buf_vbo_len > 0) {
-        uint64_t t0 = tmr_ms();
-        gfx_rapi->draw_triangles(buf_vbo, buf_vbo_len, buf_vbo_num_tris);
-        tFlushing += tmr_ms() - t0;
+        if (deferred.active) {
+            gfx_defer_batch();
+        } else {
+            gfx_draw_batch(buf_vbo, buf_vbo_len, buf_vbo_num_verts, buf_idx, buf_vbo_num_tris);
+        }
         numTris += buf_vbo_num_tris;
+        numVerts += buf_vbo_num_verts;
 
         buf_vbo_len = 0;
+        buf_vbo_num_verts = 0;
         buf_vbo_num_tris = 0;
+        ++vtx_cache_epoch;
     }
 }
 
@@ -262,38 +526,91 @@ static struct ColorCombiner *gfx_lookup_or_create_color_combiner(uint32_t cc_id)
     return prev_combiner = comb;
 }
 
-static bool gfx_texture_cache_lookup(int tile, struct TextureHashmapNode **n, const uint8_t *orig_addr, uint32_t fmt, uint32_t siz) {
-    size_t hash = (uintptr_t)orig_addr;
-    hash = (hash >> 5) & 0x3ff;
-    struct TextureHashmapNode **node = &gfx_texture_cache.hashmap[hash];
-    while (*node != NULL && *node - gfx_texture_cache.pool < (int)gfx_texture_cache.pool_pos) {
-        if ((*node)->texture_addr == orig_addr && (*node)->fmt == fmt && (*node)->siz == siz) {
-            gfx_rapi->select_texture(tile, (*node)->texture_id);
-            *n = *node;
-            return true;
-        }
+static size_t gfx_texture_cache_hash(const uint8_t *orig_addr, const uint8_t *tlut_addr) {
+    size_t hash = (uintptr_t)orig_addr ^ ((uintptr_t)tlut_addr >> 4);
+    return (hash >> 5) & 0x3ff;
+}
+
+static void gfx_texture_cache_lru_unlink(struct TextureHashmapNode *node) {
+    if (node->lru_prev) node->lru_prev->lru_next = node->lru_next;
+    else gfx_texture_cache.lru_head = node->lru_next;
+    if (node->lru_next) node->lru_next->lru_prev = node->lru_prev;
+    else gfx_texture_cache.lru_tail = node->lru_prev;
+}
+
+static void gfx_texture_cache_lru_push(struct TextureHashmapNode *node) {
+    node->lru_prev = NULL;
+    node->lru_next = gfx_texture_cache.lru_head;
+    if (gfx_texture_cache.lru_head) gfx_texture_cache.lru_head->lru_prev = node;
+    else gfx_texture_cache.lru_tail = node;
+    gfx_texture_cache.lru_head = node;
+}
+
+// takes the least recently used entry out of the cache so it can be reused for another texture
+static struct TextureHashmapNode *gfx_texture_cache_evict(void) {
+    struct TextureHashmapNode *victim = gfx_texture_cache.lru_tail;
+    // the tiles may keep drawing with their current textures without looking them up again
+    while (victim == rendering_state.textures[0] || victim == rendering_state.textures[1]) {
+        victim = victim->lru_prev;
+    }
+    struct TextureHashmapNode **node = &gfx_texture_cache.hashmap[gfx_texture_cache_hash(victim->texture_addr, victim->tlut_addr)];
+    while (*node != victim) {
         node = &(*node)->next;
     }
-    if (gfx_texture_cache.pool_pos == sizeof(gfx_texture_cache.pool) / sizeof(struct TextureHashmapNode)) {
-        // Pool is full. We just invalidate everything and start over.
-        gfx_texture_cache.pool_pos = 0;
-        node = &gfx_texture_cache.hashmap[hash];
-        //puts("Clearing texture cache");
+    *node = victim->next;
+    gfx_texture_cache_lru_unlink(victim);
+    if (gfx_rapi->delete_texture) {
+        gfx_rapi->delete_texture(victim->texture_id);
     }
-    *node = &gfx_texture_cache.pool[gfx_texture_cache.pool_pos++];
-    if ((*node)->texture_addr == NULL) {
-        (*node)->texture_id = gfx_rapi->new_texture();
+    texEntryEvictions++;
+    return victim;
+}
+
+static bool gfx_texture_cache_lookup(int tile, struct TextureHashmapNode **n, const uint8_t *orig_addr, const uint8_t *tlut_addr, uint32_t fmt, uint32_t siz) {
+    struct TextureHashmapNode **bucket = &gfx_texture_cache.hashmap[gfx_texture_cache_hash(orig_addr, tlut_addr)];
+    for (struct TextureHashmapNode *node = *bucket; node != NULL; node = node->next) {
+        if (node->texture_addr == orig_addr && node->tlut_addr == tlut_addr && node->fmt == fmt && node->siz == siz) {
+            gfx_texture_cache_lru_unlink(node);
+            gfx_texture_cache_lru_push(node);
+            *n = node;
+            // the backend may have evicted it to make room, in which case it has to be imported again
+            if (gfx_rapi->texture_resident && !gfx_rapi->texture_resident(node->texture_id)) {
+                texMisses++;
+                // the upload may evict textures the packets use, and flushing them selects their
+                // textures, so select this one after
+                gfx_flush_packets();
+                gfx_rapi->select_texture(tile, node->texture_id);
+                return false;
+            }
+            gfx_rapi->select_texture(tile, node->texture_id);
+            texHits++;
+            return true;
+        }
+    }
+    texMisses++;
+    // uploading or evicting may take away textures the packets use
+    gfx_flush_packets();
+
+    struct TextureHashmapNode *node;
+    if (gfx_texture_cache.pool_pos < sizeof(gfx_texture_cache.pool) / sizeof(struct TextureHashmapNode)) {
+        node = &gfx_texture_cache.pool[gfx_texture_cache.pool_pos++];
+        node->texture_id = gfx_rapi->new_texture();
+    } else {
+        node = gfx_texture_cache_evict();
     }
-    gfx_rapi->select_texture(tile, (*node)->texture_id);
+    gfx_rapi->select_texture(tile, node->texture_id);
     gfx_rapi->set_sampler_parameters(tile, false, 0, 0);
-    (*node)->cms = 0;
-    (*node)->cmt = 0;
-    (*node)->linear_filter = false;
-    (*node)->next = NULL;
-    (*node)->texture_addr = orig_addr;
-    (*node)->fmt = fmt;
-    (*node)->siz = siz;
-    *n = *node;
+    node->cms = 0;
+    node->cmt = 0;
+    node->linear_filter = false;
+    node->next = *bucket;
+    *bucket = node;
+    gfx_texture_cache_lru_push(node);
+    node->texture_addr = orig_addr;
+    node->tlut_addr = tlut_addr;
+    node->fmt = fmt;
+    node->siz = siz;
+    *n = node;
     return false;
 }
 
@@ -477,11 +794,24 @@ static void import_texture_ci8(int tile) {
     gfx_rapi->upload_texture(rgba32_buf, width, height);
 }
 
+// hands the texture to the backend as it is in memory, if it can sample that format itself
+static bool import_texture_native(int tile, uint8_t fmt, uint8_t siz) {
+    uint32_t width = (rdp.texture_tile.line_size_bytes * 2) >> siz;
+    uint32_t height = rdp.loaded_texture[tile].size_bytes / rdp.texture_tile.line_size_bytes;
+
+    return gfx_rapi->upload_texture_native(rdp.loaded_texture[tile].addr, width, height, fmt, siz, rdp.palette);
+}
+
 static void import_texture(int tile) {
     uint8_t fmt = rdp.texture_tile.fmt;
     uint8_t siz = rdp.texture_tile.siz;
 
-    if (gfx_texture_cache_lookup(tile, &rendering_state.textures[tile], rdp.loaded_texture[tile].addr, fmt, siz)) {
+    const uint8_t *tlut_addr = (fmt == G_IM_FMT_CI) ? rdp.palette : NULL;
+    if (gfx_texture_cache_lookup(tile, &rendering_state.textures[tile], rdp.loaded_texture[tile].addr, tlut_addr, fmt, siz)) {
+        return;
+    }
+
+    if (gfx_rapi->upload_texture_native && import_texture_native(tile, fmt, siz)) {
         return;
     }
 
@@ -583,28 +913,63 @@ static inline void gfx_matrix_mul(fix64 (*restrict res)[4], const fix64 (*restri
     }
 }
 
+// Recomputes MP_matrix and its 32-bit copy for the vertex loops. The shift is the smallest one that
+// fits every rotation/scale entry in an int32, so ordinary matrices keep 28 or more fractional bits.
+// The translation row stays 64-bit since it holds the largest values.
+static void gfx_update_mp_matrix(void) {
+    gfx_matrix_mul(rsp.MP_matrix, rsp.modelview_matrix_stack[rsp.modelview_matrix_stack_size - 1], rsp.P_matrix);
+
+    uint64_t mag = 0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            const fix64 e = rsp.MP_matrix[i][j];
+            mag |= (e < 0) ? ~(uint64_t)e : (uint64_t)e;
+        }
+    }
+    int shift = 0;
+    while ((mag >> shift) > INT32_MAX) {
+        shift++;
+    }
+    rsp.MP_shift = shift;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            rsp.MP_matrix32[i][j] = (int32_t)(rsp.MP_matrix[i][j] >> shift);
+        }
+    }
+}
+
 static void gfx_sp_matrix(uint8_t parameters, const int32_t *addr) {
     fix64 matrix[4][4];
+    if (parameters & G_MTX_FLOAT) {
+        // Float matrix straight from the game's matrix stack
+        const float *f = (const float *)addr;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                matrix[i][j] = float_bits_2_fix(*f++);
+            }
+        }
+    } else {
 #ifndef GBI_FLOATS
-    // Original GBI where fixed point matrices are used
-    register int idx;
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4; j += 2) {
-            idx = (i << 1) + (j >> 1);
-            const int32_t int_part = addr[idx];
-            const uint32_t frac_part = addr[8 + idx];
-            matrix[i][j] = (int64_t) ((int32_t) ((int_part & 0xffff0000) | (frac_part >> 16))) << 16;
-            matrix[i][j + 1] = (int64_t) ((int32_t) ((int_part << 16) | (frac_part & 0xffff))) << 16;
+        // Original GBI where fixed point matrices are used
+        register int idx;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j += 2) {
+                idx = (i << 1) + (j >> 1);
+                const int32_t int_part = addr[idx];
+                const uint32_t frac_part = addr[8 + idx];
+                matrix[i][j] = (int64_t) ((int32_t) ((int_part & 0xffff0000) | (frac_part >> 16))) << 16;
+                matrix[i][j + 1] = (int64_t) ((int32_t) ((int_part << 16) | (frac_part & 0xffff))) << 16;
+            }
         }
-    }
 #else
-    // For a modified GBI where fixed point values are replaced with floats
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4; j++) {
-            matrix[i][j] = FLOAT_2_FIX(*(float*)addr++);
+        // For a modified GBI where fixed point values are replaced with floats
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                matrix[i][j] = FLOAT_2_FIX(*(float*)addr++);
+            }
         }
-    }
 #endif
+    }
 
     if (parameters & G_MTX_PROJECTION) {
         if (parameters & G_MTX_LOAD) {
@@ -624,7 +989,7 @@ static void gfx_sp_matrix(uint8_t parameters, const int32_t *addr) {
         }
         rsp.lights_changed = 1;
     }
-    gfx_matrix_mul(rsp.MP_matrix, rsp.modelview_matrix_stack[rsp.modelview_matrix_stack_size - 1], rsp.P_matrix);
+    gfx_update_mp_matrix();
 }
 
 static void gfx_sp_pop_matrix(uint32_t count) {
@@ -632,7 +997,7 @@ static void gfx_sp_pop_matrix(uint32_t count) {
         if (rsp.modelview_matrix_stack_size > 0) {
             --rsp.modelview_matrix_stack_size;
             if (rsp.modelview_matrix_stack_size > 0) {
-                gfx_matrix_mul(rsp.MP_matrix, rsp.modelview_matrix_stack[rsp.modelview_matrix_stack_size - 1], rsp.P_matrix);
+                gfx_update_mp_matrix();
             }
         }
     }
@@ -642,47 +1007,62 @@ static inline float gfx_adjust_x_for_aspect_ratio(float x) {
     return x; // ASSUMES EXISTING ASPECT OF 4 / 3
 }
 
-static void gfx_sp_vertex(size_t n_vertices, size_t dest_index, const Vtx *vertices) {
-    for (size_t i = 0; i < n_vertices; i++, dest_index++) {
+// Narrowed copies of the light and lookat directions: each coefficient is pre-divided by 127 and stored
+// as Q30, so a dot product with an s8 normal needs three 32-bit multiply-adds and no 64-bit division.
+static void gfx_update_lights(void) {
+    for (int i = 0; i < rsp.current_num_lights - 1; i++) {
+        calculate_normal_dir(&rsp.current_lights[i], rsp.current_lights_coeffs[i]);
+        for (int k = 0; k < 3; k++) {
+            rsp.lights_coeffs32[i][k] = (int32_t)((rsp.current_lights_coeffs[i][k] / 127) >> 2);
+        }
+    }
+    static const Light_t lookat_x = {{0, 0, 0}, 0, {0, 0, 0}, 0, {127, 0, 0}, 0};
+    static const Light_t lookat_y = {{0, 0, 0}, 0, {0, 0, 0}, 0, {0, 127, 0}, 0};
+    calculate_normal_dir(&lookat_x, rsp.current_lookat_coeffs[0]);
+    calculate_normal_dir(&lookat_y, rsp.current_lookat_coeffs[1]);
+    for (int i = 0; i < 2; i++) {
+        for (int k = 0; k < 3; k++) {
+            rsp.lookat_coeffs32[i][k] = (int32_t)((rsp.current_lookat_coeffs[i][k] / 127) >> 2);
+        }
+    }
+    rsp.lights_changed = false;
+}
+
+// Transforms a run of vertices. The flags are constants in every caller, so each instance below
+// compiles to its own loop without the per-vertex geometry mode checks.
+static inline __attribute__((always_inline)) void gfx_sp_vertex_loop(size_t n_vertices, struct LoadedVertex *d, const Vtx *vertices,
+                                                                     const bool lit, const bool texgen, const bool fog) {
+    const int32_t (*m)[4] = rsp.MP_matrix32;
+    const fix64 *t = rsp.MP_matrix[3];
+    const int shift = rsp.MP_shift;
+    const int num_lights = rsp.current_num_lights - 1;
+    const Light_t *ambient = &rsp.current_lights[num_lights];
+
+    for (size_t i = 0; i < n_vertices; i++, d++) {
         const Vtx_t *v = &vertices[i].v;
         const Vtx_tn *vn = &vertices[i].n;
-        struct LoadedVertex *d = &rsp.loaded_vertices[dest_index];
 
-        fix64 x = v->ob[0] * rsp.MP_matrix[0][0] + v->ob[1] * rsp.MP_matrix[1][0] + v->ob[2] * rsp.MP_matrix[2][0] + rsp.MP_matrix[3][0];
-        fix64 y = v->ob[0] * rsp.MP_matrix[0][1] + v->ob[1] * rsp.MP_matrix[1][1] + v->ob[2] * rsp.MP_matrix[2][1] + rsp.MP_matrix[3][1];
-        fix64 z = v->ob[0] * rsp.MP_matrix[0][2] + v->ob[1] * rsp.MP_matrix[1][2] + v->ob[2] * rsp.MP_matrix[2][2] + rsp.MP_matrix[3][2];
-        fix64 w = v->ob[0] * rsp.MP_matrix[0][3] + v->ob[1] * rsp.MP_matrix[1][3] + v->ob[2] * rsp.MP_matrix[2][3] + rsp.MP_matrix[3][3];
-        //x = gfx_adjust_x_for_aspect_ratio(x);
+        const int32_t ox = v->ob[0], oy = v->ob[1], oz = v->ob[2];
+        const fix64 x = (((int64_t)ox * m[0][0] + (int64_t)oy * m[1][0] + (int64_t)oz * m[2][0]) << shift) + t[0];
+        const fix64 y = (((int64_t)ox * m[0][1] + (int64_t)oy * m[1][1] + (int64_t)oz * m[2][1]) << shift) + t[1];
+        const fix64 z = (((int64_t)ox * m[0][2] + (int64_t)oy * m[1][2] + (int64_t)oz * m[2][2]) << shift) + t[2];
+        const fix64 w = (((int64_t)ox * m[0][3] + (int64_t)oy * m[1][3] + (int64_t)oz * m[2][3]) << shift) + t[3];
 
         short U = v->tc[0] * rsp.texture_scaling_factor.s >> 16;
         short V = v->tc[1] * rsp.texture_scaling_factor.t >> 16;
 
-        if (rsp.geometry_mode & G_LIGHTING) {
-            if (rsp.lights_changed) {
-                for (int i = 0; i < rsp.current_num_lights - 1; i++) {
-                    calculate_normal_dir(&rsp.current_lights[i], rsp.current_lights_coeffs[i]);
-                }
-                static const Light_t lookat_x = {{0, 0, 0}, 0, {0, 0, 0}, 0, {127, 0, 0}, 0};
-                static const Light_t lookat_y = {{0, 0, 0}, 0, {0, 0, 0}, 0, {0, 127, 0}, 0};
-                calculate_normal_dir(&lookat_x, rsp.current_lookat_coeffs[0]);
-                calculate_normal_dir(&lookat_y, rsp.current_lookat_coeffs[1]);
-                rsp.lights_changed = false;
-            }
-
-            int r = rsp.current_lights[rsp.current_num_lights - 1].col[0];
-            int g = rsp.current_lights[rsp.current_num_lights - 1].col[1];
-            int b = rsp.current_lights[rsp.current_num_lights - 1].col[2];
-
-            for (int i = 0; i < rsp.current_num_lights - 1; i++) {
-                fix64 intensity = 0;
-                intensity += vn->n[0] * rsp.current_lights_coeffs[i][0];
-                intensity += vn->n[1] * rsp.current_lights_coeffs[i][1];
-                intensity += vn->n[2] * rsp.current_lights_coeffs[i][2];
-                intensity /= 127;
-                if (intensity > 0.0f) {
-                    r += FIX_2_INT(intensity * rsp.current_lights[i].col[0]);
-                    g += FIX_2_INT(intensity * rsp.current_lights[i].col[1]);
-                    b += FIX_2_INT(intensity * rsp.current_lights[i].col[2]);
+        if (lit) {
+            const int32_t nx = vn->n[0], ny = vn->n[1], nz = vn->n[2];
+            int r = ambient->col[0];
+            int g = ambient->col[1];
+            int b = ambient->col[2];
+
+            for (int l = 0; l < num_lights; l++) {
+                const int32_t intensity = nx * rsp.lights_coeffs32[l][0] + ny * rsp.lights_coeffs32[l][1] + nz * rsp.lights_coeffs32[l][2];
+                if (intensity > 0) {
+                    r += (int32_t)(((int64_t)intensity * rsp.current_lights[l].col[0]) >> 30);
+                    g += (int32_t)(((int64_t)intensity * rsp.current_lights[l].col[1]) >> 30);
+                    b += (int32_t)(((int64_t)intensity * rsp.current_lights[l].col[2]) >> 30);
                 }
             }
 
@@ -690,17 +1070,11 @@ static void gfx_sp_vertex(size_t n_vertices, size_t dest_index, const Vtx *verti
             d->color.g = g > 255 ? 255 : g;
             d->color.b = b > 255 ? 255 : b;
 
-            if (rsp.geometry_mode & G_TEXTURE_GEN) {
-                fix64 dotx = 0, doty = 0;
-                dotx += vn->n[0] * rsp.current_lookat_coeffs[0][0];
-                dotx += vn->n[1] * rsp.current_lookat_coeffs[0][1];
-                dotx += vn->n[2] * rsp.current_lookat_coeffs[0][2];
-                doty += vn->n[0] * rsp.current_lookat_coeffs[1][0];
-                doty += vn->n[1] * rsp.current_lookat_coeffs[1][1];
-                doty += vn->n[2] * rsp.current_lookat_coeffs[1][2];
-
-                U = FIX_2_INT(((dotx / 127 + FIX_ONE) >> 2) * rsp.texture_scaling_factor.s);
-                V = FIX_2_INT(((doty / 127 + FIX_ONE) >> 2) * rsp.texture_scaling_factor.t);
+            if (texgen) {
+                const int32_t dotx = nx * rsp.lookat_coeffs32[0][0] + ny * rsp.lookat_coeffs32[0][1] + nz * rsp.lookat_coeffs32[0][2];
+                const int32_t doty = nx * rsp.lookat_coeffs32[1][0] + ny * rsp.lookat_coeffs32[1][1] + nz * rsp.lookat_coeffs32[1][2];
+                U = (int32_t)((((int64_t)dotx + (1 << 30)) >> 2) * rsp.texture_scaling_factor.s >> 30);
+                V = (int32_t)((((int64_t)doty + (1 << 30)) >> 2) * rsp.texture_scaling_factor.t >> 30);
             }
         } else {
             d->color.r = v->cn[0];
@@ -711,24 +1085,25 @@ static void gfx_sp_vertex(size_t n_vertices, size_t dest_index, const Vtx *verti
         d->u = INT_2_FIX(U);
         d->v = INT_2_FIX(V);
 
-        // trivial clip rejection
-        d->clip_rej = 0;
-        if (x < -w) d->clip_rej |= CLIP_LEFT;
-        if (x >  w) d->clip_rej |= CLIP_RIGHT;
-        if (y < -w) d->clip_rej |= CLIP_BOTTOM;
-        if (y >  w) d->clip_rej |= CLIP_TOP;
-        if (z < -w) d->clip_rej |= CLIP_FAR;
-        if (z >  w) d->clip_rej |= CLIP_NEAR;
+        // trivial clip rejection, one compare per plane and no branches
+        const fix64 nw = -w;
+        d->clip_rej = (x < nw) * CLIP_LEFT | (x > w) * CLIP_RIGHT |
+                      (y < nw) * CLIP_BOTTOM | (y > w) * CLIP_TOP |
+                      (z < nw) * CLIP_FAR | (z > w) * CLIP_NEAR;
+        const fix64 gw = w * GUARD_BAND;
+        d->clip_guard = (x < -gw) * CLIP_LEFT | (x > gw) * CLIP_RIGHT |
+                        (y < -gw) * CLIP_BOTTOM | (y > gw) * CLIP_TOP |
+                        (z < nw) * CLIP_FAR | (z > w) * CLIP_NEAR;
 
         d->x = x;
         d->y = y;
         d->z = z;
         d->w = w;
 
-        if (configEnableFog && (rsp.geometry_mode & G_FOG)) {
-            w = (w == 0.f) ? 1.f / 0.001f : 1.f / w;
-            const float winv = w < 0.0f ? 32767.0f : w;
-            float fog_z = z * winv * rsp.fog_mul + rsp.fog_offset;
+        if (fog) {
+            // z and w share the same scale, so the ratio of the raw values is z / w
+            const float winv = (w > 0) ? 1.0f / (float)w : (w == 0) ? 1000.0f / FIX_ONE : 32767.0f / FIX_ONE;
+            float fog_z = (float)z * winv * rsp.fog_mul + rsp.fog_offset;
             if (fog_z < 0) fog_z = 0;
             if (fog_z > 255) fog_z = 255;
             d->color.a = fog_z; // Use alpha variable to store fog factor
@@ -738,6 +1113,89 @@ static void gfx_sp_vertex(size_t n_vertices, size_t dest_index, const Vtx *verti
     }
 }
 
+#define DEFINE_VERTEX_LOOP(name, lit, texgen, fog) \
+    static void gfx_sp_vertex_##name(size_t n_vertices, struct LoadedVertex *d, const Vtx *vertices) { \
+        gfx_sp_vertex_loop(n_vertices, d, vertices, lit, texgen, fog); \
+    }
+
+DEFINE_VERTEX_LOOP(unlit, false, false, false)
+DEFINE_VERTEX_LOOP(unlit_fog, false, false, true)
+DEFINE_VERTEX_LOOP(lit, true, false, false)
+DEFINE_VERTEX_LOOP(lit_fog, true, false, true)
+DEFINE_VERTEX_LOOP(lit_texgen, true, true, false)
+DEFINE_VERTEX_LOOP(lit_texgen_fog, true, true, true)
+
+// indexed by lit, texgen, fog; texture generation only applies to lit vertices
+static void (*const vertex_loops[8])(size_t, struct LoadedVertex *, const Vtx *) = {
+    gfx_sp_vertex_unlit, gfx_sp_vertex_unlit_fog, gfx_sp_vertex_unlit, gfx_sp_vertex_unlit_fog,
+    gfx_sp_vertex_lit, gfx_sp_vertex_lit_fog, gfx_sp_vertex_lit_texgen, gfx_sp_vertex_lit_texgen_fog,
+};
+
+// Index of the vertex loop for the current geometry mode, the lights are brought up to date for it
+static uint8_t gfx_vertex_mode(void) {
+    const bool lit = (rsp.geometry_mode & G_LIGHTING) != 0;
+    const bool texgen = (rsp.geometry_mode & G_TEXTURE_GEN) != 0;
+    const bool fog = configEnableFog && (rsp.geometry_mode & G_FOG);
+
+    if (lit && rsp.lights_changed) {
+        gfx_update_lights();
+    }
+    return lit << 2 | texgen << 1 | fog;
+}
+
+static void gfx_invalidate_vertices(size_t n_vertices, size_t dest_index) {
+    for (size_t i = dest_index; i < dest_index + n_vertices && i < MAX_VERTICES; i++) {
+        vtx_cache[i].epoch = 0;
+        vtx_cache[i].projected = false;
+    }
+}
+
+static void gfx_sp_vertex(size_t n_vertices, size_t dest_index, const Vtx *vertices) {
+    const uint8_t mode = gfx_vertex_mode();
+    gfx_invalidate_vertices(n_vertices, dest_index);
+    vertex_loops[mode](n_vertices, &rsp.loaded_vertices[dest_index], vertices);
+}
+
+static void gfx_vertex_key(struct VertexKey *key, const uint8_t mode) {
+    memset(key, 0, sizeof(*key));
+    memcpy(key->mp, rsp.MP_matrix, sizeof(key->mp));
+    key->mode = mode;
+    if (mode & 4) {
+        memcpy(key->lights_coeffs, rsp.lights_coeffs32, sizeof(key->lights_coeffs));
+        for (int i = 0; i < rsp.current_num_lights; i++) {
+            memcpy(key->light_colors[i], rsp.current_lights[i].col, 3);
+        }
+        key->num_lights = rsp.current_num_lights;
+    }
+    if (mode & 2) {
+        memcpy(key->lookat_coeffs, rsp.lookat_coeffs32, sizeof(key->lookat_coeffs));
+    }
+    if (mode & 1) {
+        key->fog_mul = rsp.fog_mul;
+        key->fog_offset = rsp.fog_offset;
+    }
+    key->s = rsp.texture_scaling_factor.s;
+    key->t = rsp.texture_scaling_factor.t;
+}
+
+// G_VTX of a recorded display list. Static geometry drawn with the same matrix, lights and modes as
+// the last time (say, while the camera stands still) takes its transformed vertices from the cache.
+static void gfx_sp_cached_vertex(struct CachedVertices *cv) {
+    struct VertexKey key;
+    const uint8_t mode = gfx_vertex_mode();
+    gfx_vertex_key(&key, mode);
+    gfx_invalidate_vertices(cv->n_vertices, cv->dest_index);
+
+    if (cv->valid && memcmp(&key, &cv->key, sizeof(key)) == 0) {
+        numReusedVerts += cv->n_vertices;
+    } else {
+        vertex_loops[mode](cv->n_vertices, cv->out, cv->vertices);
+        cv->key = key;
+        cv->valid = true;
+    }
+    memcpy(&rsp.loaded_vertices[cv->dest_index], cv->out, cv->n_vertices * sizeof(struct LoadedVertex));
+}
+
 static inline struct ColorCombiner *gfx_pick_combiner(bool *out_use_fog, bool *out_use_alpha) {
     uint32_t cc_id = rdp.combine_mode;
 
@@ -789,6 +1247,7 @@ static inline bool gfx_update_textures(const bool used_textures[2], const bool l
             }
             if (linear_filter != rendering_state.textures[i]->linear_filter || rdp.texture_tile.cms != rendering_state.textures[i]->cms || rdp.texture_tile.cmt != rendering_state.textures[i]->cmt) {
                 gfx_flush();
+                gfx_flush_packets(); // the packets would draw with the new parameters
                 gfx_rapi->set_sampler_parameters(i, linear_filter, rdp.texture_tile.cms, rdp.texture_tile.cmt);
                 rendering_state.textures[i]->linear_filter = linear_filter;
                 rendering_state.textures[i]->cms = rdp.texture_tile.cms;
@@ -799,9 +1258,147 @@ static inline bool gfx_update_textures(const bool used_textures[2], const bool l
     return used_textures[0] || used_textures[1];
 }
 
+static inline struct ProjectedVertex gfx_project_vertex(const struct LoadedVertex *v) {
+    const fix64 w_inv = FIX_INV(v->w);
+    return (struct ProjectedVertex) { fix_mult(v->x, w_inv), fix_mult(v->y, w_inv), w_inv };
+}
+
+static inline void gfx_emit_vertex(const struct LoadedVertex *v, const struct ProjectedVertex *pos, const struct LoadedVertex *v1, const struct VertexFormat *fmt) {
+    const fix64 w = v->w;
+    const fix64 w_inv = pos->w_inv;
+    buf_vbo[buf_vbo_len++] = pos->x;
+    buf_vbo[buf_vbo_len++] = pos->y;
+    buf_vbo[buf_vbo_len++] = fix_mult(
+                                (v->z + w) >> 1,
+                                w_inv
+    );
+
+    buf_vbo[buf_vbo_len++] = w_inv; // store inverted W right away to save softrast the trouble
+
+    if (fmt->use_texture) {
+        fix64 u = (v->u - INT_2_FIX(fmt->uls * 8)) >> 5;
+        fix64 t = (v->v - INT_2_FIX(fmt->ult * 8)) >> 5;
+        if (fmt->linear_filter) {
+            // Linear filter adds 0.5f to the coordinates
+            u += FIX_ONE_HALF;
+            t += FIX_ONE_HALF;
+        }
+        buf_vbo[buf_vbo_len++] = fix_mult(u / fmt->tex_width, w_inv);
+        buf_vbo[buf_vbo_len++] = fix_mult(t / fmt->tex_height, w_inv);
+    }
+
+    if (fmt->use_fog) {
+        buf_vbo[buf_vbo_len++] = v->color.a * w_inv; // fog factor (not alpha)
+    }
+
+    for (int j = 0; j < fmt->num_inputs; j++) {
+        const struct RGBA *color;
+        struct RGBA tmp;
+        for (int k = 0; k < 1 + (fmt->use_alpha ? 1 : 0); k++) {
+            switch (fmt->comb->shader_input_mapping[k][j]) {
+                case CC_PRIM:
+                    color = &fmt->prim_color;
+                    break;
+                case CC_SHADE:
+                    color = &v->color;
+                    break;
+                case CC_ENV:
+                    color = &fmt->env_color;
+                    break;
+                case CC_LOD:
+                {
+                    float distance_frac = (FIX_2_FLOAT(v1->w) - 3000.0f) / 3000.0f;
+                    if (distance_frac < 0.0f) distance_frac = 0.0f;
+                    if (distance_frac > 1.0f) distance_frac = 1.0f;
+                    tmp.r = tmp.g = tmp.b = tmp.a = distance_frac * 255.0f;
+                    color = &tmp;
+                    break;
+                }
+                default:
+                    memset(&tmp, 0, sizeof(tmp));
+                    color = &tmp;
+                    break;
+            }
+            if (k == 0) {
+                buf_vbo[buf_vbo_len++] = color->r * w_inv;
+                buf_vbo[buf_vbo_len++] = color->g * w_inv;
+                buf_vbo[buf_vbo_len++] = color->b * w_inv;
+            } else {
+                if (fmt->use_fog && color == &v->color) {
+                    // Shade alpha is 100% for fog
+                    buf_vbo[buf_vbo_len++] = GFX_COLOR_ONE * w_inv;
+                } else {
+                    buf_vbo[buf_vbo_len++] = color->a * w_inv;
+                }
+            }
+        }
+    }
+}
+
+// Backface culling and dropping triangles that cover no pixel centre, done on the projected positions
+// before any state or attributes are set up. Every vertex must have w > 0, which holds after clipping.
+static inline bool gfx_reject_triangle(const struct ProjectedVertex *p1, const struct ProjectedVertex *p2, const struct ProjectedVertex *p3) {
+    if ((rsp.geometry_mode & G_CULL_BOTH) != 0) {
+        const fix64 dx1 = p1->x - p2->x;
+        const fix64 dy1 = p1->y - p2->y;
+        const fix64 dx2 = p3->x - p2->x;
+        const fix64 dy2 = p3->y - p2->y;
+        const fix64 cross = fix_mult(dx1, dy2) - fix_mult(dy1, dx2);
+
+        switch (rsp.geometry_mode & G_CULL_BOTH) {
+            case G_CULL_FRONT:
+                if (cross <= 0) return true;
+                break;
+            case G_CULL_BACK:
+                if (cross >= 0) return true;
+                break;
+            case G_CULL_BOTH:
+                // Why is this even an option?
+                return true;
+        }
+    }
+
+    // Same mapping as the backend's viewport transform, minus the whole pixel offsets which don't
+    // change whether the floors match. A triangle whose x or y extent stays between two pixel
+    // centres draws nothing.
+    const fix64 hw = INT_2_FIX(rdp.viewport.width >> 1);
+    const fix64 hh = INT_2_FIX(rdp.viewport.height >> 1);
+    const fix64 x1 = fix_mult(p1->x, hw), x2 = fix_mult(p2->x, hw), x3 = fix_mult(p3->x, hw);
+    const fix64 y1 = fix_mult(p1->y, hh), y2 = fix_mult(p2->y, hh), y3 = fix_mult(p3->y, hh);
+    const fix64 x_min = x1 < x2 ? (x1 < x3 ? x1 : x3) : (x2 < x3 ? x2 : x3);
+    const fix64 x_max = x1 > x2 ? (x1 > x3 ? x1 : x3) : (x2 > x3 ? x2 : x3);
+    const fix64 y_min = y1 < y2 ? (y1 < y3 ? y1 : y3) : (y2 < y3 ? y2 : y3);
+    const fix64 y_max = y1 > y2 ? (y1 > y3 ? y1 : y3) : (y2 > y3 ? y2 : y3);
+    return FIX_2_INT(x_min + FIX_ONE_HALF) == FIX_2_INT(x_max + FIX_ONE_HALF) ||
+           FIX_2_INT(y_min + FIX_ONE_HALF) == FIX_2_INT(y_max + FIX_ONE_HALF);
+}
+
 static inline void gfx_push_triangle(const struct LoadedVertex *restrict v1, const struct LoadedVertex *restrict v2, const struct LoadedVertex *restrict v3) {
     const struct LoadedVertex *v_arr[3] = {v1, v2, v3};
 
+    // project the vertices, G_VTX slots only once per load
+    struct ProjectedVertex pos[3];
+    ptrdiff_t slots[3];
+    for (int i = 0; i < 3; i++) {
+        // clipped vertices live in gfx_clip_triangle()'s buffer, only subtract pointers into the slots
+        if (v_arr[i] >= rsp.loaded_vertices && v_arr[i] < rsp.loaded_vertices + MAX_VERTICES) {
+            slots[i] = v_arr[i] - rsp.loaded_vertices;
+            if (!vtx_cache[slots[i]].projected) {
+                vtx_cache[slots[i]].pos = gfx_project_vertex(v_arr[i]);
+                vtx_cache[slots[i]].projected = true;
+            }
+            pos[i] = vtx_cache[slots[i]].pos;
+        } else {
+            slots[i] = -1;
+            pos[i] = gfx_project_vertex(v_arr[i]);
+        }
+    }
+
+    if (gfx_reject_triangle(&pos[0], &pos[1], &pos[2])) {
+        ++numRejectedTris;
+        return;
+    }
+
     const bool depth_test = (rsp.geometry_mode & G_ZBUFFER) == G_ZBUFFER;
     if (depth_test != rendering_state.depth_test) {
         gfx_flush();
@@ -845,84 +1442,52 @@ static inline void gfx_push_triangle(const struct LoadedVertex *restrict v1, con
 
     const bool linear_filter = configFiltering && (rdp.other_mode_h & (3U << G_MDSFT_TEXTFILT)) != G_TF_POINT;
     const bool use_texture = gfx_update_textures(used_textures, linear_filter);
-    const uint32_t tex_width = (rdp.texture_tile.lrs - rdp.texture_tile.uls + 4) / 4;
-    const uint32_t tex_height = (rdp.texture_tile.lrt - rdp.texture_tile.ult + 4) / 4;
 
-    for (int i = 0; i < 3; i++) {
-        const fix64 w = v_arr[i]->w;
-        const fix64 w_inv = FIX_INV(w);
-        buf_vbo[buf_vbo_len++] = fix_mult(v_arr[i]->x, w_inv);
-        buf_vbo[buf_vbo_len++] = fix_mult(v_arr[i]->y, w_inv);
-        buf_vbo[buf_vbo_len++] = fix_mult(
-                                    (v_arr[i]->z + w) >> 1,
-                                    w_inv
-        );
-
-        buf_vbo[buf_vbo_len++] = w_inv; // store inverted W right away to save softrast the trouble
-
-        if (use_texture) {
-            fix64 u = (v_arr[i]->u - INT_2_FIX(rdp.texture_tile.uls * 8)) >> 5;
-            fix64 v = (v_arr[i]->v - INT_2_FIX(rdp.texture_tile.ult * 8)) >> 5;
-            if ((rdp.other_mode_h & (3U << G_MDSFT_TEXTFILT)) != G_TF_POINT) {
-                // Linear filter adds 0.5f to the coordinates
-                u += FIX_ONE_HALF;
-                v += FIX_ONE_HALF;
-            }
-            buf_vbo[buf_vbo_len++] = fix_mult(u / tex_width, w_inv);
-            buf_vbo[buf_vbo_len++] = fix_mult(v / tex_height, w_inv);
-        }
+    struct VertexFormat fmt;
+    memset(&fmt, 0, sizeof(fmt)); // padding too, formats are compared with memcmp
+    fmt.comb = comb;
+    fmt.prim_color = rdp.prim_color;
+    fmt.env_color = rdp.env_color;
+    fmt.num_inputs = num_inputs;
+    fmt.use_fog = use_fog;
+    fmt.use_alpha = use_alpha;
+    fmt.use_texture = use_texture;
+    if (use_texture) {
+        fmt.uls = rdp.texture_tile.uls;
+        fmt.ult = rdp.texture_tile.ult;
+        fmt.tex_width = (rdp.texture_tile.lrs - rdp.texture_tile.uls + 4) / 4;
+        fmt.tex_height = (rdp.texture_tile.lrt - rdp.texture_tile.ult + 4) / 4;
+        fmt.linear_filter = (rdp.other_mode_h & (3U << G_MDSFT_TEXTFILT)) != G_TF_POINT;
+    }
 
-        if (use_fog) {
-            buf_vbo[buf_vbo_len++] = v_arr[i]->color.a * w_inv; // fog factor (not alpha)
+    // vertices emitted under another format can't be reused
+    if (memcmp(&fmt, &vtx_cache_fmt, sizeof(fmt)) != 0) {
+        vtx_cache_fmt = fmt;
+        ++vtx_cache_epoch;
+    }
+
+    // CC_LOD takes the first vertex's w, so the attributes depend on the triangle and not just the vertex
+    bool shareable = vtx_cache_enabled;
+    for (int j = 0; j < num_inputs; j++) {
+        if (comb->shader_input_mapping[0][j] == CC_LOD || (use_alpha && comb->shader_input_mapping[1][j] == CC_LOD)) {
+            shareable = false;
         }
+    }
 
-        for (int j = 0; j < num_inputs; j++) {
-            const struct RGBA *color;
-            struct RGBA tmp;
-            for (int k = 0; k < 1 + (use_alpha ? 1 : 0); k++) {
-                switch (comb->shader_input_mapping[k][j]) {
-                    case CC_PRIM:
-                        color = &rdp.prim_color;
-                        break;
-                    case CC_SHADE:
-                        color = &v_arr[i]->color;
-                        break;
-                    case CC_ENV:
-                        color = &rdp.env_color;
-                        break;
-                    case CC_LOD:
-                    {
-                        float distance_frac = (FIX_2_FLOAT(v1->w) - 3000.0f) / 3000.0f;
-                        if (distance_frac < 0.0f) distance_frac = 0.0f;
-                        if (distance_frac > 1.0f) distance_frac = 1.0f;
-                        tmp.r = tmp.g = tmp.b = tmp.a = distance_frac * 255.0f;
-                        color = &tmp;
-                        break;
-                    }
-                    default:
-                        memset(&tmp, 0, sizeof(tmp));
-                        color = &tmp;
-                        break;
-                }
-                if (k == 0) {
-                    buf_vbo[buf_vbo_len++] = color->r * w_inv;
-                    buf_vbo[buf_vbo_len++] = color->g * w_inv;
-                    buf_vbo[buf_vbo_len++] = color->b * w_inv;
-                } else {
-                    if (use_fog && color == &v_arr[i]->color) {
-                        // Shade alpha is 100% for fog
-                        buf_vbo[buf_vbo_len++] = GFX_COLOR_ONE * w_inv;
-                    } else {
-                        buf_vbo[buf_vbo_len++] = color->a * w_inv;
-                    }
-                }
-            }
+    for (int i = 0; i < 3; i++) {
+        // only the G_VTX slots are cached, clipped and rect vertices are emitted every time
+        const ptrdiff_t slot = slots[i];
+        const bool cached = shareable && slot >= 0;
+        if (cached && vtx_cache[slot].epoch == vtx_cache_epoch) {
+            buf_idx[buf_vbo_num_tris * 3 + i] = vtx_cache[slot].idx;
+            continue;
         }
-        /*struct RGBA *color = &v_arr[i]->color;
-        buf_vbo[buf_vbo_len++] = color->r / 255.0f;
-        buf_vbo[buf_vbo_len++] = color->g / 255.0f;
-        buf_vbo[buf_vbo_len++] = color->b / 255.0f;
-        buf_vbo[buf_vbo_len++] = color->a / 255.0f;*/
+        if (cached) {
+            vtx_cache[slot].epoch = vtx_cache_epoch;
+            vtx_cache[slot].idx = buf_vbo_num_verts;
+        }
+        buf_idx[buf_vbo_num_tris * 3 + i] = buf_vbo_num_verts++;
+        gfx_emit_vertex(v_arr[i], &pos[i], v1, &fmt);
     }
     if (++buf_vbo_num_tris == MAX_BUFFERED) {
         gfx_flush();
@@ -942,20 +1507,17 @@ static inline struct RGBA rgba_lerp(const struct RGBA c0, const struct RGBA c1,
     };
 }
 
-static inline bool gfx_clip_triangle(struct LoadedVertex *v1, struct LoadedVertex *v2, struct LoadedVertex *v3, const uint8_t clip_and) {
+// clips against the planes in clip_or, which come from clip_guard, and pushes the result
+static inline void gfx_clip_triangle(struct LoadedVertex *v1, struct LoadedVertex *v2, struct LoadedVertex *v3, const uint8_t clip_or) {
     static const int c_planes[][4] = {
         {  0,  0, -1, 1 }, // near
         {  0,  0,  1, 1 },  // far
-        {  0, -1,  0, 1 }, // top
-        {  0,  1,  0, 1 },  // bottom
-        { -1,  0,  0, 1 }, // left
-        {  1,  0,  0, 1 },  // right
+        {  0, -1,  0, GUARD_BAND }, // top
+        {  0,  1,  0, GUARD_BAND },  // bottom
+        { -1,  0,  0, GUARD_BAND }, // left
+        {  1,  0,  0, GUARD_BAND },  // right
     };
 
-    const uint8_t clip_or = v1->clip_rej | v2->clip_rej | v3->clip_rej;
-
-    if (!clip_or && clip_and) return false; // triangle fully in frustum
-
     struct LoadedVertex v_buf[2][12] = { { *v1, *v2, *v3 } };
     int v_num[2] = { 3, 0 };
     int v_idx = 0;
@@ -973,8 +1535,8 @@ static inline bool gfx_clip_triangle(struct LoadedVertex *v1, struct LoadedVerte
         for (int i = 0; i < num_verts; ++i) {
             const struct LoadedVertex *vthis = &v_in[i];
             const struct LoadedVertex *vnext = &v_in[(i + 1) % num_verts];
-            const fix64 d1 = plane[0] * vthis->x + plane[1] * vthis->y + plane[2] * vthis->z + vthis->w;
-            const fix64 d2 = plane[0] * vnext->x + plane[1] * vnext->y + plane[2] * vnext->z + vnext->w;
+            const fix64 d1 = plane[0] * vthis->x + plane[1] * vthis->y + plane[2] * vthis->z + plane[3] * vthis->w;
+            const fix64 d2 = plane[0] * vnext->x + plane[1] * vnext->y + plane[2] * vnext->z + plane[3] * vnext->w;
             const bool this_in = d1 > 0;
             const bool next_in = d2 > 0;
             // current is inside clipping plane, push it into output
@@ -1005,7 +1567,7 @@ static inline bool gfx_clip_triangle(struct LoadedVertex *v1, struct LoadedVerte
             }
         }
 
-        if (v_num[outidx] < 3) return true; // not enough for a triangle
+        if (v_num[outidx] < 3) return; // not enough for a triangle
 
         v_idx = outidx;
         v_num[!v_idx] = 0;
@@ -1016,8 +1578,6 @@ static inline bool gfx_clip_triangle(struct LoadedVertex *v1, struct LoadedVerte
     const struct LoadedVertex *in = v_buf[v_idx];
     for (int i = 1; i < n; ++i)
         gfx_push_triangle(in + 0, in + i, in + i + 1);
-
-    return true;
 }
 
 static void gfx_sp_tri1(uint8_t vtx1_idx, uint8_t vtx2_idx, uint8_t vtx3_idx) {
@@ -1033,35 +1593,17 @@ static void gfx_sp_tri1(uint8_t vtx1_idx, uint8_t vtx2_idx, uint8_t vtx3_idx) {
         return;
     }
 
-    if ((rsp.geometry_mode & G_CULL_BOTH) != 0) {
-        fix64 dx1 = fix_div_s(v1->x, v1->w) - fix_div_s(v2->x, v2->w);
-        fix64 dy1 = fix_div_s(v1->y, v1->w) - fix_div_s(v2->y, v2->w);
-        fix64 dx2 = fix_div_s(v3->x, v3->w) - fix_div_s(v2->x, v2->w);
-        fix64 dy2 = fix_div_s(v3->y, v3->w) - fix_div_s(v2->y, v2->w);
-        fix64 cross = fix_mult(dx1, dy2) - fix_mult(dy1, dx2);
-
-        if ((v1->w < 0) ^ (v2->w < 0) ^ (v3->w < 0)) {
-            // If one vertex lies behind the eye, negating cross will give the correct result.
-            // If all vertices lie behind the eye, the triangle will be rejected anyway.
-            cross = -cross;
-        }
-
-        switch (rsp.geometry_mode & G_CULL_BOTH) {
-            case G_CULL_FRONT:
-                if (cross <= 0) return;
-                break;
-            case G_CULL_BACK:
-                if (cross >= 0) return;
-                break;
-            case G_CULL_BOTH:
-                // Why is this even an option?
-                return;
-        }
+    if ((rsp.geometry_mode & G_CULL_BOTH) == G_CULL_BOTH) {
+        return;
     }
-
-    // clip the triangle and put the resulting triangles into the buffer
-    // otherwise put the current triangle
-    if (!gfx_clip_triangle(v1, v2, v3, clip_and))
+    // the rest of the culling waits for the projected vertices in gfx_push_triangle
+
+    // clip the triangle if it leaves the guard band or crosses near/far and put the resulting
+    // triangles into the buffer, otherwise put the current triangle and let the rasterizer scissor it
+    const uint8_t clip_or = v1->clip_guard | v2->clip_guard | v3->clip_guard;
+    if (clip_or)
+        gfx_clip_triangle(v1, v2, v3, clip_or);
+    else
         gfx_push_triangle(v1, v2, v3);
 }
 
@@ -1316,7 +1858,10 @@ static void gfx_dp_set_fog_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
     rdp.fog_color.g = g;
     rdp.fog_color.b = b;
     rdp.fog_color.a = a;
-    if (gfx_rapi->set_fog_color) gfx_rapi->set_fog_color(&rdp.fog_color.r);
+    if (gfx_rapi->set_fog_color) {
+        gfx_flush_packets();
+        gfx_rapi->set_fog_color(&rdp.fog_color.r);
+    }
 }
 
 static void gfx_dp_set_fill_color(uint32_t packed_color) {
@@ -1436,10 +1981,13 @@ static void gfx_dp_texture_rectangle(int32_t ulx, int32_t uly, int32_t lrx, int3
         const bool used_textures[2] = { true, false };
         gfx_pick_combiner(NULL, NULL);
         gfx_update_textures(used_textures, false);
+        gfx_flush();
+        gfx_flush_packets();
         ulxf = HALF_SCREEN_WIDTH + gfx_adjust_x_for_aspect_ratio(ulxf / 4.0f - HALF_SCREEN_WIDTH);
         lrxf = HALF_SCREEN_WIDTH + gfx_adjust_x_for_aspect_ratio(lrxf / 4.0f - HALF_SCREEN_WIDTH);
         ulyf = ulyf / 4.0f;
         lryf = lryf / 4.0f;
+        gfx_draw_pending_fill();
         gfx_rapi->tex_rect(ulxf, ulyf, lrxf, lryf, uls / 32.f, ult / 32.f, dudx / 8.f, dvdy / 8.f, &rdp.env_color.r);
     } else {
         struct LoadedVertex* ul = &rsp.loaded_vertices[MAX_VERTICES + 0];
@@ -1489,11 +2037,22 @@ static void gfx_dp_fill_rectangle(int32_t ulx, int32_t uly, int32_t lrx, int32_t
         float lrxf = lrx * ratio_x;
         float lryf = lry * ratio_y;
         gfx_pick_combiner(NULL, NULL);
+        gfx_flush();
+        gfx_flush_packets();
         ulxf = HALF_SCREEN_WIDTH + gfx_adjust_x_for_aspect_ratio(ulxf / 4.0f - HALF_SCREEN_WIDTH);
         lrxf = HALF_SCREEN_WIDTH + gfx_adjust_x_for_aspect_ratio(lrxf / 4.0f - HALF_SCREEN_WIDTH);
         ulyf = ulyf / 4.0f;
         lryf = lryf / 4.0f;
-        gfx_rapi->fill_rect(ulxf, ulyf, lrxf, lryf, &rdp.fill_color.r);
+        const int x0 = ulxf, y0 = ulyf, x1 = lrxf, y1 = lryf;
+        if (x0 > pending_fill.x0 || y0 > pending_fill.y0 || x1 < pending_fill.x1 || y1 < pending_fill.y1) {
+            gfx_draw_pending_fill();
+        }
+        pending_fill.pending = true;
+        pending_fill.x0 = x0;
+        pending_fill.y0 = y0;
+        pending_fill.x1 = x1;
+        pending_fill.y1 = y1;
+        pending_fill.color = rdp.fill_color;
     } else {
         for (int i = MAX_VERTICES; i < MAX_VERTICES + 4; i++) {
             struct LoadedVertex* v = &rsp.loaded_vertices[i];
@@ -1505,6 +2064,23 @@ static void gfx_dp_fill_rectangle(int32_t ulx, int32_t uly, int32_t lrx, int32_t
     rdp.combine_mode = saved_combine_mode;
 }
 
+static void gfx_dp_background_tag(void) {
+    // the background only covers the scissor, so the fill is still needed if it reaches outside it
+    // (a narrowed viewport letterboxes the scene and the rest of the screen keeps last frame's pixels)
+    const float top = SCREEN_HEIGHT * ratio_y - (rdp.scissor.y + rdp.scissor.height);
+    if (pending_fill.x0 >= rdp.scissor.x && pending_fill.x1 <= rdp.scissor.x + rdp.scissor.width
+        && pending_fill.y0 >= top && pending_fill.y1 <= top + rdp.scissor.height) {
+        pending_fill.pending = false;
+    }
+}
+
+static void gfx_dp_layer_tag(uint32_t tag) {
+    gfx_flush();
+    gfx_flush_packets();
+    // with the depth buffer the triangles of these layers come out the same in any order
+    deferred.active = (configStateSorting || configHiZ) && tag != (G_TAG_LAYER_END & 0xff) && (tag & G_TAG_LAYER_SORTABLE);
+}
+
 static void gfx_dp_set_z_image(void *z_buf_address) {
     rdp.z_buf_address = z_buf_address;
 }
@@ -1528,6 +2104,193 @@ static inline void *seg_addr(uintptr_t w1) {
 #define C0(pos, width) ((cmd->words.w0 >> (pos)) & ((1U << width) - 1))
 #define C1(pos, width) ((cmd->words.w1 >> (pos)) & ((1U << width) - 1))
 
+// Display list being recorded. The first pass only counts, the second one writes into the buffers.
+struct DisplayListRecorder {
+    Gfx *cmds;
+    uint8_t *vertex_data;
+    size_t num_cmds;
+    size_t vertex_data_size;
+};
+
+static void gfx_record_cmd(struct DisplayListRecorder *rec, uintptr_t w0, uintptr_t w1) {
+    if (rec->cmds != NULL) {
+        rec->cmds[rec->num_cmds].words.w0 = w0;
+        rec->cmds[rec->num_cmds].words.w1 = w1;
+    }
+    rec->num_cmds++;
+}
+
+static void gfx_record_vertices(struct DisplayListRecorder *rec, size_t n_vertices, size_t dest_index, const Vtx *vertices) {
+    const size_t size = (sizeof(struct CachedVertices) + n_vertices * (sizeof(Vtx) + sizeof(struct LoadedVertex)) + 7) & ~(size_t)7;
+    if (rec->cmds != NULL) {
+        struct CachedVertices *cv = (struct CachedVertices *)(rec->vertex_data + rec->vertex_data_size);
+        struct LoadedVertex *out = (struct LoadedVertex *)(cv + 1);
+        Vtx *copy = (Vtx *)(out + n_vertices);
+        memcpy(copy, vertices, n_vertices * sizeof(Vtx));
+        cv->valid = false;
+        cv->n_vertices = n_vertices;
+        cv->dest_index = dest_index;
+        cv->vertices = copy;
+        cv->out = out;
+        gfx_record_cmd(rec, (uintptr_t)G_VTX_CACHED << 24, (uintptr_t)cv);
+    } else {
+        gfx_record_cmd(rec, 0, 0);
+    }
+    rec->vertex_data_size += size;
+}
+
+static void gfx_record_dl(struct DisplayListRecorder *rec, const Gfx *cmd) {
+    for (;;) {
+        uint32_t opcode = cmd->words.w0 >> 24;
+
+        switch (opcode) {
+            case G_VTX:
+#ifdef F3DEX_GBI_2
+                gfx_record_vertices(rec, C0(12, 8), C0(1, 7) - C0(12, 8), seg_addr(cmd->words.w1));
+#elif defined(F3DEX_GBI) || defined(F3DLP_GBI)
+                gfx_record_vertices(rec, C0(10, 6), C0(16, 8) / 2, seg_addr(cmd->words.w1));
+#else
+                gfx_record_vertices(rec, (C0(0, 16)) / sizeof(Vtx), C0(16, 4), seg_addr(cmd->words.w1));
+#endif
+                break;
+            case G_DL:
+                if (C0(16, 1) == 0) {
+                    gfx_record_dl(rec, (const Gfx *)seg_addr(cmd->words.w1));
+                } else {
+                    cmd = (const Gfx *)seg_addr(cmd->words.w1);
+                    --cmd; // increase after break
+                }
+                break;
+            case (uint8_t)G_ENDDL:
+                return;
+            case (uint8_t)G_RDPPIPESYNC:
+            case (uint8_t)G_RDPLOADSYNC:
+            case (uint8_t)G_RDPTILESYNC:
+            case (uint8_t)G_RDPFULLSYNC:
+            case (uint8_t)G_SPNOOP:
+                break;
+            case G_TEXRECT:
+            case G_TEXRECTFLIP:
+                // the two words after it carry the rest of the command
+                gfx_record_cmd(rec, cmd->words.w0, cmd->words.w1);
+                ++cmd;
+                gfx_record_cmd(rec, cmd->words.w0, cmd->words.w1);
+                ++cmd;
+                gfx_record_cmd(rec, cmd->words.w0, cmd->words.w1);
+                break;
+            default:
+                gfx_record_cmd(rec, cmd->words.w0, cmd->words.w1);
+                break;
+        }
+        ++cmd;
+    }
+}
+
+static struct CachedDisplayList **gfx_dl_cache_bucket(const Gfx *addr) {
+    return &dl_cache.hashmap[((uintptr_t)addr >> 3) & 0x1ff];
+}
+
+static void gfx_dl_cache_lru_unlink(struct CachedDisplayList *node) {
+    if (node->lru_prev) node->lru_prev->lru_next = node->lru_next;
+    else dl_cache.lru_head = node->lru_next;
+    if (node->lru_next) node->lru_next->lru_prev = node->lru_prev;
+    else dl_cache.lru_tail = node->lru_prev;
+}
+
+static void gfx_dl_cache_lru_push(struct CachedDisplayList *node) {
+    node->lru_prev = NULL;
+    node->lru_next = dl_cache.lru_head;
+    if (dl_cache.lru_head) dl_cache.lru_head->lru_prev = node;
+    else dl_cache.lru_tail = node;
+    dl_cache.lru_head = node;
+}
+
+// frees least recently used recordings until `size` more bytes fit in the budget. Lists already run
+// this frame are kept, evicting them would only have them recorded again every frame.
+// Nothing runs from a recording during a lookup, they don't call other lists.
+static bool gfx_dl_cache_make_room(size_t size) {
+    while (dl_cache.size_bytes + size > DL_CACHE_BUDGET) {
+        struct CachedDisplayList *victim = dl_cache.lru_tail;
+        if (victim == NULL || victim->last_use == dl_cache.frame) {
+            return false;
+        }
+        struct CachedDisplayList **node = gfx_dl_cache_bucket(victim->addr);
+        while (*node != victim) {
+            node = &(*node)->next;
+        }
+        *node = victim->next;
+        gfx_dl_cache_lru_unlink(victim);
+        dl_cache.size_bytes -= victim->size;
+        free(victim->cmds);
+        free(victim);
+    }
+    return true;
+}
+
+static void gfx_dl_cache_clear(void) {
+    while (dl_cache.lru_head != NULL) {
+        struct CachedDisplayList *node = dl_cache.lru_head;
+        dl_cache.lru_head = node->lru_next;
+        free(node->cmds);
+        free(node);
+    }
+    memset(dl_cache.hashmap, 0, sizeof(dl_cache.hashmap));
+    dl_cache.lru_tail = NULL;
+    dl_cache.size_bytes = 0;
+}
+
+static struct CachedDisplayList *gfx_dl_cache_lookup(const Gfx *addr) {
+    struct CachedDisplayList **bucket = gfx_dl_cache_bucket(addr);
+    for (struct CachedDisplayList *node = *bucket; node != NULL; node = node->next) {
+        if (node->addr == addr) {
+            gfx_dl_cache_lru_unlink(node);
+            gfx_dl_cache_lru_push(node);
+            node->last_use = dl_cache.frame;
+            return node;
+        }
+    }
+
+    struct CachedDisplayList *node = malloc(sizeof(struct CachedDisplayList));
+    if (node == NULL) {
+        printf("Out of memory for the display list cache\n");
+        abort();
+    }
+    node->addr = addr;
+    node->cmds = NULL;
+    node->size = 0;
+    node->last_use = dl_cache.frame;
+
+    struct DisplayListRecorder rec = { NULL, NULL, 0, 0 };
+    gfx_record_dl(&rec, addr);
+    gfx_record_cmd(&rec, (uintptr_t)(uint8_t)G_ENDDL << 24, 0);
+    const size_t cmds_size = rec.num_cmds * sizeof(Gfx);
+    const size_t size = ((cmds_size + 7) & ~(size_t)7) + rec.vertex_data_size;
+    // a list that doesn't fit stays unrecorded until it is evicted itself, then it gets another try
+    const bool fits = gfx_dl_cache_make_room(size);
+    node->next = *bucket;
+    *bucket = node;
+    gfx_dl_cache_lru_push(node);
+    if (!fits) {
+        return node;
+    }
+    uint8_t *buf = malloc(size);
+    if (buf == NULL) {
+        printf("Out of memory for the display list cache\n");
+        abort();
+    }
+    dl_cache.size_bytes += size;
+    node->size = size;
+
+    rec.cmds = (Gfx *)buf;
+    rec.vertex_data = buf + ((cmds_size + 7) & ~(size_t)7);
+    rec.num_cmds = 0;
+    rec.vertex_data_size = 0;
+    gfx_record_dl(&rec, addr);
+    gfx_record_cmd(&rec, (uintptr_t)(uint8_t)G_ENDDL << 24, 0);
+    node->cmds = rec.cmds;
+    return node;
+}
+
 static void gfx_run_dl(Gfx* cmd) {
     for (;;) {
         uint32_t opcode = cmd->words.w0 >> 24;
@@ -1578,8 +2341,17 @@ static void gfx_run_dl(Gfx* cmd) {
                 gfx_sp_vertex((C0(0, 16)) / sizeof(Vtx), C0(16, 4), seg_addr(cmd->words.w1));
 #endif
                 break;
-            case G_DL:
-                if (C0(16, 1) == 0) {
+            case G_VTX_CACHED:
+                gfx_sp_cached_vertex((struct CachedVertices *)cmd->words.w1);
+                break;
+            case G_DL: {
+                // the tag is only for this call, not for the calls in a list run from the original
+                const bool static_dl = dl_cache.static_next;
+                dl_cache.static_next = false;
+                if (C0(16, 1) == 0 && static_dl && configDlCache) {
+                    const struct CachedDisplayList *dl = gfx_dl_cache_lookup((const Gfx *)seg_addr(cmd->words.w1));
+                    gfx_run_dl(dl->cmds != NULL ? dl->cmds : (Gfx *)seg_addr(cmd->words.w1));
+                } else if (C0(16, 1) == 0) {
                     // Push return address
                     gfx_run_dl((Gfx *)seg_addr(cmd->words.w1));
                 } else {
@@ -1587,6 +2359,7 @@ static void gfx_run_dl(Gfx* cmd) {
                     --cmd; // increase after break
                 }
                 break;
+            }
             case (uint8_t)G_ENDDL:
                 return;
 #ifdef F3DEX_GBI_2
@@ -1722,6 +2495,15 @@ static void gfx_run_dl(Gfx* cmd) {
             case G_SETSCISSOR:
                 gfx_dp_set_scissor(C1(24, 2), C0(12, 12), C0(0, 12), C1(12, 12), C1(0, 12));
                 break;
+            case G_NOOP:
+                if ((cmd->words.w1 & ~0xffU) == G_TAG_LAYER) {
+                    gfx_dp_layer_tag(C1(0, 8));
+                } else if (cmd->words.w1 == G_TAG_STATIC_DL) {
+                    dl_cache.static_next = true;
+                } else if (cmd->words.w1 == G_TAG_BACKGROUND) {
+                    gfx_dp_background_tag();
+                }
+                break;
             case G_SETZIMG:
                 gfx_dp_set_z_image(seg_addr(cmd->words.w1));
                 break;
@@ -1746,6 +2528,7 @@ void gfx_get_dimensions(uint32_t *width, uint32_t *height) {
 void gfx_init(struct GfxWindowManagerAPI *wapi, struct GfxRenderingAPI *rapi, const char *game_name, bool start_in_fullscreen) {
     gfx_wapi = wapi;
     gfx_rapi = rapi;
+    vtx_cache_enabled = gfx_rapi->draw_triangles_indexed != NULL;
     gfx_wapi->init(game_name, start_in_fullscreen);
     gfx_wapi->get_dimensions(&gfx_current_dimensions.width, &gfx_current_dimensions.height);
     gfx_rapi->init();
@@ -1785,6 +2568,7 @@ void gfx_init(struct GfxWindowManagerAPI *wapi, struct GfxRenderingAPI *rapi, co
 }
 
 void gfx_shutdown(void) {
+    gfx_dl_cache_clear();
     if (gfx_rapi && gfx_rapi->shutdown) gfx_rapi->shutdown();
     if (gfx_wapi && gfx_wapi->shutdown) gfx_wapi->shutdown();
     gfx_rapi = NULL;
@@ -1821,10 +2605,14 @@ void gfx_run(Gfx *commands) {
     dropped_frame = false;
 
     profiling_reset();
+    ++dl_cache.frame;
     uint64_t t0 = tmr_ms();
     gfx_rapi->start_frame();
     gfx_run_dl(commands);
     gfx_flush();
+    gfx_flush_packets();
+    gfx_draw_pending_fill();
+    deferred.active = false;
     gfx_rapi->end_frame();
     gfx_wapi->swap_buffers_begin();
 
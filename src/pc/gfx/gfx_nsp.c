@@ -1,5 +1,6 @@
 #include <libndls.h>
 #include <SDL/SDL.h>
+#include <stdlib.h>
 
 #include "gfx_window_manager_api.h"
 #include "gfx_backend.h"
@@ -18,9 +19,29 @@ static uint32_t frames_prev = 0;
 
 static bool skip_frame = false;
 
+// if the LCD takes 320x240 565 as is, frames are presented by pointing it at one of these instead of lcd_blit
+static uint16_t *lcd_fb[2];
+static int lcd_back; // the one not on screen
+static void *lcd_old_base;
+static bool lcd_direct = false;
+
 void nsp_init(UNUSED const char *game_name, UNUSED bool start_in_fullscreen) {
     //set_cpu_speed(CPU_SPEED_150MHZ);
     lcd_init(SCR_320x240_565);
+
+    if (lcd_type() == SCR_320x240_565) {
+        lcd_fb[0] = calloc(SCREEN_WIDTH * SCREEN_HEIGHT, sizeof(uint16_t));
+        lcd_fb[1] = calloc(SCREEN_WIDTH * SCREEN_HEIGHT, sizeof(uint16_t));
+        if (lcd_fb[0] && lcd_fb[1]) {
+            lcd_old_base = REAL_SCREEN_BASE_ADDRESS;
+            REAL_SCREEN_BASE_ADDRESS = lcd_fb[0];
+            lcd_back = 1;
+            lcd_direct = true;
+        } else { // fall back to lcd_blit
+            free(lcd_fb[0]);
+            free(lcd_fb[1]);
+        }
+    }
 }
 
 void nsp_main_loop(void (*run_one_game_iter)(void)) {
@@ -96,9 +117,18 @@ void nsp_main_loop(void (*run_one_game_iter)(void)) {
                     "FPS, physical: %f\n"
                     "FPS, virtual: %f\n"
                     "^ This includes frames skipped\n"
-                    "Tris this frame: %d\n"
-                    "Frames skipped: %d\n",
-                    tmr_ms(), tFlushing, tFullRender, tDelta, fps, fps * (to_skip + 1), numTris, to_skip);
+                    "Tris/verts this frame: %d/%d\n"
+                    "Tris rejected/occluded: %d/%d\n"
+                    "Sorted batches: %d\n"
+                    "Verts reused: %d\n"
+                    "Frames skipped: %d\n"
+                    "Tex hits/misses: %d/%d\n"
+                    "Tex evictions, entries/memory: %d/%d\n"
+                    "Tex KB resident: %d\n"
+                    "Floor memo hits/misses: %d/%d\n",
+                    tmr_ms(), tFlushing, tFullRender, tDelta, fps, fps * (to_skip + 1), numTris, numVerts, numRejectedTris, numOccludedTris, numPackets, numReusedVerts, to_skip,
+                    texHits, texMisses, texEntryEvictions, texEvictions, texBytes / 1024,
+                    floorMemoHits, floorMemoMisses);
 
                 wait_key_pressed();
                 nio_free(console);
@@ -122,6 +152,11 @@ void nsp_get_dimensions(uint32_t *width, uint32_t *height) {
 }
 
 bool nsp_start_frame(void) {
+#ifdef SOFTRAST_RGB565
+    // at full resolution the renderer can draw right into the framebuffer that goes on screen next
+    if (lcd_direct && !config120pMode && !skip_frame)
+        gfx_soft_set_output(lcd_fb[lcd_back]);
+#endif
     return !skip_frame; // (current_frame % 4) == 0; //
 }
 
@@ -134,8 +169,28 @@ void nsp_swap_buffers_begin(void) {
 }
 
 void nsp_swap_buffers_end(void) {
-    static uint16_t buffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+    static uint16_t buffer[SCREEN_WIDTH * SCREEN_HEIGHT] ALIGNED8;
+
+    // fill the framebuffer that is not on screen if we can flip, or a buffer for lcd_blit otherwise
+    uint16_t *dst = lcd_direct ? lcd_fb[lcd_back] : buffer;
 
+#ifdef SOFTRAST_RGB565
+    // the renderer already outputs what the LCD takes
+    if (config120pMode) {
+        // spread 160 * 120 img to fill whole screen, a doubled pixel fits in a single 32-bit store
+        uint32_t *row = (uint32_t *)dst;
+        const uint16_t *img = gfx_output;
+        for (int y = 0; y < HALF_HEIGHT; y++, row += SCREEN_WIDTH, img += HALF_WIDTH) { // two rows at a time
+            for (int x = 0; x < HALF_WIDTH; x++) {
+                const uint32_t c32 = img[x] * 0x10001u;
+                row[x] = c32;
+                row[x + HALF_WIDTH] = c32; // the row below
+            }
+        }
+    } else if (!lcd_direct) {
+        dst = gfx_output;
+    } // else the frame was drawn into dst in the first place
+#else
     // populate buffer according to configuration
     if (config120pMode) {
         // spread 160 * 120 img to fill whole screen, not just top left quarter
@@ -145,21 +200,27 @@ void nsp_swap_buffers_end(void) {
                 uint16_t c16 = c4444_to_c565(gfx_output[img_pix]);
                 int index = i + col;
 
-                buffer[index] = c16;
-                buffer[index + 1] = c16;
-                buffer[index + SCREEN_WIDTH] = c16;
-                buffer[index + SCREEN_WIDTH + 1] =  c16; // expand single pixel to 2*2 square, towards bottom right
+                dst[index] = c16;
+                dst[index + 1] = c16;
+                dst[index + SCREEN_WIDTH] = c16;
+                dst[index + SCREEN_WIDTH + 1] =  c16; // expand single pixel to 2*2 square, towards bottom right
             }
         }
     } else {
         for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
             uint32_t c32 = gfx_output[i];
 
-            buffer[i] = c4444_to_c565(c32);
+            dst[i] = c4444_to_c565(c32);
         }
     }
+#endif
 
-    lcd_blit(buffer, SCR_320x240_565);
+    if (lcd_direct) {
+        REAL_SCREEN_BASE_ADDRESS = dst;
+        lcd_back ^= 1;
+    } else {
+        lcd_blit(dst, SCR_320x240_565);
+    }
 }
 
 // unimplemented windowing features
@@ -179,6 +240,13 @@ double nsp_get_time(void) {
 }
 
 void nsp_shutdown(void) {
+    if (lcd_direct) {
+        gfx_soft_set_output(NULL);
+        REAL_SCREEN_BASE_ADDRESS = lcd_old_base;
+        free(lcd_fb[0]);
+        free(lcd_fb[1]);
+        lcd_direct = false;
+    }
     lcd_init(SCR_TYPE_INVALID);
     //tmr_shutdown(); // BANDAID FIX: attempting to restore old timer soft locks calc. not required but could be problematic? 
 }
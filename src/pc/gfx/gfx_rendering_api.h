@@ -19,6 +19,7 @@ struct GfxRenderingAPI {
     uint32_t (*new_texture)(void);
     void (*select_texture)(int tile, uint32_t texture_id);
     void (*upload_texture)(const uint8_t *rgba32_buf, int width, int height);
+    bool (*upload_texture_native)(const uint8_t *data, int width, int height, uint32_t fmt, uint32_t siz, const uint8_t *tlut); // optional; false if fmt/siz has to be uploaded as RGBA32
     void (*set_sampler_parameters)(int sampler, bool linear_filter, uint32_t cms, uint32_t cmt);
     void (*set_depth_test)(bool depth_test);
     void (*set_depth_mask)(bool z_upd);
@@ -27,6 +28,7 @@ struct GfxRenderingAPI {
     void (*set_scissor)(int x, int y, int width, int height);
     void (*set_use_alpha)(bool use_alpha);
     void (*draw_triangles)(fix64 buf_vbo[], size_t buf_vbo_len, size_t buf_vbo_num_tris);
+    void (*draw_triangles_indexed)(fix64 buf_vbo[], size_t buf_vbo_len, size_t buf_vbo_num_verts, const uint16_t indices[], size_t num_tris); // optional; 3 indices into buf_vbo per triangle
     void (*init)(void);
     void (*on_resize)(void);
     void (*start_frame)(void);
@@ -35,6 +37,8 @@ struct GfxRenderingAPI {
     void (*fill_rect)(int x0, int y0, int x1, int y1, const uint8_t *rgba); // optional; fill 2d rect with color
     void (*tex_rect)(int x0, int y0, int x1, int y1, const float u0, const float v0, const float dudx, const float dvdy, const uint8_t *rgba); // optional; draw 2d rect textured with tile 0
     void (*set_fog_color)(const uint8_t *rgb); // optional; set global fog color
+    void (*delete_texture)(uint32_t texture_id); // optional; release the texture's storage, the id stays valid
+    bool (*texture_resident)(uint32_t texture_id); // optional; false if the texture was evicted and must be uploaded again
     void (*shutdown)(void); // optional
 };
 
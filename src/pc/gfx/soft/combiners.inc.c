@@ -0,0 +1,148 @@
+// combiners.inc.c - color combiners, included by gfx_backend.c once per rasterizer precision
+// the includer defines:
+//   CC_PROP             vertex property type (fix64 or fix32)
+//   CC_FN(name)         name mangling for this instance
+//   CC_CHAN(p, w)       8-bit color channel from a property premultiplied by 1/w
+//   CC_TEXC(p, w)       texture coordinate from a property premultiplied by 1/w
+//   CC_SAMPLE(t, u, v)  nearest texture sample at CC_TEXC coordinates
+
+static inline Color4 CC_FN(combine_rgb)(const CC_PROP w, const CC_PROP *props) { // 3
+    return (Color4){ { .r = CC_CHAN(props[0], w),
+                       .g = CC_CHAN(props[1], w),
+                       .b = CC_CHAN(props[2], w),
+                       .a = 0xFF } };
+}
+
+static inline Color4 CC_FN(combine_rgba)(const CC_PROP w, const CC_PROP *props) { // 4
+    return (Color4){ { .r = CC_CHAN(props[0], w),
+                       .g = CC_CHAN(props[1], w),
+                       .b = CC_CHAN(props[2], w),
+                       .a = CC_CHAN(props[3], w) } };
+}
+
+static inline Color4 CC_FN(combine_fog_rgb)(const CC_PROP w, const CC_PROP *props) { // 5
+    const uint8_t fog = CC_CHAN(props[0], w);
+    const Color4 c = (Color4){ { .r = CC_CHAN(props[1], w),
+                                 .g = CC_CHAN(props[2], w),
+                                 .b = CC_CHAN(props[3], w),
+                                 .a = 0xFF } };
+    return rgba_blend(fog_color, c, fog);
+}
+
+static inline Color4 CC_FN(combine_fog_rgba)(const CC_PROP w, const CC_PROP *props) {
+    const uint8_t fog = CC_CHAN(props[0], w);
+    const Color4 c = (Color4){ { .r = CC_CHAN(props[1], w),
+                                 .g = CC_CHAN(props[2], w),
+                                 .b = CC_CHAN(props[3], w),
+                                 .a = CC_CHAN(props[4], w) } };
+    return rgba_blend(fog_color, c, fog);
+}
+
+static inline Color4 CC_FN(combine_rgba_rgba)(const CC_PROP w, const CC_PROP *props) {
+    const Color4 ca = (Color4){ { .r = CC_CHAN(props[0], w),
+                                  .g = CC_CHAN(props[1], w),
+                                  .b = CC_CHAN(props[2], w),
+                                  .a = CC_CHAN(props[3], w) } };
+    const Color4 cb = (Color4){ { .r = CC_CHAN(props[4], w),
+                                  .g = CC_CHAN(props[5], w),
+                                  .b = CC_CHAN(props[6], w),
+                                  .a = CC_CHAN(props[7], w) } };
+    return rgba_modulate(ca, cb);
+}
+
+static inline Color4 CC_FN(combine_tex)(const CC_PROP w, const CC_PROP *props) {
+    return CC_SAMPLE(cur_tex[0], CC_TEXC(props[0], w), CC_TEXC(props[1], w));
+}
+
+static inline Color4 CC_FN(combine_tex_fog)(const CC_PROP w, const CC_PROP *props) {
+    const Color4 tc = CC_SAMPLE(cur_tex[0], CC_TEXC(props[0], w), CC_TEXC(props[1], w));
+    const uint8_t fog = CC_CHAN(props[2], w);
+    return rgba_blend(fog_color, tc, fog);
+}
+
+static inline Color4 CC_FN(combine_tex_rgb)(const CC_PROP w, const CC_PROP *props) {
+    const Color4 tc = CC_SAMPLE(cur_tex[0], CC_TEXC(props[0], w), CC_TEXC(props[1], w));
+    const Color4 cc = (Color4){ { .r = CC_CHAN(props[2], w),
+                                  .g = CC_CHAN(props[3], w),
+                                  .b = CC_CHAN(props[4], w),
+                                  .a = 0xFF } };
+    return rgba_modulate(tc, cc);
+}
+
+static inline Color4 CC_FN(combine_tex_fog_rgb)(const CC_PROP w, const CC_PROP *props) {
+    const Color4 tc = CC_SAMPLE(cur_tex[0], CC_TEXC(props[0], w), CC_TEXC(props[1], w));
+    const uint8_t fog = CC_CHAN(props[2], w);
+    const Color4 cc = (Color4){ { .r = CC_CHAN(props[3], w),
+                                  .g = CC_CHAN(props[4], w),
+                                  .b = CC_CHAN(props[5], w),
+                                  .a = 0xFF } };
+    return rgba_blend(fog_color, rgba_modulate(tc, cc), fog);
+}
+
+static inline Color4 CC_FN(combine_tex_rgb_decal)(const CC_PROP w, const CC_PROP *props) {
+    const Color4 tc = CC_SAMPLE(cur_tex[0], CC_TEXC(props[0], w), CC_TEXC(props[1], w));
+    const Color4 cc = (Color4){ { .r = CC_CHAN(props[2], w),
+                                  .g = CC_CHAN(props[3], w),
+                                  .b = CC_CHAN(props[4], w),
+                                  .a = 0xFF } };
+    return rgba_blend(tc, cc, tc.a);
+}
+
+static inline Color4 CC_FN(combine_tex_rgba)(const CC_PROP w, const CC_PROP *props) {
+    const Color4 tc = CC_SAMPLE(cur_tex[0], CC_TEXC(props[0], w), CC_TEXC(props[1], w));
+    const Color4 cc = (Color4){ { .r = CC_CHAN(props[2], w),
+                                  .g = CC_CHAN(props[3], w),
+                                  .b = CC_CHAN(props[4], w),
+                                  .a = CC_CHAN(props[5], w) } };
+    return rgba_modulate(tc, cc);
+}
+
+static inline Color4 CC_FN(combine_tex_rgba_texa)(const CC_PROP w, const CC_PROP *props) {
+    const Color4 tc = CC_SAMPLE(cur_tex[0], CC_TEXC(props[0], w), CC_TEXC(props[1], w));
+    const Color4 cc = (Color4){ { .r = CC_CHAN(props[2], w),
+                                  .g = CC_CHAN(props[3], w),
+                                  .b = CC_CHAN(props[4], w),
+                                  .a = 0xFF } };
+    return rgba_modulate(tc, cc);
+}
+
+static inline Color4 CC_FN(combine_tex_fog_rgba)(const CC_PROP w, const CC_PROP *props) {
+    const Color4 tc = CC_SAMPLE(cur_tex[0], CC_TEXC(props[0], w), CC_TEXC(props[1], w));
+    const uint8_t fog = CC_CHAN(props[2], w);
+    const Color4 cc = (Color4){ { .r = CC_CHAN(props[3], w),
+                                  .g = CC_CHAN(props[4], w),
+                                  .b = CC_CHAN(props[5], w),
+                                  .a = CC_CHAN(props[6], w) } };
+    return rgba_blend(fog_color, rgba_modulate(tc, cc), fog);
+}
+
+static inline Color4 CC_FN(combine_tex_rgba_decal)(const CC_PROP w, const CC_PROP *props) {
+    const Color4 tc = CC_SAMPLE(cur_tex[0], CC_TEXC(props[0], w), CC_TEXC(props[1], w));
+    const Color4 cc = (Color4){ { .r = CC_CHAN(props[2], w),
+                                  .g = CC_CHAN(props[3], w),
+                                  .b = CC_CHAN(props[4], w),
+                                  .a = CC_CHAN(props[5], w) } };
+    return rgba_blend(tc, cc, tc.a);
+}
+
+static inline Color4 CC_FN(combine_tex_rgb_rgb)(const CC_PROP w, const CC_PROP *props) {
+    const Color4 tc = CC_SAMPLE(cur_tex[0], CC_TEXC(props[0], w), CC_TEXC(props[1], w));
+    const Color4 cc1 = (Color4){ { .r = CC_CHAN(props[2], w),
+                                   .g = CC_CHAN(props[3], w),
+                                   .b = CC_CHAN(props[4], w),
+                                   .a = 0xFF } };
+    const Color4 cc2 = (Color4){ { .r = CC_CHAN(props[5], w),
+                                   .g = CC_CHAN(props[6], w),
+                                   .b = CC_CHAN(props[7], w),
+                                   .a = 0xFF } };
+    return rgba_lerp(cc2, cc1, tc.r);
+}
+
+static inline Color4 CC_FN(combine_tex_tex_rgba)(const CC_PROP w, const CC_PROP *props) {
+    const CC_PROP u = CC_TEXC(props[0], w);
+    const CC_PROP v = CC_TEXC(props[1], w);
+    const Color4 tc1 = CC_SAMPLE(cur_tex[0], u, v);
+    const Color4 tc2 = CC_SAMPLE(cur_tex[1], u, v);
+    const uint8_t r = CC_CHAN(props[2], w);
+    return rgba_lerp(tc1, tc2, r);
+}
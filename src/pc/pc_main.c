@@ -5,6 +5,7 @@
 #include "sm64.h"
 
 #include "game/memory.h"
+#include "engine/surface_load.h"
 #include "audio/external.h"
 
 #include "gfx/gfx_frontend.h"
@@ -66,7 +67,8 @@ static void on_fullscreen_changed(UNUSED bool is_now_fullscreen) {
 }
 
 int main(UNUSED int argc, char *argv[]) {
-    static u64 pool[0x165000 / 8 / 4 * sizeof(void *)];
+    // grown by what the surface pools take beyond the original 7000 nodes (see alloc_surface_pools)
+    static u64 pool[(0x165000 / 4 * sizeof(void *) + SURFACE_POOLS_EXTRA_SIZE) / 8];
     main_pool_init(pool, pool + sizeof(pool) / sizeof(pool[0]));
     gEffectsMemoryPool = mem_pool_init(0x4000, MEMORY_POOL_LEFT);
 
@@ -1,9 +1,30 @@
 int numTris = 0;
+int numVerts = 0;          // vertices projected and sent to the backend, this frame
+int numRejectedTris = 0;   // triangles culled or too small to cover a pixel, this frame
+int numPackets = 0;        // batches drawn from the deferred layers, this frame
+int numReusedVerts = 0;    // vertices of recorded display lists that skipped the transform, this frame
+int numOccludedTris = 0;   // triangles found to be hidden by the coarse depth buffer, this frame
 int tFlushing = 0;
 int tFullRender = 0;
+int texHits = 0;           // texture lookups that needed no import, this frame
+int texMisses = 0;         // texture lookups that had to import the texture, this frame
+int texEvictions = 0;      // textures dropped from the backend's texture memory so far
+int texEntryEvictions = 0; // frontend texture cache entries reused for other textures so far
+int texBytes = 0;          // texture memory bytes in use
+int floorMemoHits = 0;     // find_floor calls that reused the static floor of an earlier call, this frame
+int floorMemoMisses = 0;   // find_floor calls that walked the static floors, this frame
 
 void profiling_reset(void) {
     numTris = 0;
+    numVerts = 0;
+    numRejectedTris = 0;
+    numPackets = 0;
+    numReusedVerts = 0;
+    numOccludedTris = 0;
     tFlushing = 0;
     tFullRender = 0;
+    texHits = 0;
+    texMisses = 0;
+    floorMemoHits = 0;
+    floorMemoMisses = 0;
 }
\ No newline at end of file
@@ -2,8 +2,20 @@
 #define PROFILING_H
 
 extern int numTris;
+extern int numVerts;
+extern int numRejectedTris;
+extern int numPackets;
+extern int numReusedVerts;
+extern int numOccludedTris;
 extern int tFlushing;
 extern int tFullRender;
+extern int texHits;
+extern int texMisses;
+extern int texEvictions;
+extern int texEntryEvictions;
+extern int texBytes;
+extern int floorMemoHits;
+extern int floorMemoMisses;
 
 void profiling_reset(void);
 
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""
+Reports how long the static surface lists of the collision spatial partition get for each
+level area, at several partition resolutions, to help pick NUM_CELLS (see the COLLISION_CELLS
+Makefile option).
+
+Usage: tools/collision_histogram.py [--cells 16,32,64] [collision.inc.c ...]
+
+Without files, every levels/*/areas/*/collision.inc.c is read. The surfaces are put in cells
+the same way add_surface() in src/engine/surface_load.c does, including its 50 unit border.
+"""
+
+import argparse
+import glob
+import math
+import re
+import sys
+
+LEVEL_BOUNDARY_MAX = 0x2000
+CELL_BORDER = 50
+BUCKETS = [8, 16, 32, 64, 128, 256]
+KINDS = ["floors", "ceils", "walls"]
+
+MACRO_RE = re.compile(r"\b(COL_\w+)\(([^()]*)\)")
+
+
+def parse_blocks(path):
+    """Yields (name, triangles) for each COL_INIT ... COL_END block of a collision file."""
+    with open(path) as f:
+        text = f.read()
+    # drop comments so commented out macros don't count
+    text = re.sub(r"//[^\n]*|/\*.*?\*/", "", text, flags=re.S)
+    arrays = [(m.start(), m.group(1)) for m in re.finditer(r"Collision\s+(\w+)\s*\[\]", text)]
+
+    vertices, tris, start = [], [], None
+    for m in MACRO_RE.finditer(text):
+        macro, args = m.group(1), [a.strip() for a in m.group(2).split(",") if a.strip()]
+        if macro == "COL_INIT":
+            vertices, tris, start = [], [], m.start()
+        elif macro == "COL_VERTEX":
+            vertices.append(tuple(int(a, 0) for a in args))
+        elif macro in ("COL_TRI", "COL_TRI_SPECIAL"):
+            tris.append(tuple(vertices[int(a, 0)] for a in args[:3]))
+        elif macro == "COL_END" and start is not None:
+            names = [name for pos, name in arrays if pos < start]
+            yield (names[-1] if names else "?"), tris
+            start = None
+
+
+def lower_cell_index(coord, cell_size, num_cells):
+    coord = max(coord + LEVEL_BOUNDARY_MAX, 0)
+    index = coord // cell_size
+    if coord % cell_size < CELL_BORDER:
+        index -= 1
+    return max(index, 0)
+
+
+def upper_cell_index(coord, cell_size, num_cells):
+    coord = max(coord + LEVEL_BOUNDARY_MAX, 0)
+    index = coord // cell_size
+    if coord % cell_size > cell_size - CELL_BORDER:
+        index += 1
+    return min(index, num_cells - 1)
+
+
+def surface_kind(tri):
+    (x1, y1, z1), (x2, y2, z2), (x3, y3, z3) = tri
+    nx = (y2 - y1) * (z3 - z2) - (z2 - z1) * (y3 - y2)
+    ny = (z2 - z1) * (x3 - x2) - (x2 - x1) * (z3 - z2)
+    nz = (x2 - x1) * (y3 - y2) - (y2 - y1) * (x3 - x2)
+    mag = math.sqrt(nx * nx + ny * ny + nz * nz)
+    if mag < 0.0001:
+        return None
+    ny /= mag
+    if ny > 0.01:
+        return 0
+    if ny < -0.01:
+        return 1
+    return 2
+
+
+def partition(tris, num_cells):
+    cell_size = 2 * LEVEL_BOUNDARY_MAX // num_cells
+    lengths = [[[0] * num_cells for _ in range(num_cells)] for _ in KINDS]
+    for tri in tris:
+        kind = surface_kind(tri)
+        if kind is None:
+            continue
+        xs = [v[0] for v in tri]
+        zs = [v[2] for v in tri]
+        for cz in range(lower_cell_index(min(zs), cell_size, num_cells), upper_cell_index(max(zs), cell_size, num_cells) + 1):
+            for cx in range(lower_cell_index(min(xs), cell_size, num_cells), upper_cell_index(max(xs), cell_size, num_cells) + 1):
+                lengths[kind][cz][cx] += 1
+    return lengths
+
+
+def histogram(values):
+    """Counts cells per list length bucket: empty, then up to each of BUCKETS, then longer."""
+    counts = [0] * (len(BUCKETS) + 2)
+    for v in values:
+        if v == 0:
+            counts[0] += 1
+        else:
+            counts[next((i + 1 for i, hi in enumerate(BUCKETS) if v <= hi), len(BUCKETS) + 1)] += 1
+    return counts
+
+
+def bucket_names():
+    lows = [1] + [hi + 1 for hi in BUCKETS]
+    return ["0"] + ["%d-%d" % (lo, hi) for lo, hi in zip(lows, BUCKETS)] + ["%d+" % lows[-1]]
+
+
+def report(label, tris, cells_list):
+    print("%s: %d triangles" % (label, len(tris)))
+    print("  %5s %6s  %-6s %5s %6s  %s" % ("cells", "nodes", "list", "max", "mean", "  ".join("%7s" % n for n in bucket_names())))
+    for num_cells in cells_list:
+        lengths = partition(tris, num_cells)
+        nodes = sum(sum(map(sum, k)) for k in lengths)
+        for kind, name in enumerate(KINDS):
+            flat = [n for row in lengths[kind] for n in row]
+            used = [n for n in flat if n]
+            mean = sum(used) / len(used) if used else 0
+            print("  %5s %6s  %-6s %5d %6.1f  %s" % (
+                num_cells if kind == 0 else "", nodes if kind == 0 else "", name, max(flat), mean,
+                "  ".join("%7d" % c for c in histogram(flat))))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Static collision list lengths per partition resolution")
+    parser.add_argument("--cells", default="16,32,64", help="comma separated cell counts per axis")
+    parser.add_argument("files", nargs="*")
+    args = parser.parse_args()
+
+    cells_list = [int(c) for c in args.cells.split(",")]
+    for c in cells_list:
+        if c & (c - 1) or c > 2 * LEVEL_BOUNDARY_MAX:
+            sys.exit("cell count %d is not a power of two" % c)
+
+    files = args.files or sorted(glob.glob("levels/*/areas/*/collision.inc.c"))
+    for path in files:
+        for name, tris in parse_blocks(path):
+            report("%s (%s)" % (path, name), tris, cells_list)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,379 @@
+// math_util_fixed_check.c - host check of the fixed point functions in src/engine/math_util_fixed.inc.c
+// against the float code they replace. Built by "make -C tools check", not by the game build.
+//
+// math_util.c is included without FIXED_MATH_UTIL, so its functions are the float versions, and the
+// fixed point ones are included next to them. Every output is compared with a double precision
+// reference and has to stay within the error its fixed point format allows. Inputs at the edges of
+// the handled ranges check that the functions fall back to the float code where they should.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "math_util.c"
+#include "math_util_fixed.inc.c"
+
+#define NUM_SAMPLES 200000
+
+// the rest of math_util.c needs these, the checks don't call it
+Vec3f gVec3fZero = { 0.0f, 0.0f, 0.0f };
+
+void guMtxF2L(UNUSED float mf[4][4], UNUSED Mtx *m) {
+}
+
+f32 find_floor(UNUSED f32 x, UNUSED f32 y, UNUSED f32 z, struct Surface **pfloor) {
+    *pfloor = NULL;
+    return -11000.0f;
+}
+
+f32 find_floor_height_and_data(UNUSED f32 x, UNUSED f32 y, UNUSED f32 z, struct FloorGeometry **floorGeo) {
+    *floorGeo = NULL;
+    return -11000.0f;
+}
+
+static int sFailures;
+
+static unsigned int sRandState = 0x12345678;
+
+static unsigned int rand_u32(void) {
+    sRandState ^= sRandState << 13;
+    sRandState ^= sRandState >> 17;
+    sRandState ^= sRandState << 5;
+    return sRandState;
+}
+
+/// uniform in (-range, range)
+static f32 rand_f32(f32 range) {
+    return (f32) (((double) rand_u32() / 4294967296.0 * 2.0 - 1.0) * range);
+}
+
+/// random sign, magnitude log-uniform between 2^lo and 2^hi
+static f32 rand_f32_log(int lo, int hi) {
+    f32 f = (f32) exp2(lo + (double) rand_u32() / 4294967296.0 * (hi - lo));
+    return (rand_u32() & 1) ? -f : f;
+}
+
+/// the largest float below 2^bits
+static f32 below_pow2(int bits) {
+    return nextafterf((f32) exp2(bits), 0.0f);
+}
+
+struct ErrorStats {
+    const char *name;
+    double worst; // largest error / allowed error
+    long samples;
+};
+
+static void check_error(struct ErrorStats *stats, double got, double want, double allowed) {
+    double ratio = fabs(got - want) / allowed;
+
+    if (!(ratio <= stats->worst)) { // also catches NaN
+        stats->worst = ratio;
+    }
+    stats->samples++;
+}
+
+static void report(struct ErrorStats *stats) {
+    int ok = stats->worst <= 1.0;
+
+    printf("%-34s %8ld outputs, worst error %.3f of allowed  %s\n", stats->name, stats->samples,
+           stats->worst, ok ? "ok" : "FAIL");
+    if (!ok) {
+        sFailures++;
+    }
+}
+
+static void expect(int cond, const char *what) {
+    if (!cond) {
+        printf("FAIL: %s\n", what);
+        sFailures++;
+    }
+}
+
+static void rand_matrix(Mat4 m, f32 entryRange, f32 posRange) {
+    int i;
+    int j;
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            m[i][j] = rand_f32(entryRange);
+        }
+        m[i][3] = 0;
+        m[3][i] = rand_f32(posRange);
+    }
+    m[3][3] = 1;
+}
+
+static void check_mtxf_mul_sample(struct ErrorStats *stats, Mat4 a, Mat4 b) {
+    Mat4 dest;
+    int i;
+    int j;
+    int k;
+
+    if (!mtxf_mul_fixed(dest, a, b)) {
+        expect(FALSE, "mtxf_mul_fixed rejected in range inputs");
+        return;
+    }
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < 3; j++) {
+            double want = (i == 3) ? b[3][j] : 0.0;
+            double allowed = (i == 3) ? exp2(-POS_FRAC) : 0.0;
+
+            for (k = 0; k < 3; k++) {
+                want += (double) a[i][k] * b[k][j];
+                if (i == 3) {
+                    allowed += exp2(-POS_FRAC) * fabs(b[k][j]) + exp2(-MTX_FRAC) * fabs(a[i][k]);
+                } else {
+                    allowed += exp2(-MTX_FRAC) * (fabs(a[i][k]) + fabs(b[k][j]));
+                }
+            }
+            // the result keeps 23 of its mantissa bits
+            allowed += exp2(-22) * fabs(want) + 1e-30;
+            check_error(stats, dest[i][j], want, allowed);
+        }
+    }
+}
+
+static void check_mtxf_mul(void) {
+    struct ErrorStats stats = { "mtxf_mul_fixed", 0, 0 };
+    f32 big = below_pow2(MTX_RANGE);
+    f32 far = below_pow2(POS_RANGE);
+    Mat4 a;
+    Mat4 b;
+    Mat4 dest;
+    int n;
+    int i;
+    int j;
+
+    for (n = 0; n < NUM_SAMPLES; n++) {
+        rand_matrix(a, (n & 1) ? 2.0f : big, (n & 2) ? 1000.0f : far);
+        rand_matrix(b, (n & 4) ? 2.0f : big, (n & 8) ? 1000.0f : far);
+        check_mtxf_mul_sample(&stats, a, b);
+    }
+
+    // every entry at the top of the range with the same sign, the largest sums there are
+    for (n = 0; n < 2; n++) {
+        for (i = 0; i < 3; i++) {
+            for (j = 0; j < 3; j++) {
+                a[i][j] = b[i][j] = n ? -big : big;
+            }
+            a[3][i] = b[3][i] = n ? -far : far;
+        }
+        check_mtxf_mul_sample(&stats, a, b);
+    }
+    report(&stats);
+
+    // just out of range, or not finite: the float code has to take over
+    rand_matrix(a, 1.0f, 100.0f);
+    rand_matrix(b, 1.0f, 100.0f);
+    a[1][2] = exp2f(MTX_RANGE);
+    expect(!mtxf_mul_fixed(dest, a, b), "mtxf_mul_fixed takes an entry of 2^MTX_RANGE");
+    a[1][2] = -exp2f(MTX_RANGE);
+    expect(!mtxf_mul_fixed(dest, a, b), "mtxf_mul_fixed takes an entry of -2^MTX_RANGE");
+    a[1][2] = 0.5f;
+    b[3][1] = exp2f(POS_RANGE);
+    expect(!mtxf_mul_fixed(dest, a, b), "mtxf_mul_fixed takes a translation of 2^POS_RANGE");
+    b[3][1] = 1.0f;
+    b[0][0] = INFINITY;
+    expect(!mtxf_mul_fixed(dest, a, b), "mtxf_mul_fixed takes an infinite entry");
+    b[0][0] = NAN;
+    expect(!mtxf_mul_fixed(dest, a, b), "mtxf_mul_fixed takes a NaN entry");
+}
+
+static void check_mtxf_billboard(void) {
+    struct ErrorStats stats = { "mtxf_billboard_fixed", 0, 0 };
+    Mat4 mtx;
+    Mat4 dest;
+    Mat4 ref;
+    Vec3f pos;
+    s16 angle;
+    int n;
+    int i;
+    int j;
+
+    for (n = 0; n < NUM_SAMPLES; n++) {
+        rand_matrix(mtx, (n & 1) ? 1.0f : below_pow2(MTX_RANGE), (n & 2) ? 1000.0f : below_pow2(POS_RANGE));
+        for (i = 0; i < 3; i++) {
+            pos[i] = (n & 4) ? rand_f32(8000.0f) : rand_f32(below_pow2(POS_RANGE));
+        }
+        angle = rand_u32();
+        if (!mtxf_billboard_fixed(dest, mtx, pos, angle)) {
+            expect(FALSE, "mtxf_billboard_fixed rejected in range inputs");
+            continue;
+        }
+        mtxf_billboard(ref, mtx, pos, angle);
+        for (i = 0; i < 3; i++) {
+            for (j = 0; j < 4; j++) {
+                expect(dest[i][j] == ref[i][j], "mtxf_billboard_fixed rotation differs");
+            }
+        }
+        for (j = 0; j < 3; j++) {
+            double want = mtx[3][j];
+            double allowed = exp2(-POS_FRAC);
+
+            for (i = 0; i < 3; i++) {
+                want += (double) mtx[i][j] * pos[i];
+                allowed += exp2(-MTX_FRAC) * fabs(pos[i]) + exp2(-POS_FRAC) * fabs(mtx[i][j]);
+            }
+            allowed += exp2(-22) * fabs(want) + 1e-30;
+            check_error(&stats, dest[3][j], want, allowed);
+        }
+    }
+    report(&stats);
+
+    rand_matrix(mtx, 1.0f, 100.0f);
+    pos[0] = pos[1] = pos[2] = 10.0f;
+    pos[2] = exp2f(POS_RANGE);
+    expect(!mtxf_billboard_fixed(dest, mtx, pos, 0), "mtxf_billboard_fixed takes a position of 2^POS_RANGE");
+    pos[2] = NAN;
+    expect(!mtxf_billboard_fixed(dest, mtx, pos, 0), "mtxf_billboard_fixed takes a NaN position");
+    pos[2] = 10.0f;
+    mtx[3][0] = -INFINITY;
+    expect(!mtxf_billboard_fixed(dest, mtx, pos, 0), "mtxf_billboard_fixed takes an infinite translation");
+}
+
+static void check_mtxf_mul_vec3s(void) {
+    struct ErrorStats stats = { "mtxf_mul_vec3s_fixed", 0, 0 };
+    Mat4 mtx;
+    Vec3s v;
+    Vec3s got;
+    int n;
+    int i;
+    int j;
+
+    for (n = 0; n < NUM_SAMPLES; n++) {
+        rand_matrix(mtx, (n & 1) ? 1.5f : 4.0f, (n & 2) ? 1000.0f : 8000.0f);
+        for (i = 0; i < 3; i++) {
+            v[i] = got[i] = (s16) (rand_u32() % 4001) - 2000;
+        }
+        if (!mtxf_mul_vec3s_fixed(mtx, got)) {
+            expect(FALSE, "mtxf_mul_vec3s_fixed rejected in range inputs");
+            continue;
+        }
+        for (j = 0; j < 3; j++) {
+            double want = mtx[3][j];
+            double allowed = exp2(-POS_FRAC);
+
+            for (i = 0; i < 3; i++) {
+                want += (double) v[i] * mtx[i][j];
+                allowed += exp2(-MTX_FRAC) * abs(v[i]);
+            }
+            // off by one where the truncation lands on the other side of an integer
+            check_error(&stats, got[j], trunc(want), 1.0 + allowed);
+        }
+    }
+    report(&stats);
+
+    rand_matrix(mtx, 1.0f, 100.0f);
+    mtx[2][2] = exp2f(MTX_RANGE);
+    expect(!mtxf_mul_vec3s_fixed(mtx, v), "mtxf_mul_vec3s_fixed takes an entry of 2^MTX_RANGE");
+}
+
+static void check_rotations(void) {
+    struct ErrorStats zxy = { "mtxf_rotate_zxy_and_translate_fixed", 0, 0 };
+    struct ErrorStats xyz = { "mtxf_rotate_xyz_and_translate_fixed", 0, 0 };
+    Mat4 dest;
+    Mat4 ref;
+    Vec3f t;
+    Vec3s r;
+    int n;
+    int i;
+    int j;
+
+    for (n = 0; n < NUM_SAMPLES; n++) {
+        for (i = 0; i < 3; i++) {
+            t[i] = rand_f32(20000.0f);
+            r[i] = rand_u32();
+        }
+        // the float code on the same table values is the reference, the products only lose the
+        // 2^-30 of the conversions and the float rounding
+        mtxf_rotate_zxy_and_translate_fixed(dest, t, r);
+        mtxf_rotate_zxy_and_translate(ref, t, r);
+        for (i = 0; i < 4; i++) {
+            for (j = 0; j < 4; j++) {
+                check_error(&zxy, dest[i][j], ref[i][j], exp2(-22) * (1.0 + fabs(ref[i][j])));
+            }
+        }
+        mtxf_rotate_xyz_and_translate_fixed(dest, t, r);
+        mtxf_rotate_xyz_and_translate(ref, t, r);
+        for (i = 0; i < 4; i++) {
+            for (j = 0; j < 4; j++) {
+                check_error(&xyz, dest[i][j], ref[i][j], exp2(-22) * (1.0 + fabs(ref[i][j])));
+            }
+        }
+    }
+    report(&zxy);
+    report(&xyz);
+}
+
+static void check_vec3f_normalize(void) {
+    struct ErrorStats stats = { "vec3f_normalize_fixed", 0, 0 };
+    Vec3f v;
+    Vec3f got;
+    double len;
+    int n;
+    int i;
+
+    for (n = 0; n < NUM_SAMPLES; n++) {
+        for (i = 0; i < 3; i++) {
+            v[i] = got[i] = (n & 1) ? rand_f32(1000.0f) : rand_f32_log(-60, 60);
+        }
+        if (n % 7 == 0) {
+            v[n % 3] = got[n % 3] = 0.0f;
+        }
+        if (!vec3f_normalize_fixed(got)) {
+            expect(FALSE, "vec3f_normalize_fixed rejected a finite nonzero vector");
+            continue;
+        }
+        len = sqrt((double) v[0] * v[0] + (double) v[1] * v[1] + (double) v[2] * v[2]);
+        for (i = 0; i < 3; i++) {
+            // the components and 1 / length keep about 21 bits
+            check_error(&stats, got[i], v[i] / len, exp2(-20));
+        }
+    }
+    report(&stats);
+
+    v[0] = v[1] = v[2] = 0.0f;
+    expect(!vec3f_normalize_fixed(v), "vec3f_normalize_fixed takes a zero vector");
+    v[1] = INFINITY;
+    expect(!vec3f_normalize_fixed(v), "vec3f_normalize_fixed takes an infinite vector");
+    v[1] = NAN;
+    expect(!vec3f_normalize_fixed(v), "vec3f_normalize_fixed takes a NaN vector");
+    v[1] = 1e-40f;
+    expect(!vec3f_normalize_fixed(v), "vec3f_normalize_fixed takes a denormal vector");
+}
+
+static void check_inv_sqrtf(void) {
+    struct ErrorStats stats = { "fixed_inv_sqrtf", 0, 0 };
+    f32 f;
+    double want;
+    int n;
+
+    for (n = 0; n < NUM_SAMPLES; n++) {
+        f = fabsf(rand_f32_log(-100, 100));
+        want = 1.0 / sqrt(f);
+        check_error(&stats, fixed_inv_sqrtf(f), want, exp2(-20) * want);
+    }
+    report(&stats);
+
+    // the fallback cases give what the float code gives
+    expect(isinf(fixed_inv_sqrtf(0.0f)), "fixed_inv_sqrtf(0) isn't infinite");
+    expect(fixed_inv_sqrtf(INFINITY) == 0.0f, "fixed_inv_sqrtf(inf) isn't 0");
+    expect(isnan(fixed_inv_sqrtf(-1.0f)), "fixed_inv_sqrtf(-1) isn't NaN");
+}
+
+int main(void) {
+    check_mtxf_mul();
+    check_mtxf_billboard();
+    check_mtxf_mul_vec3s();
+    check_rotations();
+    check_vec3f_normalize();
+    check_inv_sqrtf();
+
+    if (sFailures != 0) {
+        printf("%d checks failed\n", sFailures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
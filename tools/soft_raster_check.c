@@ -0,0 +1,304 @@
+// soft_raster_check.c - host check of the fix32 rasterizers in src/pc/gfx/gfx_backend.c against the
+// fix64 ones they stand in for. Built by "make -C tools check", not by the game build.
+//
+// gfx_backend.c is included as a whole and drives itself through gfx_soft_api, the way the frontend
+// does. The same fixed set of triangles is drawn once with configFastRasterizer off and once with it
+// on, and the two frames are diffed: depth tells which pixels each path covered, and the colors of
+// pixels both covered are compared. The set mixes random flat and perspective triangles, shaded and
+// textured, with slivers, triangles far past the screen edges and edges steep enough to leave the
+// fix32 range. Run with a file name prefix to also write both frames and the diff as PPM images.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gfx/gfx_backend.c"
+#include "gfx/gfx_cc.c"
+
+#define SCREEN_W 320
+#define SCREEN_H 240
+#define NUM_RANDOM_TRIS 400
+
+// pixels covered by only one of the paths, per thousand covered pixels
+#define MAX_COVERAGE_DIFF 1
+// pixels whose color differs by more than one step of the framebuffer, per thousand compared
+// there is no bound on how much they differ: where a texture coordinate sits on a texel boundary,
+// the paths can round it to different texels
+#define MAX_COLOR_DIFF_RATE 5
+
+// the rest of the game provides these
+struct GfxDimensions gfx_current_dimensions = { SCREEN_W, SCREEN_H, 4.0f / 3.0f };
+bool configFastRasterizer = true;
+bool configTileBinning = false;
+bool configHiZ = false;
+unsigned int configPerspSubdiv = 1; // exact perspective, the affine and subdivided spans are approximations
+unsigned int configTextureBudget = 256;
+int numOccludedTris;
+int texEvictions;
+int texBytes;
+
+struct TestVertex {
+    double x, y, z, w; // x and y in NDC, z from 0 to 1, all before the divide by w
+    double u, v;       // normalized texture coordinates
+    int r, g, b;
+};
+
+struct TestTri {
+    struct TestVertex v[3];
+    bool textured;
+};
+
+static struct TestTri sTris[NUM_RANDOM_TRIS + 16];
+static int sNumTris;
+
+static unsigned int sRandState = 0x2545F491;
+
+static unsigned int rand_u32(void) {
+    sRandState ^= sRandState << 13;
+    sRandState ^= sRandState >> 17;
+    sRandState ^= sRandState << 5;
+    return sRandState;
+}
+
+/// uniform in [lo, hi)
+static double rand_range(double lo, double hi) {
+    return lo + (double) rand_u32() / 4294967296.0 * (hi - lo);
+}
+
+static struct TestVertex make_vertex(double x, double y, double z, double w) {
+    return (struct TestVertex) {
+        x, y, z, w,
+        rand_range(-2.0, 2.0), rand_range(-2.0, 2.0),
+        (int) (rand_u32() & 0xFF), (int) (rand_u32() & 0xFF), (int) (rand_u32() & 0xFF),
+    };
+}
+
+static void add_tri(struct TestVertex a, struct TestVertex b, struct TestVertex c, bool textured) {
+    sTris[sNumTris].v[0] = a;
+    sTris[sNumTris].v[1] = b;
+    sTris[sNumTris].v[2] = c;
+    sTris[sNumTris].textured = textured;
+    sNumTris++;
+}
+
+static void make_triangles(void) {
+    int i;
+
+    for (i = 0; i < NUM_RANDOM_TRIS; i++) {
+        // centers spread a bit past the screen, sizes from a few pixels up to about the screen
+        double cx = rand_range(-1.2, 1.2);
+        double cy = rand_range(-1.2, 1.2);
+        double size = exp2(rand_range(-6.0, 0.5));
+        bool persp = i & 1;
+        struct TestVertex v[3];
+        int j;
+
+        for (j = 0; j < 3; j++) {
+            double w = persp ? rand_range(1.0, 40.0) : 2.0;
+            v[j] = make_vertex(cx + rand_range(-size, size), cy + rand_range(-size, size), rand_range(0.05, 0.95), w);
+        }
+        add_tri(v[0], v[1], v[2], (i & 2) != 0);
+    }
+
+    // slivers one pixel wide or less, along each axis and diagonally
+    add_tri(make_vertex(-0.9, -0.5, 0.1, 1.0), make_vertex(0.9, -0.5 + 0.004, 0.1, 1.0), make_vertex(0.9, -0.5 + 0.008, 0.1, 1.0), false);
+    add_tri(make_vertex(0.3, -0.9, 0.1, 1.0), make_vertex(0.3 + 0.003, 0.9, 0.1, 3.0), make_vertex(0.3 + 0.006, 0.9, 0.1, 1.0), true);
+    add_tri(make_vertex(-0.8, -0.8, 0.1, 1.0), make_vertex(0.8, 0.8, 0.1, 1.0), make_vertex(0.8, 0.805, 0.1, 1.0), false);
+    // vertices thousands of pixels off screen, the fix32 walk can still hold them
+    add_tri(make_vertex(-40.0, -0.6, 0.2, 1.0), make_vertex(40.0, -0.4, 0.2, 1.0), make_vertex(0.0, 0.6, 0.2, 4.0), true);
+    // vertices past the fix32 range
+    add_tri(make_vertex(-300.0, 0.1, 0.15, 1.0), make_vertex(300.0, 0.2, 0.15, 1.0), make_vertex(0.0, 0.9, 0.15, 1.0), false);
+    // nearly flat edges: a few hundred thousand pixels of x over a scanline
+    add_tri(make_vertex(-0.5, 0.3, 0.12, 1.0), make_vertex(90.0, 0.3 + 0.008, 0.12, 1.0), make_vertex(0.2, 0.7, 0.12, 1.0), true);
+    add_tri(make_vertex(0.4, -0.3, 0.12, 1.0), make_vertex(-90.0, -0.3 + 0.0085, 0.12, 1.0), make_vertex(-0.1, -0.7, 0.12, 1.0), false);
+    // exactly flat top and bottom edges
+    add_tri(make_vertex(-0.6, 0.25, 0.3, 1.0), make_vertex(0.6, 0.25, 0.3, 2.0), make_vertex(0.0, 0.55, 0.3, 1.0), true);
+    add_tri(make_vertex(-0.6, -0.25, 0.3, 1.0), make_vertex(0.6, -0.25, 0.3, 2.0), make_vertex(0.0, -0.55, 0.3, 1.0), false);
+}
+
+static uint8_t sTexture[32 * 32 * 4];
+
+static void make_texture(void) {
+    int x, y;
+
+    for (y = 0; y < 32; y++) {
+        for (x = 0; x < 32; x++) {
+            uint8_t *t = &sTexture[(y * 32 + x) * 4];
+            int checker = ((x >> 2) ^ (y >> 2)) & 1;
+            t[0] = x * 8;
+            t[1] = y * 8;
+            t[2] = checker ? 0xFF : 0x20;
+            t[3] = 0xFF;
+        }
+    }
+}
+
+/// writes the vertices the way gfx_emit_vertex() does: projected, with the properties times 1/w
+static size_t emit_vertex(fix64 *buf, const struct TestVertex *v, bool textured) {
+    const double w_inv = 1.0 / v->w;
+    size_t n = 0;
+
+    buf[n++] = DOUBLE_2_FIX(v->x);
+    buf[n++] = DOUBLE_2_FIX(v->y);
+    buf[n++] = DOUBLE_2_FIX(v->z);
+    buf[n++] = DOUBLE_2_FIX(w_inv);
+    if (textured) {
+        buf[n++] = DOUBLE_2_FIX(v->u * w_inv);
+        buf[n++] = DOUBLE_2_FIX(v->v * w_inv);
+    }
+    buf[n++] = DOUBLE_2_FIX(v->r * w_inv);
+    buf[n++] = DOUBLE_2_FIX(v->g * w_inv);
+    buf[n++] = DOUBLE_2_FIX(v->b * w_inv);
+    return n;
+}
+
+struct Frame {
+    gfx_pixel_t color[SCREEN_W * SCREEN_H];
+    uint16_t depth[SCREEN_W * SCREEN_H];
+};
+
+static struct Frame sFrames[2];
+
+static void render(struct Frame *frame, bool fast, uint32_t texture_id) {
+    // the rasterizer is picked when a shader is created
+    struct ShaderProgram *shade, *textured;
+    fix64 buf[3 * 9];
+    int i, j;
+
+    configFastRasterizer = fast;
+    textured = gfx_soft_api.create_and_load_new_shader(SHADER_TEXEL0 | (SHADER_INPUT_1 << 6));
+    shade = gfx_soft_api.create_and_load_new_shader(SHADER_INPUT_1 << 9);
+
+    gfx_soft_api.start_frame();
+    memset(gfx_output, 0, SCREEN_W * SCREEN_H * sizeof(gfx_pixel_t));
+    memset(z_buffer, 0xFF, SCREEN_W * SCREEN_H * sizeof(*z_buffer));
+    memset(z_stale, 0, hiz_w * hiz_h);
+    gfx_soft_api.set_viewport(0, 0, SCREEN_W, SCREEN_H);
+    gfx_soft_api.set_scissor(0, 0, SCREEN_W, SCREEN_H);
+    gfx_soft_api.set_depth_test(true);
+    gfx_soft_api.set_depth_mask(true);
+    gfx_soft_api.set_use_alpha(false);
+
+    for (i = 0; i < sNumTris; i++) {
+        size_t len = 0;
+
+        if (sTris[i].textured) {
+            gfx_soft_api.load_shader(textured);
+            gfx_soft_api.select_texture(0, texture_id);
+        } else {
+            gfx_soft_api.load_shader(shade);
+        }
+        for (j = 0; j < 3; j++) {
+            len += emit_vertex(buf + len, &sTris[i].v[j], sTris[i].textured);
+        }
+        gfx_soft_api.draw_triangles(buf, len, 1);
+    }
+    gfx_soft_api.end_frame();
+
+    memcpy(frame->color, gfx_output, sizeof(frame->color));
+    memcpy(frame->depth, z_buffer, sizeof(frame->depth));
+}
+
+static void pixel_rgb(gfx_pixel_t p, int rgb[3]) {
+#ifdef SOFTRAST_RGB565
+    rgb[0] = ((p >> 11) & 0x1F) << 3;
+    rgb[1] = ((p >> 5) & 0x3F) << 2;
+    rgb[2] = (p & 0x1F) << 3;
+#else
+    rgb[0] = p & 0xFF;
+    rgb[1] = (p >> 8) & 0xFF;
+    rgb[2] = (p >> 16) & 0xFF;
+#endif
+}
+
+static void write_ppm(const char *prefix, const char *name, const int *rgb) {
+    char path[512];
+    FILE *f;
+    int i;
+
+    snprintf(path, sizeof(path), "%s%s.ppm", prefix, name);
+    f = fopen(path, "wb");
+    if (f == NULL) {
+        perror(path);
+        return;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", SCREEN_W, SCREEN_H);
+    // the framebuffer is stored bottom row first
+    for (i = SCREEN_H - 1; i >= 0; i--) {
+        int x;
+        for (x = 0; x < SCREEN_W; x++) {
+            const int *c = &rgb[(i * SCREEN_W + x) * 3];
+            fputc(c[0], f);
+            fputc(c[1], f);
+            fputc(c[2], f);
+        }
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    static int images[3][SCREEN_W * SCREEN_H * 3];
+    long covered = 0, coverage_diff = 0, compared = 0, color_diff = 0;
+    int worst = 0;
+    // one step of the framebuffer's coarsest channel
+#ifdef SOFTRAST_RGB565
+    const int step = 8;
+#else
+    const int step = 1;
+#endif
+    uint32_t texture_id;
+    int i, ok;
+
+    make_triangles();
+    make_texture();
+
+    gfx_soft_api.init();
+    texture_id = gfx_soft_api.new_texture();
+    gfx_soft_api.select_texture(0, texture_id);
+    gfx_soft_api.upload_texture(sTexture, 32, 32);
+    gfx_soft_api.set_sampler_parameters(0, false, G_TX_WRAP, G_TX_WRAP);
+
+    render(&sFrames[0], false, texture_id);
+    render(&sFrames[1], true, texture_id);
+
+    for (i = 0; i < SCREEN_W * SCREEN_H; i++) {
+        bool in64 = sFrames[0].depth[i] != 0xFFFF;
+        bool in32 = sFrames[1].depth[i] != 0xFFFF;
+        int *c64 = &images[0][i * 3], *c32 = &images[1][i * 3], *d = &images[2][i * 3];
+        int k, diff = 0;
+
+        pixel_rgb(sFrames[0].color[i], c64);
+        pixel_rgb(sFrames[1].color[i], c32);
+        covered += in64 || in32;
+        if (in64 != in32) {
+            coverage_diff++;
+            d[0] = 0xFF;
+            d[1] = d[2] = 0;
+            continue;
+        }
+        for (k = 0; k < 3; k++) {
+            int c = abs(c64[k] - c32[k]);
+            diff = c > diff ? c : diff;
+        }
+        d[0] = d[1] = d[2] = diff * 8 > 0xFF ? 0xFF : diff * 8;
+        if (in64) {
+            compared++;
+            color_diff += diff > step;
+            worst = diff > worst ? diff : worst;
+        }
+    }
+
+    if (argc > 1) {
+        write_ppm(argv[1], "fix64", images[0]);
+        write_ppm(argv[1], "fix32", images[1]);
+        write_ppm(argv[1], "diff", images[2]);
+    }
+
+    ok = coverage_diff * 1000 <= covered * MAX_COVERAGE_DIFF
+        && color_diff * 1000 <= compared * MAX_COLOR_DIFF_RATE;
+    printf("%d triangles, %ld pixels covered, %ld covered by one path only, %ld of %ld differ by more than %d, "
+           "worst channel difference %d  %s\n",
+           sNumTris, covered, coverage_diff, color_diff, compared, step, worst, ok ? "ok" : "FAIL");
+
+    gfx_soft_api.shutdown();
+    return ok ? 0 : 1;
+}
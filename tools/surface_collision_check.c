@@ -0,0 +1,492 @@
+// surface_collision_check.c - host check of the floor and ceiling queries of src/engine/surface_collision.c
+// against the f32 queries they replace. Built by "make -C tools check", not by the game build.
+//
+// surface_load.c and surface_collision.c are included as they are, and every level area's collision
+// data is loaded with load_area_terrain(). Object collision models of the same level are loaded as
+// dynamic surfaces with load_object_collision_model(), over a few frames where some of the objects
+// move and the rest keep their surfaces, which have to be the surfaces a new load gives. Points sampled over the floors and ceilings and anywhere in
+// the level are queried with find_floor() and find_ceil(), and with the f32 queries as they were
+// before the surfaces were baked, walking the partition lists that the baked runs are made from.
+// Both have to pick the same surface at nearly the same height, unless the point is that close to
+// the 78 unit buffer of a surface, where either answer is right.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "math_util.c"
+#include "surface_load.c"
+#include "surface_collision.c"
+
+#include "surface_terrains.h"
+#include "level_misc_macros.h"
+#include "special_preset_names.h"
+#include "special_presets.h"
+
+struct CheckCollision {
+    const char *path;
+    const Collision *data;
+};
+
+#include "surface_collision_check_data.h"
+
+#define NUM_FRAMES 3
+#define NUM_OBJECTS 8
+#define NUM_SAMPLES 20000
+
+// The f32 queries round x * nx + nz * z + oo to a few thousandths of a unit and divide that by ny, so
+// the heights can only be held to a difference that grows with 1 / |ny|, up to 0.4 units on the
+// steepest floors and ceilings
+#define MAX_HEIGHT_DIFF_TIMES_NY 0.004f
+
+// the rest of surface_load.c, surface_collision.c and math_util.c need these
+Vec3f gVec3fZero = { 0.0f, 0.0f, 0.0f };
+struct Object *gCurrentObject;
+struct Object *gMarioObject;
+struct MarioState *gMarioState;
+u32 gTimeStopState;
+s16 *gEnvironmentRegions;
+s32 gEnvironmentLevels[20];
+s16 gCCMEnteredSlide;
+s16 gCheckingSurfaceCollisionsForCamera;
+s16 gFindFloorIncludeSurfaceIntangible;
+s32 gSurfaceNodesAllocated;
+s32 gSurfacesAllocated;
+s32 gNumStaticSurfaceNodes;
+s32 gNumStaticSurfaces;
+s32 gNumFindFloorMisses;
+struct NumTimesCalled gNumCalls;
+const BehaviorScript bhvDddWarp[1];
+
+void guMtxF2L(UNUSED float mf[4][4], UNUSED Mtx *m) {
+}
+
+void *main_pool_alloc(u32 size, UNUSED u32 side) {
+    return malloc(size);
+}
+
+void *segmented_to_virtual(const void *addr) {
+    return (void *) addr;
+}
+
+void reset_red_coins_collected(void) {
+}
+
+void set_text_array_x_y(UNUSED s32 xOffset, UNUSED s32 yOffset) {
+}
+
+void print_debug_top_down_mapinfo(UNUSED const char *str, UNUSED s32 number) {
+}
+
+f32 dist_between_objects(UNUSED struct Object *obj1, UNUSED struct Object *obj2) {
+    return 0.0f;
+}
+
+void obj_build_transform_from_pos_and_angle(struct Object *obj, s16 posIndex, s16 angleIndex) {
+    Vec3s rotation;
+
+    rotation[0] = obj->rawData.asS32[angleIndex + 0];
+    rotation[1] = obj->rawData.asS32[angleIndex + 1];
+    rotation[2] = obj->rawData.asS32[angleIndex + 2];
+    mtxf_rotate_zxy_and_translate(obj->transform, &obj->rawData.asF32[posIndex], rotation);
+}
+
+void obj_apply_scale_to_matrix(struct Object *obj, Mat4 dst, Mat4 src) {
+    s32 i, j;
+
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < 4; j++) {
+            dst[i][j] = (i < 3 && j < 3) ? src[i][j] * obj->header.gfx.scale[i] : src[i][j];
+        }
+    }
+}
+
+// special objects aren't spawned, only skipped over like get_special_objects_size() does
+void spawn_special_objects(UNUSED s16 areaIndex, s16 **specialObjList) {
+    static const s8 extraShorts[] = { 0, 1, 2, 3, 1 }; // by SPTYPE_
+    s32 numOfSpecialObjects = *(*specialObjList)++;
+    s32 offset;
+
+    while (numOfSpecialObjects--) {
+        for (offset = 0; SpecialObjectPresets[offset].preset_id != (u8) **specialObjList; offset++) {
+        }
+        *specialObjList += 4 + extraShorts[SpecialObjectPresets[offset].type];
+    }
+}
+
+void spawn_macro_objects(UNUSED s16 areaIndex, UNUSED s16 *macroObjList) {
+}
+
+void spawn_macro_objects_hardcoded(UNUSED s16 areaIndex, UNUSED s16 *macroObjList) {
+}
+
+int floorMemoHits;
+int floorMemoMisses;
+
+static struct Object sObjects[NUM_OBJECTS];
+static struct Surface sKeptSurfaces[2300];
+
+static int sFailures;
+
+static unsigned int sRandState = 0x12345678;
+
+static unsigned int rand_u32(void) {
+    sRandState ^= sRandState << 13;
+    sRandState ^= sRandState >> 17;
+    sRandState ^= sRandState << 5;
+    return sRandState;
+}
+
+/// uniform in [0, 1)
+static f32 rand_unit(void) {
+    return (f32) ((double) rand_u32() / 4294967296.0);
+}
+
+/// a random point on a surface
+static void rand_point_on_surface(struct Surface *surf, f32 pos[3]) {
+    f32 a = rand_unit();
+    f32 b = rand_unit();
+    s32 i;
+
+    if (a + b > 1.0f) {
+        a = 1.0f - a;
+        b = 1.0f - b;
+    }
+    for (i = 0; i < 3; i++) {
+        pos[i] = surf->vertex1[i] + a * (surf->vertex2[i] - surf->vertex1[i])
+                 + b * (surf->vertex3[i] - surf->vertex1[i]);
+    }
+}
+
+/// a random floor or ceiling out of the loaded surfaces
+static struct Surface *rand_floor_or_ceil(void) {
+    struct Surface *surf;
+    s32 tries;
+
+    for (tries = 0; tries < 100; tries++) {
+        surf = &sSurfacePool[rand_u32() % gSurfacesAllocated];
+        if (surf->normal.y > 0.01 || surf->normal.y < -0.01) {
+            return surf;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * The f32 queries, as they were before the static partition was baked and the heights went to
+ * fixed point. sNearestEdge tracks how close the query came to the 78 unit buffer of a surface it
+ * looked at, times |ny| like MAX_HEIGHT_DIFF_TIMES_NY, with a unit of slack for the height the
+ * intangible floor check retries from.
+ */
+static f32 sNearestEdge;
+
+static void note_edge(struct Surface *surf, f32 distance, f32 slack) {
+    distance = (fabsf(distance) - slack) * fabsf(surf->normal.y);
+    if (distance < sNearestEdge) {
+        sNearestEdge = distance;
+    }
+}
+
+static s32 laterally_inside(struct Surface *surf, s32 x, s32 z, s32 sign) {
+    s32 x1 = surf->vertex1[0], z1 = surf->vertex1[2];
+    s32 x2 = surf->vertex2[0], z2 = surf->vertex2[2];
+    s32 x3 = surf->vertex3[0], z3 = surf->vertex3[2];
+
+    return sign * ((z1 - z) * (x2 - x1) - (x1 - x) * (z2 - z1)) >= 0
+           && sign * ((z2 - z) * (x3 - x2) - (x2 - x) * (z3 - z2)) >= 0
+           && sign * ((z3 - z) * (x1 - x3) - (x3 - x) * (z1 - z3)) >= 0;
+}
+
+static s32 skipped_surface(struct Surface *surf) {
+    if (gCheckingSurfaceCollisionsForCamera != 0) {
+        return surf->flags & SURFACE_FLAG_NO_CAM_COLLISION;
+    }
+    return surf->type == SURFACE_CAMERA_BOUNDARY;
+}
+
+static struct Surface *f32_floor_from_list(struct SurfaceNode *node, s32 x, s32 y, s32 z, f32 slack,
+                                           f32 *pheight) {
+    struct Surface *surf;
+    f32 height;
+
+    for (; node != NULL; node = node->next) {
+        surf = node->surface;
+        if (!laterally_inside(surf, x, z, 1) || skipped_surface(surf) || surf->normal.y == 0.0f) {
+            continue;
+        }
+
+        height = -(x * surf->normal.x + surf->normal.z * z + surf->originOffset) / surf->normal.y;
+        note_edge(surf, y - (height + -78.0f), slack);
+        if (y - (height + -78.0f) < 0.0f) {
+            continue;
+        }
+
+        *pheight = height;
+        return surf;
+    }
+    return NULL;
+}
+
+static struct Surface *f32_ceil_from_list(struct SurfaceNode *node, s32 x, s32 y, s32 z, f32 *pheight) {
+    struct Surface *surf;
+    f32 height;
+
+    for (; node != NULL; node = node->next) {
+        surf = node->surface;
+        if (!laterally_inside(surf, x, z, -1) || skipped_surface(surf) || surf->normal.y == 0.0f) {
+            continue;
+        }
+
+        height = -(x * surf->normal.x + surf->normal.z * z + surf->originOffset) / surf->normal.y;
+        note_edge(surf, y - (height - -78.0f), 0.0f);
+        if (y - (height - -78.0f) > 0.0f) {
+            continue;
+        }
+
+        *pheight = height;
+        return surf;
+    }
+    return NULL;
+}
+
+static s32 cell_index(s16 coord) {
+    return ((coord + LEVEL_BOUNDARY_MAX) / CELL_SIZE) & (NUM_CELLS - 1);
+}
+
+static f32 f32_find_floor(s16 x, s16 y, s16 z, s32 includeIntangible, struct Surface **pfloor) {
+    struct SurfaceNode *staticList = gStaticSurfacePartition[cell_index(z)][cell_index(x)][SPATIAL_PARTITION_FLOORS].next;
+    struct SurfaceNode *dynamicList = gDynamicSurfacePartition[cell_index(z)][cell_index(x)][SPATIAL_PARTITION_FLOORS].next;
+    struct Surface *floor, *dynamicFloor;
+    f32 height = -11000.0f;
+    f32 dynamicHeight = -11000.0f;
+
+    dynamicFloor = f32_floor_from_list(dynamicList, x, y, z, 0.0f, &dynamicHeight);
+    floor = f32_floor_from_list(staticList, x, y, z, 0.0f, &height);
+    if (!includeIntangible && floor != NULL && floor->type == SURFACE_INTANGIBLE) {
+        floor = f32_floor_from_list(staticList, x, (s32)(height - 200.0f), z, 1.0f, &height);
+    }
+
+    if (dynamicHeight > height) {
+        floor = dynamicFloor;
+        height = dynamicHeight;
+    }
+    *pfloor = floor;
+    return height;
+}
+
+static f32 f32_find_ceil(s16 x, s16 y, s16 z, struct Surface **pceil) {
+    struct SurfaceNode *staticList = gStaticSurfacePartition[cell_index(z)][cell_index(x)][SPATIAL_PARTITION_CEILS].next;
+    struct SurfaceNode *dynamicList = gDynamicSurfacePartition[cell_index(z)][cell_index(x)][SPATIAL_PARTITION_CEILS].next;
+    struct Surface *ceil, *dynamicCeil;
+    f32 height = 20000.0f;
+    f32 dynamicHeight = 20000.0f;
+
+    dynamicCeil = f32_ceil_from_list(dynamicList, x, y, z, &dynamicHeight);
+    ceil = f32_ceil_from_list(staticList, x, y, z, &height);
+
+    if (dynamicHeight < height) {
+        ceil = dynamicCeil;
+        height = dynamicHeight;
+    }
+    *pceil = ceil;
+    return height;
+}
+
+struct QueryStats {
+    long queries;
+    long hits;
+    long atBufferEdge;
+    f32 worst; // largest height difference / allowed difference
+};
+
+static void compare(struct QueryStats *stats, const char *kind, s16 x, s16 y, s16 z,
+                    struct Surface *got, f32 gotHeight, struct Surface *want, f32 wantHeight) {
+    stats->queries++;
+
+    if (got == want) {
+        if (got != NULL) {
+            f32 ratio = fabsf(gotHeight - wantHeight) * fabsf(got->normal.y) / MAX_HEIGHT_DIFF_TIMES_NY;
+
+            if (!(ratio <= stats->worst)) { // also catches NaN
+                stats->worst = ratio;
+            }
+            stats->hits++;
+        }
+    } else if (sNearestEdge <= MAX_HEIGHT_DIFF_TIMES_NY) {
+        stats->atBufferEdge++;
+    } else {
+        sFailures++;
+        printf("  %s at (%d, %d, %d): surface %ld at %.4f, the f32 query finds %ld at %.4f\n", kind, x, y, z,
+               got == NULL ? -1L : (long) (got - sSurfacePool), gotHeight,
+               want == NULL ? -1L : (long) (want - sSurfacePool), wantHeight);
+    }
+}
+
+/// query a point both ways, the floor twice to check the memo too
+static void check_point(struct QueryStats *floors, struct QueryStats *ceils, f32 pos[3]) {
+    s16 x = (s16) pos[0], y = (s16) pos[1], z = (s16) pos[2];
+    s32 includeIntangible = rand_u32() % 4 == 0;
+    struct Surface *got, *want;
+    f32 gotHeight, wantHeight;
+    s32 i;
+
+    if (x <= -LEVEL_BOUNDARY_MAX || x >= LEVEL_BOUNDARY_MAX || z <= -LEVEL_BOUNDARY_MAX || z >= LEVEL_BOUNDARY_MAX) {
+        return;
+    }
+    gCheckingSurfaceCollisionsForCamera = rand_u32() % 4 == 0;
+
+    sNearestEdge = 1e9f;
+    wantHeight = f32_find_floor(x, y, z, includeIntangible, &want);
+    for (i = 0; i < 2; i++) {
+        gFindFloorIncludeSurfaceIntangible = includeIntangible;
+        gotHeight = find_floor(x, y, z, &got);
+        compare(floors, "floor", x, y, z, got, gotHeight, want, wantHeight);
+    }
+
+    sNearestEdge = 1e9f;
+    wantHeight = f32_find_ceil(x, y, z, &want);
+    gotHeight = find_ceil(x, y, z, &got);
+    compare(ceils, "ceiling", x, y, z, got, gotHeight, want, wantHeight);
+
+    gCheckingSurfaceCollisionsForCamera = 0;
+}
+
+/// put an object down somewhere on the loaded floors and ceilings, at a random angle
+static void place_object(struct Object *obj) {
+    struct Surface *surf = rand_floor_or_ceil();
+    f32 pos[3] = { 0.0f, 0.0f, 0.0f };
+
+    if (surf != NULL) {
+        rand_point_on_surface(surf, pos);
+    }
+    obj->oPosX = pos[0];
+    obj->oPosY = pos[1];
+    obj->oPosZ = pos[2];
+    obj->oFaceAnglePitch = (s16) rand_u32() / 8;
+    obj->oFaceAngleYaw = (s16) rand_u32();
+    obj->oFaceAngleRoll = (s16) rand_u32() / 8;
+    obj_build_transform_from_pos_and_angle(obj, O_POS_INDEX, O_FACE_ANGLE_INDEX);
+}
+
+/// give each object one of the level's object collision models that fits the vertex buffer
+static s32 set_up_objects(const char *areaPath) {
+    const struct CheckCollision *models[ARRAY_COUNT(sObjectCollision)];
+    s32 levelLength = strchr(areaPath + strlen("levels/"), '/') - areaPath + 1;
+    s32 numModels = 0;
+    s32 i;
+
+    for (i = 0; i < (s32) ARRAY_COUNT(sObjectCollision); i++) {
+        const Collision *data = sObjectCollision[i].data;
+
+        if (strncmp(sObjectCollision[i].path, areaPath, levelLength) == 0
+            && data[0] == TERRAIN_LOAD_VERTICES && data[1] <= 200) {
+            models[numModels++] = &sObjectCollision[i];
+        }
+    }
+
+    for (i = 0; i < NUM_OBJECTS && numModels > 0; i++) {
+        memset(&sObjects[i], 0, sizeof(struct Object));
+        sObjects[i].collisionData = (void *) models[i % numModels]->data;
+        sObjects[i].oCollisionDistance = 1e9f;
+        sObjects[i].oDrawingDistance = 1e9f;
+        sObjects[i].header.gfx.scale[0] = 0.5f + rand_unit();
+        sObjects[i].header.gfx.scale[1] = sObjects[i].header.gfx.scale[2] = sObjects[i].header.gfx.scale[0];
+        place_object(&sObjects[i]);
+    }
+    return numModels > 0 ? NUM_OBJECTS : 0;
+}
+
+/// a frame's dynamic surfaces, either keeping the unmoved objects' surfaces or loading them all anew
+static void load_objects(s32 numObjects, s32 loadAnew) {
+    s32 i;
+
+    clear_dynamic_surfaces();
+    if (loadAnew) {
+        sNumPrevDynamicSurfaceLoads = 0;
+    }
+    for (i = 0; i < numObjects; i++) {
+        gCurrentObject = &sObjects[i];
+        load_object_collision_model();
+    }
+}
+
+static void check_area(const struct CheckCollision *area) {
+    struct QueryStats floors = { 0, 0, 0, 0.0f };
+    struct QueryStats ceils = { 0, 0, 0, 0.0f };
+    f32 worst;
+    struct Surface *surf;
+    s32 numObjects;
+    s32 numSurfaces;
+    s32 frame, i;
+    f32 pos[3];
+    int failuresBefore = sFailures;
+
+    load_area_terrain(0, (s16 *) area->data, NULL, NULL);
+    numObjects = set_up_objects(area->path);
+
+    for (frame = 0; frame < NUM_FRAMES; frame++) {
+        // some of the objects move, the rest keep the surfaces of the last frame
+        for (i = 0; i < numObjects && frame > 0; i++) {
+            if (rand_u32() % 2 == 0) {
+                place_object(&sObjects[i]);
+            }
+        }
+
+        load_objects(numObjects, FALSE);
+        if (gSurfaceNodesAllocated >= SURFACE_NODE_POOL_SIZE || gSurfacesAllocated >= sSurfacePoolSize) {
+            sFailures++;
+            printf("  %d surfaces and %d nodes overflow the pools\n", gSurfacesAllocated, gSurfaceNodesAllocated);
+            return;
+        }
+        numSurfaces = gSurfacesAllocated - gNumStaticSurfaces;
+        memcpy(sKeptSurfaces, &sSurfacePool[gNumStaticSurfaces], numSurfaces * sizeof(struct Surface));
+        load_objects(numObjects, TRUE);
+        if (gSurfacesAllocated - gNumStaticSurfaces != numSurfaces
+            || memcmp(sKeptSurfaces, &sSurfacePool[gNumStaticSurfaces], numSurfaces * sizeof(struct Surface)) != 0) {
+            sFailures++;
+            printf("  frame %d: the kept object surfaces differ from newly loaded ones\n", frame);
+        }
+
+        for (i = 0; i < NUM_SAMPLES; i++) {
+            surf = rand_floor_or_ceil();
+            if (surf != NULL && i % 4 != 3) {
+                rand_point_on_surface(surf, pos);
+                pos[1] += ((s32) (rand_u32() % 3) - 1) * 78.0f + (rand_unit() * 6.0f - 3.0f);
+            } else {
+                pos[0] = (rand_unit() * 2.0f - 1.0f) * LEVEL_BOUNDARY_MAX;
+                pos[1] = (rand_unit() * 2.0f - 1.0f) * LEVEL_BOUNDARY_MAX;
+                pos[2] = (rand_unit() * 2.0f - 1.0f) * LEVEL_BOUNDARY_MAX;
+            }
+            check_point(&floors, &ceils, pos);
+        }
+    }
+
+    worst = MAX(floors.worst, ceils.worst);
+    if (!(worst <= 1.0f)) {
+        sFailures++;
+    }
+
+    printf("%-48s %d objects, %6ld floors %6ld ceilings found, %3ld at the buffer edge, worst height"
+           " difference %.3f of allowed  %s\n",
+           area->path, numObjects, floors.hits, ceils.hits, floors.atBufferEdge + ceils.atBufferEdge, worst,
+           sFailures == failuresBefore ? "ok" : "FAIL");
+}
+
+int main(void) {
+    u32 i;
+
+    printf("NUM_CELLS %d\n", NUM_CELLS);
+    alloc_surface_pools();
+
+    for (i = 0; i < ARRAY_COUNT(sAreaCollision); i++) {
+        check_area(&sAreaCollision[i]);
+    }
+
+    if (sFailures != 0) {
+        printf("%d checks failed\n", sFailures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}